@@ -42,6 +42,25 @@ namespace clcpp
 	};
 
 
+	//
+	// Describes container values that are laid out contiguously in memory, at a fixed
+	// stride from each other. Clients can step through these directly, rather than
+	// making a virtual call into the iterator for each value.
+	//
+	struct ContainerSpan
+	{
+		ContainerSpan()
+			: data(0)
+			, stride(0)
+		{
+		}
+
+		// Address of the first value or null if the values aren't contiguous
+		char* data;
+		unsigned int stride;
+	};
+
+
 	//
 	// The interface that the various read iterators for containers must
 	// derive from.
@@ -51,7 +70,8 @@ namespace clcpp
 		virtual ~IReadIterator() { }
 
 		// One-time initialisation of the iterator that should initialise its own internal
-		// values and write back what it knows of the container to ReadIterator.
+		// values and write back what it knows of the container to ReadIterator. If the values
+		// are contiguous, also write back their span.
 		virtual void Initialise(const Primitive* primitive, const void* container_object, ReadIterator& storage) = 0;
 
 		// Return the key/value pair at the current iterator position
@@ -72,7 +92,9 @@ namespace clcpp
 
 		// One-time initialisation of the iterator that should initialise its own internal
 		// values and write back what it knows of the container to WriteIterator. Use the count
-		// parameter to pre-allocate all the values that need writing.
+		// parameter to pre-allocate all the values that need writing. If that leaves the values
+		// constructed and contiguous, also write back their span so that clients can write to
+		// them directly, without calling AddEmpty.
 		virtual void Initialise(const Primitive* primitive, void* container_object, WriteIterator& storage, int count) = 0;
 
 		// Allocate an empty value in the container at the current iterator position and return
@@ -84,6 +106,15 @@ namespace clcpp
 		// and return a pointer to that value so that it can be written to. Moves onto the next
 		// value after the call.
 		virtual void* AddEmpty(void* key) = 0;
+
+		// Allocate count contiguous empty values at the current iterator position and return
+		// a pointer to the first, moving past them after the call. Containers that can't do
+		// this return null without allocating, leaving values to be added one at a time.
+		virtual void* AddEmptyRange(unsigned int count) { return 0; }
+
+		// Hint that the container will hold count values in total, for containers that would
+		// otherwise grow repeatedly as values are added beyond the initial count.
+		virtual void Reserve(unsigned int count) { }
 	};
 
 
@@ -111,6 +142,7 @@ namespace clcpp
 		const Type* m_ValueType;
 		bool m_KeyIsPtr;
 		bool m_ValueIsPtr;
+		ContainerSpan m_Span;
 
 	protected:
 		char m_ImplData[128];
@@ -172,6 +204,14 @@ namespace clcpp
 		{
 			return ((IWriteIterator*)m_ImplData)->AddEmpty(key);
 		}
+		void* AddEmptyRange(unsigned int count)
+		{
+			return ((IWriteIterator*)m_ImplData)->AddEmptyRange(count);
+		}
+		void Reserve(unsigned int count)
+		{
+			((IWriteIterator*)m_ImplData)->Reserve(count);
+		}
 
 	private:
 		bool m_Initialised;
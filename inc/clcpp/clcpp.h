@@ -633,6 +633,34 @@ namespace clcpp
 	};
 
 
+	//
+	// Dense identifiers assigned by the exporter to each built-in type, allowing
+	// serialisers to dispatch with a direct table index instead of a name lookup.
+	//
+	struct BuiltinKind
+	{
+		enum Value
+		{
+			NONE,
+			BOOL,
+			CHAR,
+			WCHAR_T,
+			UNSIGNED_CHAR,
+			SHORT,
+			UNSIGNED_SHORT,
+			INT,
+			UNSIGNED_INT,
+			LONG,
+			UNSIGNED_LONG,
+			LONG_LONG,
+			UNSIGNED_LONG_LONG,
+			FLOAT,
+			DOUBLE,
+			COUNT
+		};
+	};
+
+
 	//
 	// A basic built-in type that classes/structs can also inherit from
 	// Only one base type is supported until it becomes necessary to do otherwise.
@@ -660,6 +688,9 @@ namespace clcpp
 
 		// This is non-null if the type is a registered container
 		ContainerInfo* ci;
+
+		// Set for built-in types only, otherwise BuiltinKind::NONE
+		BuiltinKind::Value builtin_kind;
 	};
 
 
@@ -723,6 +754,11 @@ namespace clcpp
 
 		// This is non-null if the field is a C-Array of constant size
 		ContainerInfo* ci;
+
+		// Optional pre-encoded JSON key for class fields, emitted when clReflectExport is run with -json_keys.
+		// This is the escaped, quoted field name followed by a colon (e.g. "x":) and isn't null-terminated.
+		const char* json_key;
+		unsigned int json_key_length;
 	};
 
 
@@ -765,7 +801,7 @@ namespace clcpp
 	{
 		static const Kind KIND = KIND_TEMPLATE_TYPE;
 
-		static const int MAX_NB_ARGS = 4;
+		static const int MAX_NB_ARGS = 6;
 
 		TemplateType();
 
@@ -814,6 +850,12 @@ namespace clcpp
 
 		// Bits representing some of the flag attributes in the attribute array
 		unsigned int flag_attributes;
+
+		// Hash of the names, types, sizes and offsets of all fields, set by the exporter for classes
+		// that can be saved as a straight copy of their field bytes: those without base classes or
+		// transient fields whose fields are all built-in types, enums, nested classes of the
+		// same kind or C-arrays of these. Zero for all other classes.
+		unsigned int layout_fingerprint;
 	};
 
 
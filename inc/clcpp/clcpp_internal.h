@@ -43,6 +43,9 @@ namespace clcpp
 			CArray<PrimitiveAttribute> primitive_attributes;
 			CArray<TextAttribute> text_attributes;
 
+			// Raw allocation of all pre-encoded JSON field keys, null if they weren't exported
+			const char* json_key_data;
+
 			// A list of references to all types, enums and classes for potentially quicker
 			// searches during serialisation
 			CArray<const Type*> type_primitives;
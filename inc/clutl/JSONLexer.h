@@ -112,7 +112,17 @@ namespace clutl
 		void PushState(const clutl::JSONToken& token);
 		void PopState(clutl::JSONToken& token);
 
+		// Allocator for copies of strings loaded into StringView fields, used when strings contain escape
+		// sequences or, if copy_all_strings is set, for all strings as the input won't outlive the objects
+		void SetStringAllocator(clcpp::IAllocator* allocator, bool copy_all_strings = false);
+
+		// Record loaded pointers for patching once loading is complete, rather than storing their hash
+		void SetPtrFixups(clutl::PtrFixups* ptr_fixups);
+
 		clutl::JSONError GetError() const { return m_Error; }
+		clcpp::IAllocator* GetStringAllocator() const { return m_StringAllocator; }
+		bool CopyAllStrings() const { return m_CopyAllStrings; }
+		clutl::PtrFixups* GetPtrFixups() const { return m_PtrFixups; }
 
 
 	private:
@@ -125,6 +135,10 @@ namespace clutl
 		// One-level deep parsing state stack
 		unsigned int m_StackPosition;
 		clutl::JSONToken m_StackToken;
+
+		clcpp::IAllocator* m_StringAllocator;
+		bool m_CopyAllStrings;
+		clutl::PtrFixups* m_PtrFixups;
 	};
 
 
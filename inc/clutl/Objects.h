@@ -12,6 +12,7 @@
 
 
 #include <clcpp/clcpp.h>
+#include <clutl/Serialise.h>
 
 
 //
@@ -174,6 +175,26 @@ namespace clutl
 	};
 
 
+	//
+	// Pointer serialisation through an object group, saving pointers to named objects as their
+	// unique ID and loading them by searching the group and its parents for that ID. Pointers to
+	// anonymous objects or types that don't derive from Object are saved as null, as are loaded
+	// objects whose type doesn't derive from the pointer type.
+	//
+	class ObjectGroupPtrs : public IPtrSave, public IPtrLoad
+	{
+	public:
+		ObjectGroupPtrs(const ObjectGroup* object_group);
+
+		bool CanSavePtr(void* ptr, const clcpp::Field* field, const clcpp::Type* type);
+		unsigned int SavePtr(void* ptr);
+		void* LoadPtr(unsigned int hash, const clcpp::Type* type);
+
+	private:
+		const ObjectGroup* m_ObjectGroup;
+	};
+
+
 	//
 	// Iterator for visiting all created objects in an object group.
 	// The iterator is invalidated if objects are added/removed from the group.
@@ -20,16 +20,96 @@ namespace clutl
 {
 	struct Object;
 	class JSONContext;
+	struct JSONToken;
+
+
+	//
+	// Destination for data flushed from a streaming WriteBuffer. Sinks can consume data
+	// asynchronously, in which case WaitForWrite must block until the data passed to the
+	// previous Write call is no longer referenced.
+	//
+	struct IWriteSink
+	{
+		virtual void Write(const void* data, unsigned int length) = 0;
+		virtual void WaitForWrite() { }
+	};
+
+
+	//
+	// Sink that writes to a file descriptor; a file opened with open/_open or a socket
+	//
+	class FileDescriptorSink : public IWriteSink
+	{
+	public:
+		FileDescriptorSink(int fd);
+
+		void Write(const void* data, unsigned int length);
+
+		// Set when any write to the file descriptor fails, after which all data is discarded
+		bool HasError() const { return m_Error; }
+
+	private:
+		int m_FD;
+		bool m_Error;
+	};
+
+
+	//
+	// Sink that passes each flushed chunk to a user callback
+	//
+	class CallbackSink : public IWriteSink
+	{
+	public:
+		typedef void (*Callback)(const void* data, unsigned int length, void* user_data);
+
+		CallbackSink(Callback callback, void* user_data);
+
+		void Write(const void* data, unsigned int length);
+
+	private:
+		Callback m_Callback;
+		void* m_UserData;
+	};
 
 
 	//
 	// Growable write byte buffer
 	//
+	// When constructed with a sink, the buffer works in streaming mode: instead of growing it
+	// flushes its contents to the sink whenever its chunk is full, keeping memory use bounded
+	// by the chunk size. In this mode GetData only returns the data written since the last
+	// flush, so it can't be used for serialisers that seek back to patch data.
+	//
+	// When constructed with a reserve size, the buffer reserves that much address space up front
+	// and commits pages of it as data is written, so that growing never copies and pointers into
+	// the data stay valid. Buffers fall back to growing on the heap where virtual memory isn't
+	// supported, when the reservation fails and once the reserved space is used up.
+	//
+	// When constructed with an allocator, the buffer is made of a list of fixed-size segments
+	// that's extended with a new segment whenever the current one is full, so that no data is
+	// ever copied. The data is then output with WriteSegments or SendSegments, and Reset keeps
+	// the segments for reuse. As with streaming, GetData only returns the current segment.
+	//
 	class WriteBuffer
 	{
 	public:
 		WriteBuffer();
 		WriteBuffer(unsigned int initial_capacity);
+
+		// Streaming buffer with fixed-size chunks. If double_buffer is set, a second chunk is
+		// filled while the sink consumes the first, for use with asynchronous sinks.
+		WriteBuffer(IWriteSink* sink, unsigned int chunk_size, bool double_buffer = false);
+
+		// Virtual memory buffer reserving reserve_size bytes, with at least initial_capacity bytes
+		// committed. Both are rounded up to the commit granularity of 64KB.
+		enum VirtualMemory { VIRTUAL_MEMORY };
+		WriteBuffer(VirtualMemory, unsigned int reserve_size, unsigned int initial_capacity = 0);
+
+		// Segmented buffer allocating segments of segment_size bytes from the allocator. Single
+		// allocations bigger than that are given a segment of their own, which isn't reused.
+		WriteBuffer(clcpp::IAllocator* allocator, unsigned int segment_size);
+
+		// Streaming buffers are flushed on destruction
 		~WriteBuffer();
 
 		// Resets only the write position, ensuring none of the capacity already allocated is released
@@ -49,13 +129,96 @@ namespace clutl
 
 		void SeekRel(int offset);
 
+		// Send all buffered data to the sink, if there is one, and wait for it to be consumed
+		void Flush();
+
 		const char* GetData() const { return m_Data; }
 		unsigned int GetBytesWritten() const { return m_DataWrite - m_Data; }
 
+		// Total number of bytes sent to the sink so far, or in segments before the current one
+		clcpp::uint64 GetBytesFlushed() const { return m_BytesFlushed; }
+
+		// Set while the data is within reserved address space and won't move as it grows
+		bool IsVirtual() const { return m_VirtualReserve != 0; }
+
+		// Write all data in the buffer to a file descriptor, gathering segments into as few
+		// writes as possible. Returns false if any write fails.
+		bool WriteSegments(int fd) const;
+
+		// Pass each segment of data in the buffer to the sink in order, waiting for the sink to
+		// finish with them before returning
+		void SendSegments(IWriteSink* sink) const;
+
 	private:
+		struct Segment;
+
+		void FlushChunk();
+		void FreeData();
+		void NextSegment(unsigned int length);
+		unsigned int GetSegmentSize(const Segment* segment) const;
+
 		char* m_Data;
 		char* m_DataEnd;
 		char* m_DataWrite;
+
+		// Streaming mode state
+		IWriteSink* m_Sink;
+		char* m_SpareData;
+		char* m_SpareDataEnd;
+		clcpp::uint64 m_BytesFlushed;
+
+		// Size of the address space reserved for the data, zero when it's on the heap
+		unsigned int m_VirtualReserve;
+
+		// Segmented mode state, with the current segment last in the list
+		clcpp::IAllocator* m_SegmentAllocator;
+		unsigned int m_SegmentSize;
+		Segment* m_FirstSegment;
+		Segment* m_LastSegment;
+		Segment* m_FreeSegments;
+	};
+
+
+	//
+	// Memory mapping of an entire file, allowing it to be loaded straight from the mapped pages
+	// without first reading it into memory. Anything loaded that points into the data, such as
+	// the StringViews of a JSON load, is only valid while the file remains open. Files of 4GB or
+	// more can't be mapped.
+	//
+	class MappedFile
+	{
+	public:
+		enum Mode
+		{
+			READ_ONLY,
+
+			// The data can also be written, for loaders that patch it in place such as LoadImage.
+			// Each page is copied privately the first time it's written, leaving the file unchanged.
+			COPY_ON_WRITE,
+		};
+
+		MappedFile();
+		~MappedFile();
+
+		// Closes any file that's already open and maps the new one, returning false on failure
+		bool Open(const char* filename, Mode mode = READ_ONLY);
+		void Close();
+
+		bool IsOpen() const { return m_Data != 0; }
+		const char* GetData() const { return m_Data; }
+		unsigned int GetSize() const { return m_Size; }
+
+		// Null unless the file is open copy-on-write
+		char* GetWritableData() const { return m_Writable ? (char*)m_Data : 0; }
+
+	private:
+		// Non-copyable
+		MappedFile(const MappedFile&);
+		MappedFile& operator = (const MappedFile&);
+
+		const char* m_Data;
+		unsigned int m_Size;
+		bool m_Writable;
 	};
 
 
@@ -68,6 +231,12 @@ namespace clutl
 	public:
 		ReadBuffer(const WriteBuffer& write_buffer);
 
+		// Read from existing memory, which must outlive the buffer
+		ReadBuffer(const void* data, unsigned int length);
+
+		// Read from a mapped file, which must remain open for the life time of the buffer
+		ReadBuffer(const MappedFile& mapped_file);
+
 		// TODO: Not entirely convinced by this API with regards to the ability of its users
 		//  to quickly, safely and easily detect buffer overflow scenarios before it asserts.
 		void Read(void* data, unsigned int length);
@@ -95,9 +264,250 @@ namespace clutl
 	};
 
 
+	//
+	// Counterpart to IPtrSave, mapping the hashes returned by SavePtr back to objects
+	//
+	struct IPtrLoad
+	{
+		// Return the object that was saved with the given hash, or null if there isn't one.
+		// As with IPtrSave, type is the type pointed to by the field or container value.
+		virtual void* LoadPtr(unsigned int hash, const clcpp::Type* type) = 0;
+	};
+
+
+	//
+	// Pointers loaded as the hash they were saved with, to be patched once all the objects they
+	// can point to have been loaded. Any number of loads can share the same fixups, allowing
+	// pointers between objects loaded separately, and the location of each loaded pointer must
+	// remain valid until Resolve is called.
+	//
+	// Objects added to the fixups are stored in a hash table that's searched before any IPtrLoad
+	// passed to Resolve, so that graphs saved with their own object IDs can be loaded without
+	// implementing one.
+	//
+	class PtrFixups
+	{
+	public:
+		PtrFixups();
+
+		// Record a pointer to be patched with the object saved with the given hash. Zero hashes
+		// are null pointers, which are set immediately.
+		void AddPtr(void** ptr, unsigned int hash, const clcpp::Type* type);
+
+		// Register an object to resolve hashes with, replacing any previous object with the same hash
+		void AddObject(unsigned int hash, void* object);
+
+		// Patch all pointers recorded since the last call, returning the number that couldn't be
+		// resolved and were set to null. Added objects are kept for later calls.
+		unsigned int Resolve(IPtrLoad* ptr_load = 0);
+
+		// Forget all recorded pointers and added objects
+		void Reset();
+
+		unsigned int GetNbPtrs() const;
+
+	private:
+		void* FindObject(unsigned int hash) const;
+
+		WriteBuffer m_Ptrs;
+
+		// Open-addressed hash table of added objects, with a power of two capacity
+		WriteBuffer m_Objects;
+		unsigned int m_NbObjects;
+	};
+
+
+	//
+	// Worker pool implemented by the client for serialisers that can split their work
+	//
+	struct IParallelFor
+	{
+		typedef void (*Function)(void* data, unsigned int index);
+
+		// Call the function once for each index in [0, count), in any order and on any threads,
+		// returning only when all calls have completed
+		virtual void Run(Function function, void* data, unsigned int count) = 0;
+	};
+
+
+	//
+	// Custom flag attribute for quickly identifying StringView types
+	//
+	enum
+	{
+		FLAG_ATTR_IS_STRING_VIEW = 0x40000000,
+	};
+
+
+	//
+	// A string that isn't null-terminated and doesn't own its data. LoadJSON points views directly
+	// into its input where possible, so the input must outlive the loaded objects. Strings with
+	// escape sequences are decoded into a copy made with the allocator passed to LoadJSON. Without
+	// an allocator, they're left pointing at the undecoded string in the input.
+	//
+	struct clcpp_attr(reflect_part, custom_flag = 0x40000000) StringView
+	{
+		StringView()
+			: data(0)
+			, length(0)
+		{
+		}
+
+		const char* data;
+		unsigned int length;
+	};
+
+
+	//
+	// Layouts shared by the versioned binary objects written to or read from one stream, such as a
+	// network connection. Each class, enum and container is only described by the first object
+	// that uses it, with later objects referring back to it by index. The plans built to load
+	// each saved type are also kept for the life of the stream. A stream is used either for saving
+	// or for loading, and objects must be loaded in the order they were saved.
+	//
+	class VersionedBinaryStream
+	{
+	public:
+		// Forget all layouts and plans, e.g. when a connection is re-established
+		void Reset();
+
+	private:
+		friend void SaveVersionedBinary(WriteBuffer&, const void*, const clcpp::Type*, VersionedBinaryStream*, IPtrSave*);
+		friend bool LoadVersionedBinary(ReadBuffer&, void*, const clcpp::Type*, VersionedBinaryStream*, PtrFixups*);
+
+		// Types described by saves, in the order they were described
+		WriteBuffer m_SavedTypes;
+
+		// Name hashes of the types described to loads and their decoded layouts
+		WriteBuffer m_TypeHashes;
+		WriteBuffer m_Classes;
+		WriteBuffer m_Enums;
+		WriteBuffer m_Containers;
+
+		// Plans for loading saved types
+		WriteBuffer m_Plans;
+		WriteBuffer m_PlanOps;
+		WriteBuffer m_ContainerPlans;
+		WriteBuffer m_EnumMaps;
+		WriteBuffer m_EnumValues;
+	};
+
+
 	// Binary serialisation
-	void SaveVersionedBinary(WriteBuffer& out, const void* object, const clcpp::Type* type);
-	void LoadVersionedBinary(ReadBuffer& in, void* object, const clcpp::Type* type);
+	// The layout of each saved class is described once at the start of the data, allowing classes
+	// to add, remove, reorder and change the type of fields between saving and loading. Classes with
+	// an unchanged layout fingerprint and no padding are loaded as a single copy, all others with a
+	// plan that maps saved fields to loaded fields, built once for each class in the data. Containers are saved
+	// through their iterators as a value count followed by their keys and values, with contiguous
+	// values of trivially copyable types copied in one go. Containers that no longer exist or have
+	// changed their parameters are skipped. Sizes and counts are variable-length integers and the
+	// data is written front to back, so streaming write buffers can be used. If a stream is given,
+	// layouts are only described the first time they're used within it. Pointer fields are saved as
+	// the hash given by IPtrSave and loaded into the pointer fixups, if any, ready to be resolved once
+	// everything they point to has been loaded. Containers of pointers can't be saved.
+	//
+	// Loading returns false if the data is corrupt or holds an object of a different type, which is
+	// skipped. Corrupt data is skipped up to the end of the input, leaving the object partially loaded.
+	void SaveVersionedBinary(WriteBuffer& out, const void* object, const clcpp::Type* type, VersionedBinaryStream* stream = 0, IPtrSave* ptr_save = 0);
+	bool LoadVersionedBinary(ReadBuffer& in, void* object, const clcpp::Type* type, VersionedBinaryStream* stream = 0, PtrFixups* ptr_fixups = 0);
+
+
+	// Memory images
+	// The graph of objects reachable from each root object is copied into one contiguous block, in the
+	// same way that clReflectExport lays out the reflection database. Each object reached through a
+	// pointer is copied once, with every pointer to it replaced by its offset within the image and
+	// listed in a relocation table. Strings are copied up to their null terminator and the data of
+	// string views and clcpp::CArray containers is copied alongside them; no other template types
+	// can be saved. Transient fields are cleared, as are pointers to types with no known size.
+	// Pointers are assumed to point to the start of an object of their field type.
+	//
+	// Objects are copied as they are in memory, so an image can only be loaded by a build with the
+	// same type layouts and pointer size. Virtual function tables aren't reflected, so their pointers
+	// are copied as they are and objects with virtual functions are only usable within the process
+	// that saved them. Returns false without writing anything if any other template type is
+	// reachable from the roots.
+	bool SaveImage(WriteBuffer& out, const void* const* objects, const clcpp::Type* const* types, unsigned int nb_objects);
+
+	// Patch all pointers in an image, read or mapped copy-on-write into memory aligned to 16 bytes, and
+	// return the address of each root object within it. The image must be loaded with the same root
+	// types it was saved with and outlive the objects, which are never destructed. Returns false if the
+	// image tables are invalid, in which case its contents may have been partially patched. Object data
+	// isn't checked, so images should only be loaded from trusted sources.
+	bool LoadImage(void* image, unsigned int size, void** objects, const clcpp::Type* const* types, unsigned int nb_objects);
+
+
+	struct DeltaFlags
+	{
+		enum
+		{
+			// Changed fields are marked in a bitmask with one bit per field, rather than listed by
+			// name hash. This is smaller unless few fields of large classes change, but the saving
+			// and applying code must be built with the same field lists for each class.
+			FIELD_BITMASKS = 0x01,
+		};
+	};
+
+
+	// Delta serialisation
+	// Only the fields of an object that differ from a baseline object of the same type are saved,
+	// for replicating state that changes a little at a time. Trivially copyable objects are compared
+	// with memcmp, nested classes are saved as deltas of their own and containers that differ are
+	// saved in full. Base class fields are included; transient and pointer fields, and containers
+	// of pointers, are not. Without a baseline, every field is saved. String views are compared and
+	// saved by their characters. The data is written front to back, so streaming and segmented
+	// write buffers can be used.
+	//
+	// Deltas are applied to an object holding the same baseline, with the same flags they were
+	// saved with. Applied string views point into the delta data, which must outlive them. Returns
+	// false if the data is invalid, in which case the object may have been partially updated.
+	void SaveDelta(WriteBuffer& out, const void* object, const void* baseline, const clcpp::Type* type, unsigned int flags = 0);
+	bool ApplyDelta(ReadBuffer& in, void* object, const clcpp::Type* type, unsigned int flags = 0);
+
+
+	struct MsgPackError
+	{
+		enum Code
+		{
+			NONE,
+			UNEXPECTED_END_OF_DATA,
+			INVALID_FORMAT,
+			NESTING_TOO_DEEP,
+		};
+
+		MsgPackError()
+			: code(NONE)
+			, position(0)
+		{
+		}
+
+		Code code;
+
+		// Position in the data buffer where the error occurred
+		unsigned int position;
+	};
+
+
+	struct MsgPackFlags
+	{
+		enum
+		{
+			// Field keys are written as their 32-bit name hash instead of the name string, which is
+			// smaller for names longer than 4 characters and avoids hashing names on load
+			HASH_FIELD_KEYS = 0x01,
+		};
+	};
+
+
+	// MessagePack serialisation
+	// Objects are walked the same way as JSON: classes are maps from field name to value, enums are
+	// saved by constant name, keyed containers with integer, enum or string keys are maps and all
+	// other containers are arrays. Transient fields are skipped and the JSON custom load/save,
+	// pre-save and post-load functions are called, exchanging scalar values through JSON tokens.
+	// Pointers are saved as the hash returned by ptr_save or nil when it can't be saved, and loaded
+	// in the same way as JSON. Loaded string views point into the input data, which must outlive them.
+	// Arrays and maps nested more than 256 deep aren't loaded, failing with NESTING_TOO_DEEP.
+	void SaveMsgPack(WriteBuffer& out, const void* object, const clcpp::Type* type, IPtrSave* ptr_save, unsigned int flags = 0);
+	MsgPackError LoadMsgPack(ReadBuffer& in, void* object, const clcpp::Type* type, PtrFixups* ptr_fixups = 0);
 
 
 	struct JSONError
@@ -112,6 +522,7 @@ namespace clutl
 			INVALID_KEYWORD,
 			INVALID_ESCAPE_SEQUENCE,
 			UNEXPECTED_TOKEN,
+			FILE_READ_FAILED,
 		};
 
 		JSONError()
@@ -161,14 +572,143 @@ namespace clutl
 
 
 	// JSON serialisation
+	// None of these functions share mutable state so they can be called concurrently from any
+	// number of threads, provided each call uses its own buffers and objects.
+	//
+	// Keyed containers are saved as objects with one member per value, named by its key. Integer
+	// keys are written as decimal strings, enum keys by constant name and string keys as-is. Values
+	// of containers with any other key type are saved as arrays, which can't be loaded back.
+	//
+	// Pointers are loaded as the hash they were saved with. Given fixups, they're recorded for
+	// patching once all objects are loaded; otherwise the hash is stored in the pointer.
 	JSONError LoadJSON(ReadBuffer& in, void* object, const clcpp::Type* type);
+	JSONError LoadJSON(ReadBuffer& in, void* object, const clcpp::Type* type, clcpp::IAllocator* string_allocator, PtrFixups* ptr_fixups = 0);
 	JSONError LoadJSON(JSONContext& ctx, void* object, const clcpp::Field* field);
 
+	//
+	// Resumable JSON parser for input that arrives in chunks, such as from a socket or a file
+	// read piece by piece. Objects are populated as each value completes, in the same way that
+	// LoadJSON populates them. Chunks can be split at any point, including within tokens, and
+	// don't need to outlive the call to Feed.
+	//
+	// Containers are also populated value by value. As their final size isn't known until they
+	// close, their write iterators are initialised with a count of zero and each value is added
+	// with AddEmpty, so iterators must support growing that way, as the std container ones do.
+	//
+	// As chunks are transient, strings loaded into StringView fields are always copied using the
+	// string allocator. Without one, StringView fields are left empty. Pointers are recorded in the fixups,
+	// if given, as they are by LoadJSON.
+	//
+	class JSONPushParser
+	{
+	public:
+		JSONPushParser(void* object, const clcpp::Type* type, clcpp::IAllocator* string_allocator = 0, PtrFixups* ptr_fixups = 0);
+		~JSONPushParser();
+
+		// Parse the next chunk of input, returning the first error encountered so far
+		JSONError Feed(const void* data, unsigned int length);
+
+		// Signal the end of input, returning an error if the document is incomplete
+		JSONError Finish();
+
+		// Has the closing brace of the root object been parsed?
+		bool IsComplete() const { return m_Complete; }
+
+	private:
+		void LexToken(bool terminate);
+		void ParseToken(JSONToken& t);
+		void ParseValue(JSONToken& t, char* object, const clcpp::Type* type, clcpp::Qualifier::Operator op, const clcpp::Field* field);
+		void SetError(JSONError::Code code, unsigned int position);
+		void SetError(const JSONError& error, unsigned int position, unsigned int line, unsigned int column);
+
+		char* m_Object;
+		const clcpp::Type* m_Type;
+		clcpp::IAllocator* m_StringAllocator;
+		PtrFixups* m_PtrFixups;
+		JSONError m_Error;
+		bool m_Complete;
+
+		// Position of the next byte to be parsed
+		unsigned int m_Position;
+		unsigned int m_Line;
+		unsigned int m_LinePosition;
+
+		// Text of the token currently being parsed, which can span multiple chunks
+		int m_LexState;
+		bool m_Escape;
+		unsigned int m_TokenPosition;
+		WriteBuffer m_Token;
+
+		// Decoded text of the current key of a keyed container
+		WriteBuffer m_Key;
+
+		// Stack of the objects and arrays currently being parsed
+		WriteBuffer m_Stack;
+	};
+
 	// Save an object of a given type to the write buffer.
 	// If ptr_save is null, no pointers are serialised.
 	void SaveJSON(WriteBuffer& out, const void* object, const clcpp::Type* type, IPtrSave* ptr_save, unsigned int flags = 0);
 
+	// Save an object, splitting any container with more than range_size elements into ranges that
+	// are each saved into their own buffer on the worker pool, before being concatenated in order.
+	// The output is identical to that of a serial save. As they're called from the worker threads,
+	// ptr_save and any custom save functions must be thread-safe.
+	void SaveJSON(WriteBuffer& out, const void* object, const clcpp::Type* type, IPtrSave* ptr_save, unsigned int flags, IParallelFor* parallel_for, unsigned int range_size);
+
 	// Save an object described by the given field to the write buffer.
 	// If ptr_save is null, no pointers are serialised.
 	void SaveJSON(WriteBuffer& out, const void* object, const clcpp::Field* field, IPtrSave* ptr_save, unsigned int flags = 0);
+
+
+	//
+	// Receives the records loaded by LoadJSONLines. When a worker pool is used, calls are made
+	// from multiple threads at once so implementations must be thread-safe.
+	//
+	struct IJSONLinesLoad
+	{
+		// Return the object to load the record with the given index into, or null to skip it.
+		// The same object can be returned for each record if it's processed in RecordLoaded.
+		virtual void* GetObject(unsigned int index) = 0;
+
+		// Called once a record has been successfully loaded into its object
+		virtual void RecordLoaded(unsigned int index, void* object) { }
+	};
+
+	// Load newline-delimited JSON records of the same type, consuming the entire input. Blank lines are
+	// skipped and not counted as records. The error returned is the first in the input, with its line
+	// and position relative to the start of the input, after which no records are loaded.
+	//
+	// With a worker pool, the input is split at the newline boundaries following each range_size bytes
+	// and the ranges are loaded in parallel. Records following the first error may then be loaded.
+	//
+	// The string allocator is used as it is by LoadJSON and must be thread-safe with a worker pool.
+	JSONError LoadJSONLines(ReadBuffer& in, const clcpp::Type* type, IJSONLinesLoad* load, IParallelFor* parallel_for = 0, unsigned int range_size = 0, clcpp::IAllocator* string_allocator = 0);
+
+	// Load newline-delimited JSON records into consecutive elements of an array of objects, with records
+	// beyond max_objects being skipped. The number of records loaded before the first error is returned
+	// in nb_objects.
+	JSONError LoadJSONLines(ReadBuffer& in, void* objects, unsigned int max_objects, const clcpp::Type* type, unsigned int& nb_objects, IParallelFor* parallel_for = 0, unsigned int range_size = 0, clcpp::IAllocator* string_allocator = 0);
+
+	// Save an array of objects as newline-delimited JSON records. FORMAT_OUTPUT is ignored as each
+	// record must be written on a single line.
+	void SaveJSONLines(WriteBuffer& out, const void* objects, unsigned int nb_objects, const clcpp::Type* type, IPtrSave* ptr_save, unsigned int flags = 0);
+
+
+	//
+	// Load JSON through a cache of the loaded object saved in versioned binary form. The cache file
+	// records a hash of the JSON text and a fingerprint of the type's schema and is only used when
+	// both match, otherwise the JSON is loaded and the cache file rewritten. Cache files that fail
+	// to load are also rewritten, with the JSON loaded over anything partially loaded from them.
+	//
+	// The cached binary is a snapshot of the object after the JSON load so the object must be in
+	// the same initial state on each call, e.g. default constructed. Types that versioned binary
+	// can't represent exactly are always loaded from JSON; these are types with base classes,
+	// pointers or custom load/save functions.
+	//
+	JSONError LoadJSONCached(ReadBuffer& in, const char* cache_filename, void* object, const clcpp::Type* type, bool* loaded_from_cache = 0);
+
+	// Load a JSON file, caching it within the given directory under a name derived from the JSON
+	// filename and type name
+	JSONError LoadJSONCached(const char* json_filename, const char* cache_dir, void* object, const clcpp::Type* type, bool* loaded_from_cache = 0);
 }
\ No newline at end of file
@@ -99,7 +99,9 @@ namespace clutl
 
 
 
-	bool BuildParameterObjectCache_JSON(ParameterObjectCache& poc, const clcpp::Function* function, ReadBuffer& parameter_source);
+	// Pointers within the parameters are resolved through ptr_load once all parameters are loaded. Without
+	// it, they're left holding the hash they were saved with.
+	bool BuildParameterObjectCache_JSON(ParameterObjectCache& poc, const clcpp::Function* function, ReadBuffer& parameter_source, IPtrLoad* ptr_load = 0);
 
 
 	bool CallFunction_x86_32_msvc_cdecl(const clcpp::Function* function, const ParameterData& parameters);
@@ -0,0 +1,462 @@
+//
+// ===============================================================================
+// clReflect, StdContainers.h - Reflected iterators for standard library containers
+// -------------------------------------------------------------------------------
+// Copyright (c) 2011-2012 Don Williamson & clReflect Authors (see AUTHORS file)
+// Released under MIT License (see LICENSE file)
+// ===============================================================================
+//
+
+#pragma once
+
+
+#include <clcpp/Containers.h>
+#include <clutl/Serialise.h>
+
+#include <vector>
+#include <string>
+#include <map>
+#include <new>
+
+#if __cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1600)
+	#define CLUTL_STD_UNORDERED_MAP
+	#include <unordered_map>
+#endif
+
+
+//
+// The iterators can't be templates as only one read/write iterator type can be given for each
+// container, so they instead look up the operations of each container instantiation, registered
+// once at global scope in any source file:
+//
+//    clutl_std_vector(MyStruct)
+//    clutl_std_vector(MyStruct*)
+//    clutl_std_string()
+//    clutl_std_map(int, MyStruct)
+//    clutl_std_unordered_map(unsigned int, float)
+//
+// Registration uses clcpp::GetTypeNameHash so each template argument must be a reflected type
+// that has one, which rules out containers of containers. Iterating over a container
+// instantiation that hasn't been registered asserts.
+//
+// Map keys given to clcpp::WriteIterator::AddEmpty point to an object of the key type, except
+// for std::string keys which are given as a clutl::StringView so that they can be built
+// straight from serialised text.
+//
+#define clutl_std_vector(type)																	\
+	static clutl::StdSequenceOps< std::vector< type >, clutl::StdContainerOps::KIND_VECTOR >	\
+		CLCPP_UNIQUE(clutl_std_container_ops);
+
+#define clutl_std_string()																		\
+	static clutl::StdSequenceOps< std::string, clutl::StdContainerOps::KIND_STRING >			\
+		CLCPP_UNIQUE(clutl_std_container_ops);
+
+#define clutl_std_map(key, value)																\
+	static clutl::StdMapOps< std::map< key, value >, clutl::StdContainerOps::KIND_MAP >		\
+		CLCPP_UNIQUE(clutl_std_container_ops);
+
+#if defined(CLUTL_STD_UNORDERED_MAP)
+	#define clutl_std_unordered_map(key, value)																	\
+		static clutl::StdMapOps< std::unordered_map< key, value >, clutl::StdContainerOps::KIND_UNORDERED_MAP >	\
+			CLCPP_UNIQUE(clutl_std_container_ops);
+#endif
+
+
+// Template arguments the scanner has to parse when reflecting the containers
+clcpp_reflect_part(std::allocator)
+clcpp_reflect_part(std::char_traits)
+clcpp_reflect_part(std::less)
+clcpp_reflect_part(std::pair)
+clcpp_reflect_part(std::hash)
+clcpp_reflect_part(std::equal_to)
+
+clcpp_reflect_part(std::vector)
+clcpp_reflect_part(std::basic_string)
+clcpp_reflect_part(std::map)
+clcpp_reflect_part(std::unordered_map)
+
+clcpp_container_iterators(std::vector, clutl::StdVectorReadIterator, clutl::StdVectorWriteIterator, nokey)
+clcpp_container_iterators(std::basic_string, clutl::StdStringReadIterator, clutl::StdStringWriteIterator, nokey)
+clcpp_container_iterators(std::map, clutl::StdMapReadIterator, clutl::StdMapWriteIterator, haskey)
+clcpp_container_iterators(std::unordered_map, clutl::StdUnorderedMapReadIterator, clutl::StdUnorderedMapWriteIterator, haskey)
+
+// libstdc++ declares strings in an inline namespace for its C++11 ABI
+#if defined(_GLIBCXX_USE_CXX11_ABI) && _GLIBCXX_USE_CXX11_ABI
+	clcpp_reflect_part(std::__cxx11::basic_string)
+	clcpp_container_iterators(std::__cxx11::basic_string, clutl::StdStringReadIterator, clutl::StdStringWriteIterator, nokey)
+#endif
+
+
+clcpp_reflect_part(clutl)
+namespace clutl
+{
+	//
+	// Type-erased operations for a single standard container instantiation. Sequences are
+	// contiguous and only need the sequence functions; maps only need the map functions.
+	//
+	struct StdContainerOps
+	{
+		enum Kind
+		{
+			KIND_VECTOR,
+			KIND_STRING,
+			KIND_MAP,
+			KIND_UNORDERED_MAP,
+		};
+
+		// Names of template arguments can't be hashed during static initialisation
+		typedef unsigned int (*NameHashFunc)();
+
+		// Links itself into the global registry
+		StdContainerOps(Kind kind, NameHashFunc key_name_hash, bool key_is_ptr, NameHashFunc value_name_hash, bool value_is_ptr);
+
+		// Functions for all containers
+		unsigned int (*size)(const void* container);
+		void (*reserve)(void* container, unsigned int count);
+
+		// Sequence functions; resize discards existing values and grow keeps them
+		const void* (*data)(const void* container);
+		void* (*resize)(void* container, unsigned int count);
+		void* (*grow)(void* container, unsigned int count);
+		unsigned int value_size;
+
+		// Map functions, with iteration state kept in a caller-provided buffer of MAX_STATE_SIZE bytes
+		enum { MAX_STATE_SIZE = 4 * sizeof(void*) };
+		void (*begin)(const void* container, void* state);
+		void (*end)(void* state);
+		clcpp::ContainerKeyValue (*get)(const void* state);
+		void (*move_next)(void* state);
+		void (*clear)(void* container, unsigned int reserve_count);
+		void* (*insert)(void* container, const void* key);
+
+		Kind kind;
+		NameHashFunc key_name_hash;
+		bool key_is_ptr;
+		NameHashFunc value_name_hash;
+		bool value_is_ptr;
+		StdContainerOps* next;
+	};
+
+
+	// Find the registered operations for an instantiation of the given container kind
+	const StdContainerOps* FindStdContainerOps(StdContainerOps::Kind kind, const clcpp::TemplateType* type);
+
+
+	namespace internal
+	{
+		// Maps each template argument to the name hash of its reflected type
+		template <typename TYPE> struct StdTypeArg
+		{
+			static unsigned int NameHash() { return clcpp::GetTypeNameHash<TYPE>(); }
+			static const bool IS_PTR = false;
+		};
+		template <typename TYPE> struct StdTypeArg<TYPE*>
+		{
+			static unsigned int NameHash() { return clcpp::GetTypeNameHash<TYPE>(); }
+			static const bool IS_PTR = true;
+		};
+
+		// Converts the key given to AddEmpty into the container key type
+		template <typename TYPE> struct StdKeyArg
+		{
+			static const TYPE& Get(const void* key) { return *(const TYPE*)key; }
+		};
+		template <typename TRAITS, typename ALLOC> struct StdKeyArg< std::basic_string<char, TRAITS, ALLOC> >
+		{
+			static std::basic_string<char, TRAITS, ALLOC> Get(const void* key)
+			{
+				const StringView& view = *(const StringView*)key;
+				return std::basic_string<char, TRAITS, ALLOC>(view.data, view.length);
+			}
+		};
+	}
+
+
+	//
+	// Operations for contiguous containers with value_type, size, resize and operator[]
+	//
+	template <typename CONTAINER, StdContainerOps::Kind KIND>
+	struct StdSequenceOps : public StdContainerOps
+	{
+		typedef typename CONTAINER::value_type ValueType;
+		typedef internal::StdTypeArg<ValueType> ValueArg;
+
+		StdSequenceOps()
+			: StdContainerOps(KIND, 0, false, ValueArg::NameHash, ValueArg::IS_PTR)
+		{
+			size = Size;
+			reserve = Reserve;
+			data = Data;
+			resize = Resize;
+			grow = Grow;
+			value_size = sizeof(ValueType);
+		}
+
+		static unsigned int Size(const void* container)
+		{
+			return (unsigned int)((const CONTAINER*)container)->size();
+		}
+
+		static const void* Data(const void* container)
+		{
+			const CONTAINER& c = *(const CONTAINER*)container;
+			return c.empty() ? 0 : &c[0];
+		}
+
+		static void Reserve(void* container, unsigned int count)
+		{
+			((CONTAINER*)container)->reserve(count);
+		}
+
+		static void* Resize(void* container, unsigned int count)
+		{
+			// Discard old values and allocate all new ones in one go
+			CONTAINER& c = *(CONTAINER*)container;
+			c.clear();
+			c.resize(count);
+			return count ? &c[0] : 0;
+		}
+
+		static void* Grow(void* container, unsigned int count)
+		{
+			CONTAINER& c = *(CONTAINER*)container;
+			c.resize(count);
+			return count ? &c[0] : 0;
+		}
+	};
+
+
+	//
+	// Operations for associative containers with key_type, mapped_type and hinted insert. Values
+	// are inserted at the end so that keys loaded in sorted order don't search the container.
+	//
+	template <typename CONTAINER, StdContainerOps::Kind KIND>
+	struct StdMapOps : public StdContainerOps
+	{
+		typedef typename CONTAINER::key_type KeyType;
+		typedef typename CONTAINER::mapped_type MappedType;
+		typedef typename CONTAINER::value_type ValueType;
+		typedef typename CONTAINER::const_iterator Iterator;
+		typedef internal::StdTypeArg<KeyType> KeyArg;
+		typedef internal::StdTypeArg<MappedType> ValueArg;
+
+		// Iteration stops at the end so that moving past the last value is safe
+		struct State
+		{
+			Iterator position;
+			Iterator end;
+		};
+
+		StdMapOps()
+			: StdContainerOps(KIND, KeyArg::NameHash, KeyArg::IS_PTR, ValueArg::NameHash, ValueArg::IS_PTR)
+		{
+			// Compile-time check that the iterator fits in the state buffer
+			char state_fits[sizeof(State) <= MAX_STATE_SIZE ? 1 : -1];
+			(void)state_fits;
+
+			size = Size;
+			reserve = Reserve;
+			begin = Begin;
+			end = End;
+			get = Get;
+			move_next = MoveNext;
+			clear = Clear;
+			insert = Insert;
+		}
+
+		static unsigned int Size(const void* container)
+		{
+			return (unsigned int)((const CONTAINER*)container)->size();
+		}
+
+		static void Begin(const void* container, void* state)
+		{
+			const CONTAINER& c = *(const CONTAINER*)container;
+			State* s = new (state) State;
+			s->position = c.begin();
+			s->end = c.end();
+		}
+
+		static void End(void* state)
+		{
+			((State*)state)->~State();
+		}
+
+		static clcpp::ContainerKeyValue Get(const void* state)
+		{
+			const Iterator& i = ((const State*)state)->position;
+			clcpp::ContainerKeyValue kv;
+			kv.key = &i->first;
+			kv.value = &i->second;
+			return kv;
+		}
+
+		static void MoveNext(void* state)
+		{
+			State& s = *(State*)state;
+			if (s.position != s.end)
+				++s.position;
+		}
+
+		static void Clear(void* container, unsigned int reserve_count)
+		{
+			((CONTAINER*)container)->clear();
+			Reserve(container, reserve_count);
+		}
+
+		static void Reserve(void* container, unsigned int count)
+		{
+			ReserveHashed((CONTAINER*)container, count);
+		}
+
+		static void* Insert(void* container, const void* key)
+		{
+			// Existing values are kept and returned for overwriting
+			CONTAINER& c = *(CONTAINER*)container;
+			ValueType value(internal::StdKeyArg<KeyType>::Get(key), MappedType());
+			return &c.insert(c.end(), value)->second;
+		}
+
+		// Only hashed containers can reserve
+		template <typename TYPE> static void ReserveHashed(TYPE*, unsigned int)
+		{
+		}
+#if defined(CLUTL_STD_UNORDERED_MAP)
+		template <typename KEY, typename VALUE, typename HASH, typename EQUAL, typename ALLOC>
+		static void ReserveHashed(std::unordered_map<KEY, VALUE, HASH, EQUAL, ALLOC>* container, unsigned int count)
+		{
+			container->reserve(count);
+		}
+#endif
+	};
+
+
+	//
+	// Read/write iterators for contiguous containers, which step through the container's memory
+	// directly after a single lookup on initialisation. Values added beyond the count given to
+	// the write iterator grow the container, invalidating its span.
+	//
+	class clcpp_attr(reflect_part) StdSequenceReadIterator : public clcpp::IReadIterator
+	{
+	public:
+		void Initialise(const clcpp::Primitive* primitive, const void* container_object, clcpp::ReadIterator& storage);
+		clcpp::ContainerKeyValue GetKeyValue() const;
+		void MoveNext();
+
+	protected:
+		StdSequenceReadIterator(StdContainerOps::Kind kind);
+
+	private:
+		StdContainerOps::Kind m_Kind;
+		const char* m_Position;
+		const char* m_End;
+		unsigned int m_Stride;
+	};
+
+	class clcpp_attr(reflect_part) StdSequenceWriteIterator : public clcpp::IWriteIterator
+	{
+	public:
+		void Initialise(const clcpp::Primitive* primitive, void* container_object, clcpp::WriteIterator& storage, int count);
+		void* AddEmpty();
+		void* AddEmpty(void* key);
+		void* AddEmptyRange(unsigned int count);
+		void Reserve(unsigned int count);
+
+	protected:
+		StdSequenceWriteIterator(StdContainerOps::Kind kind);
+
+	private:
+		// Grow the container to fit count values, should they be added beyond the initial count
+		void GrowTo(unsigned int count);
+
+		StdContainerOps::Kind m_Kind;
+		const StdContainerOps* m_Ops;
+		void* m_Container;
+		char* m_Position;
+		char* m_End;
+		unsigned int m_Stride;
+	};
+
+
+	//
+	// Read/write iterators for associative containers. Values can only be added with a key.
+	//
+	class clcpp_attr(reflect_part) StdAssocReadIterator : public clcpp::IReadIterator
+	{
+	public:
+		~StdAssocReadIterator();
+		void Initialise(const clcpp::Primitive* primitive, const void* container_object, clcpp::ReadIterator& storage);
+		clcpp::ContainerKeyValue GetKeyValue() const;
+		void MoveNext();
+
+	protected:
+		StdAssocReadIterator(StdContainerOps::Kind kind);
+
+	private:
+		StdContainerOps::Kind m_Kind;
+		const StdContainerOps* m_Ops;
+		void* m_State[StdContainerOps::MAX_STATE_SIZE / sizeof(void*)];
+	};
+
+	class clcpp_attr(reflect_part) StdAssocWriteIterator : public clcpp::IWriteIterator
+	{
+	public:
+		void Initialise(const clcpp::Primitive* primitive, void* container_object, clcpp::WriteIterator& storage, int count);
+		void* AddEmpty();
+		void* AddEmpty(void* key);
+		void Reserve(unsigned int count);
+
+	protected:
+		StdAssocWriteIterator(StdContainerOps::Kind kind);
+
+	private:
+		StdContainerOps::Kind m_Kind;
+		const StdContainerOps* m_Ops;
+		void* m_Container;
+	};
+
+
+	//
+	// The concrete iterators referenced by the container specs above
+	//
+	class clcpp_attr(reflect_part) StdVectorReadIterator : public StdSequenceReadIterator
+	{
+	public:
+		StdVectorReadIterator() : StdSequenceReadIterator(StdContainerOps::KIND_VECTOR) { }
+	};
+	class clcpp_attr(reflect_part) StdVectorWriteIterator : public StdSequenceWriteIterator
+	{
+	public:
+		StdVectorWriteIterator() : StdSequenceWriteIterator(StdContainerOps::KIND_VECTOR) { }
+	};
+	class clcpp_attr(reflect_part) StdStringReadIterator : public StdSequenceReadIterator
+	{
+	public:
+		StdStringReadIterator() : StdSequenceReadIterator(StdContainerOps::KIND_STRING) { }
+	};
+	class clcpp_attr(reflect_part) StdStringWriteIterator : public StdSequenceWriteIterator
+	{
+	public:
+		StdStringWriteIterator() : StdSequenceWriteIterator(StdContainerOps::KIND_STRING) { }
+	};
+	class clcpp_attr(reflect_part) StdMapReadIterator : public StdAssocReadIterator
+	{
+	public:
+		StdMapReadIterator() : StdAssocReadIterator(StdContainerOps::KIND_MAP) { }
+	};
+	class clcpp_attr(reflect_part) StdMapWriteIterator : public StdAssocWriteIterator
+	{
+	public:
+		StdMapWriteIterator() : StdAssocWriteIterator(StdContainerOps::KIND_MAP) { }
+	};
+	class clcpp_attr(reflect_part) StdUnorderedMapReadIterator : public StdAssocReadIterator
+	{
+	public:
+		StdUnorderedMapReadIterator() : StdAssocReadIterator(StdContainerOps::KIND_UNORDERED_MAP) { }
+	};
+	class clcpp_attr(reflect_part) StdUnorderedMapWriteIterator : public StdAssocWriteIterator
+	{
+	public:
+		StdUnorderedMapWriteIterator() : StdAssocWriteIterator(StdContainerOps::KIND_UNORDERED_MAP) { }
+	};
+}
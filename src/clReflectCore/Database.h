@@ -406,8 +406,8 @@ namespace cldb
 	//
 	struct TemplateType : public Type
 	{
-		// Enough for std::map
-		static const int MAX_NB_ARGS = 4;
+		// Enough for std::unordered_map
+		static const int MAX_NB_ARGS = 6;
 
 		TemplateType()
 			: Type(KIND_TEMPLATE_TYPE)
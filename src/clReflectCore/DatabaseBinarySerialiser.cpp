@@ -21,7 +21,7 @@ namespace
 {
 	// 'cldb'
 	const unsigned int FILE_HEADER = 0x62647263;
-	const unsigned int FILE_VERSION = 1;
+	const unsigned int FILE_VERSION = 2;
 
 
 	// Map from hash to a text attribute, mainly for binary serialisation of a
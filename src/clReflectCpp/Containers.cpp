@@ -47,6 +47,8 @@ public:
 		m_Position = 0;
 		storage.m_Count = field->ci->count;
 		m_Size = storage.m_Count * m_ElementSize;
+		storage.m_Span.data = (char*)m_ArrayData;
+		storage.m_Span.stride = (unsigned int)m_ElementSize;
 	}
 
 	clcpp::ContainerKeyValue GetKeyValue() const
@@ -108,6 +110,8 @@ public:
 		m_Position = 0;
 		storage.m_Count = count;
 		m_Size = storage.m_Count * m_ElementSize;
+		storage.m_Span.data = m_ArrayData;
+		storage.m_Span.stride = (unsigned int)m_ElementSize;
 	}
 
 	void* AddEmpty()
@@ -123,6 +127,14 @@ public:
 		return AddEmpty();
 	}
 
+	void* AddEmptyRange(unsigned int count)
+	{
+		clcpp::internal::Assert(m_Position + count * m_ElementSize <= m_Size);
+		void* values = m_ArrayData + m_Position;
+		m_Position += count * m_ElementSize;
+		return values;
+	}
+
 private:
 	// Construction values
 	char* m_ArrayData;
@@ -464,6 +464,7 @@ clcpp::Type::Type()
 	: Primitive(KIND)
 	, size(0)
 	, ci(0)
+	, builtin_kind(BuiltinKind::NONE)
 {
 }
 
@@ -472,6 +473,7 @@ clcpp::Type::Type(Kind k)
 	: Primitive(k)
 	, size(0)
 	, ci(0)
+	, builtin_kind(BuiltinKind::NONE)
 {
 }
 
@@ -538,6 +540,8 @@ clcpp::Field::Field()
 	, parent_unique_id(0)
 	, flag_attributes(0)
 	, ci(0)
+	, json_key(0)
+	, json_key_length(0)
 {
 }
 
@@ -579,6 +583,7 @@ clcpp::Class::Class()
 	, constructor(0)
 	, destructor(0)
 	, flag_attributes(0)
+	, layout_fingerprint(0)
 {
 }
 
@@ -724,6 +729,7 @@ clcpp::Range clcpp::Database::GetOverloadedFunction(unsigned int hash) const
 clcpp::internal::DatabaseMem::DatabaseMem()
 	: function_base_address(0)
 	, name_text_data(0)
+	, json_key_data(0)
 {
 }
 
@@ -731,7 +737,7 @@ clcpp::internal::DatabaseMem::DatabaseMem()
 clcpp::internal::DatabaseFileHeader::DatabaseFileHeader()
 	: signature0('pclc')
 	, signature1('\0bdp')
-	, version(2)
+	, version(6)
 	, nb_ptr_schemas(0)
 	, nb_ptr_offsets(0)
 	, nb_ptr_relocations(0)
@@ -414,6 +414,89 @@ namespace
 	}
 
 
+	int EncodeJSONKey(char* dest, const char* name)
+	{
+		// Quoted name followed by a colon, with any characters that JSON requires escaped
+		int length = 0;
+		dest[length++] = '\"';
+		for (const char* c = name; *c; c++)
+		{
+			if (*c == '\"' || *c == '\\')
+				dest[length++] = '\\';
+			dest[length++] = *c;
+		}
+		dest[length++] = '\"';
+		dest[length++] = ':';
+		return length;
+	}
+
+
+	void AssignJSONKeys(CppExport& cppexp)
+	{
+		// Count how many bytes are needed to store the keys of all class fields, assuming worst-case
+		// escaping of every character
+		int key_size = 0;
+		for (unsigned int i = 0; i < cppexp.db->fields.size; i++)
+		{
+			const clcpp::Field& field = cppexp.db->fields[i];
+			if (!field.IsFunctionParameter())
+				key_size += strlen(field.name.text) * 2 + 3;
+		}
+
+		// Allocate memory for them
+		cppexp.db->json_key_data = cppexp.allocator.Alloc<char>(key_size);
+
+		// Encode each key into the main store
+		char* pos = (char*)cppexp.db->json_key_data;
+		for (unsigned int i = 0; i < cppexp.db->fields.size; i++)
+		{
+			clcpp::Field& field = cppexp.db->fields[i];
+			if (field.IsFunctionParameter())
+				continue;
+
+			field.json_key = pos;
+			field.json_key_length = EncodeJSONKey(pos, field.name.text);
+			pos += field.json_key_length;
+		}
+	}
+
+
+	void AssignBuiltinKinds(CppExport& cppexp)
+	{
+		static const char* builtin_names[clcpp::BuiltinKind::COUNT] =
+		{
+			0,
+			"bool",
+			"char",
+			"wchar_t",
+			"unsigned char",
+			"short",
+			"unsigned short",
+			"int",
+			"unsigned int",
+			"long",
+			"unsigned long",
+			"long long",
+			"unsigned long long",
+			"float",
+			"double",
+		};
+
+		for (unsigned int i = 0; i < cppexp.db->types.size; i++)
+		{
+			clcpp::Type& type = cppexp.db->types[i];
+			for (int j = 1; j < clcpp::BuiltinKind::COUNT; j++)
+			{
+				if (!strcmp(type.name.text, builtin_names[j]))
+				{
+					type.builtin_kind = (clcpp::BuiltinKind::Value)j;
+					break;
+				}
+			}
+		}
+	}
+
+
 	template <typename PARENT_TYPE, typename FIELD_TYPE, typename FIELD_OBJECT_TYPE, typename CHILD_TYPE>
 	void Link(clcpp::CArray<PARENT_TYPE>& parents, const FIELD_TYPE* (FIELD_OBJECT_TYPE::*field), clcpp::CArray<const CHILD_TYPE*>& children)
 	{
@@ -1055,6 +1138,90 @@ namespace
 			RemoveInvalidFunctions(primitive.functions);
 		}
 	}
+
+
+	unsigned int CombineLayoutHash(unsigned int hash, unsigned int value)
+	{
+		return clcpp::internal::HashData(&value, sizeof(value), hash);
+	}
+
+
+	unsigned int CalcLayoutFingerprint(const clcpp::Class& class_prim);
+
+
+	bool CombineFieldTypeLayout(const clcpp::Type* type, unsigned int& hash)
+	{
+		hash = CombineLayoutHash(hash, type->name.hash);
+		hash = CombineLayoutHash(hash, type->size);
+
+		switch (type->kind)
+		{
+		case clcpp::Primitive::KIND_TYPE:
+			return type->builtin_kind != clcpp::BuiltinKind::NONE;
+
+		case clcpp::Primitive::KIND_ENUM:
+			{
+				// Copied enum values are only valid while the constants don't change
+				const clcpp::Enum* enum_prim = type->AsEnum();
+				for (unsigned int i = 0; i < enum_prim->constants.size; i++)
+				{
+					hash = CombineLayoutHash(hash, enum_prim->constants[i]->name.hash);
+					hash = CombineLayoutHash(hash, enum_prim->constants[i]->value);
+				}
+				return type->size == sizeof(int);
+			}
+
+		case clcpp::Primitive::KIND_CLASS:
+			{
+				unsigned int nested_fingerprint = CalcLayoutFingerprint(*type->AsClass());
+				hash = CombineLayoutHash(hash, nested_fingerprint);
+				return nested_fingerprint != 0;
+			}
+
+		default:
+			return false;
+		}
+	}
+
+
+	unsigned int CalcLayoutFingerprint(const clcpp::Class& class_prim)
+	{
+		// Classes with no fields may be opaque, with their data hidden from the database
+		if (class_prim.base_types.size != 0 || class_prim.fields.size == 0)
+			return 0;
+
+		// Fields are hashed in their sorted array order, with their offsets so that reordering them in
+		// memory changes the fingerprint
+		unsigned int hash = CombineLayoutHash(0, class_prim.fields.size);
+		hash = CombineLayoutHash(hash, class_prim.size);
+		for (unsigned int i = 0; i < class_prim.fields.size; i++)
+		{
+			const clcpp::Field& field = *class_prim.fields[i];
+			if (field.flag_attributes & clcpp::FlagAttribute::TRANSIENT)
+				return 0;
+			if (field.qualifier.op != clcpp::Qualifier::VALUE)
+				return 0;
+
+			hash = CombineLayoutHash(hash, field.name.hash);
+			hash = CombineLayoutHash(hash, field.offset);
+			hash = CombineLayoutHash(hash, field.ci ? field.ci->count : 1);
+			if (!CombineFieldTypeLayout(field.type, hash))
+				return 0;
+		}
+
+		// Zero is reserved for classes that can't be copied
+		return hash != 0 ? hash : 1;
+	}
+
+
+	void AssignLayoutFingerprints(CppExport& cppexp)
+	{
+		for (unsigned int i = 0; i < cppexp.db->classes.size; i++)
+		{
+			clcpp::Class& class_prim = cppexp.db->classes[i];
+			class_prim.layout_fingerprint = CalcLayoutFingerprint(class_prim);
+		}
+	}
 }
 
 
@@ -1089,6 +1256,13 @@ bool BuildCppExport(const cldb::Database& db, CppExport& cppexp)
 	// Now ensure all text data is pointing into the data to be memory mapped
 	AssignAttributeText(cppexp);
 
+	// Pre-encode field names as JSON keys so that text serialisers can write them in one go
+	if (cppexp.emit_json_keys)
+		AssignJSONKeys(cppexp);
+
+	// Identify built-in types so that serialisers can dispatch on them without name lookups
+	AssignBuiltinKinds(cppexp);
+
 	// Generate a list of references to all type primitives so that runtime serialisation code
 	// can quickly look them up.
 	GatherTypePrimitives(cppexp);
@@ -1191,6 +1365,10 @@ bool BuildCppExport(const cldb::Database& db, CppExport& cppexp)
 	// if your compile is without warnings!
 	IsolateInvalidPrimitives(cppexp);
 
+	// Fingerprint the layout of classes that binary serialisers can save as raw field bytes.
+	// This needs the final field lists, with types, flag attributes and C-array sizes resolved.
+	AssignLayoutFingerprints(cppexp);
+
 	return true;
 }
 
@@ -1238,6 +1416,7 @@ void SaveCppExport(CppExport& cppexp, const char* filename)
 		(&clcpp::internal::DatabaseMem::float_attributes, array_ofs)
 		(&clcpp::internal::DatabaseMem::primitive_attributes, array_ofs)
 		(&clcpp::internal::DatabaseMem::text_attributes, array_ofs)
+		(&clcpp::internal::DatabaseMem::json_key_data)
 		(&clcpp::internal::DatabaseMem::type_primitives, array_ofs)
 		(&clcpp::internal::DatabaseMem::container_infos, array_ofs)
 		(&clcpp::Namespace::namespaces, array_ofs + global_namespace_offset)
@@ -1266,7 +1445,8 @@ void SaveCppExport(CppExport& cppexp, const char* filename)
 	PtrSchema& schema_field = relocator.AddSchema<clcpp::Field>(&schema_primitive)
 		(&clcpp::Field::type)
 		(&clcpp::Field::attributes, array_ofs)
-		(&clcpp::Field::ci);
+		(&clcpp::Field::ci)
+		(&clcpp::Field::json_key);
 
 	PtrSchema& schema_function = relocator.AddSchema<clcpp::Function>(&schema_primitive)
 		(&clcpp::Function::return_parameter)
@@ -1287,7 +1467,9 @@ void SaveCppExport(CppExport& cppexp, const char* filename)
 		(&clcpp::TemplateType::parameter_types, sizeof(void*) * 0)
 		(&clcpp::TemplateType::parameter_types, sizeof(void*) * 1)
 		(&clcpp::TemplateType::parameter_types, sizeof(void*) * 2)
-		(&clcpp::TemplateType::parameter_types, sizeof(void*) * 3);
+		(&clcpp::TemplateType::parameter_types, sizeof(void*) * 3)
+		(&clcpp::TemplateType::parameter_types, sizeof(void*) * 4)
+		(&clcpp::TemplateType::parameter_types, sizeof(void*) * 5);
 
 	PtrSchema& schema_template = relocator.AddSchema<clcpp::Template>(&schema_primitive)
 		(&clcpp::Template::instances, array_ofs);
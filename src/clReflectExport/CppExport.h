@@ -28,6 +28,7 @@ struct CppExport
 	CppExport(clcpp::pointer_type function_base_address)
 		: allocator(5 * 1024 * 1024)	// 5MB should do for now
 		, function_base_address(function_base_address)
+		, emit_json_keys(false)
 		, db(0)
 	{
 	}
@@ -35,6 +36,10 @@ struct CppExport
 	StackAllocator allocator;
 
 	clcpp::pointer_type function_base_address;
+
+	// Generate pre-encoded "name": JSON keys for all class fields
+	bool emit_json_keys;
+
 	clcpp::internal::DatabaseMem* db;
 
 	// Hash of names for easier debugging
@@ -58,6 +58,7 @@ int main(int argc, const char* argv[])
 	{
 		// First build the C++ export representation
 		CppExport cppexp(function_base_address);
+		cppexp.emit_json_keys = args.Have("-json_keys");
 		if (!BuildCppExport(db, cppexp))
 			return 1;
 
@@ -222,7 +222,7 @@ namespace
 		// Get access to the template argument list
 		ParameterInfo template_args[cldb::TemplateType::MAX_NB_ARGS];
 		const clang::TemplateArgumentList& list = cts_decl->getTemplateArgs();
-		if (list.size() >= cldb::TemplateType::MAX_NB_ARGS)
+		if (list.size() > cldb::TemplateType::MAX_NB_ARGS)
 			return Status::Warn(va("Only %d template arguments are supported; template has %d", cldb::TemplateType::MAX_NB_ARGS, list.size()));
 
 		for (unsigned int i = 0; i < list.size(); i++)
@@ -74,9 +74,14 @@ extern void TestConstructorDestructor(clcpp::Database& db);
 extern void TestAttributesFunc(clcpp::Database& db);
 extern void TestSerialise(clcpp::Database& db);
 extern void TestSerialiseJSON(clcpp::Database& db);
+extern void TestSerialiseJSONParallel(clcpp::Database& db);
+extern void TestSerialiseJSONConcurrent(clcpp::Database& db);
+extern void TestSerialiseMsgPack(clcpp::Database& db);
 extern void TestOffsets(clcpp::Database& db);
 extern void TestTypedefsFunc(clcpp::Database& db);
 extern void TestFunctionSerialise(clcpp::Database& db);
+extern void TestCollectionsFunc(clcpp::Database& db);
+extern void TestCollectionsDictionaryBenchmark(clcpp::Database& db);
 
 extern void clcppInitGetType(const clcpp::Database* db);
 
@@ -103,8 +108,13 @@ int main()
 	TestSerialise(db);
 	TestOffsets(db);
 	TestSerialiseJSON(db);
+	TestSerialiseJSONParallel(db);
+	TestSerialiseJSONConcurrent(db);
+	TestSerialiseMsgPack(db);
 	TestTypedefsFunc(db);
 	TestFunctionSerialise(db);
+	TestCollectionsFunc(db);
+	TestCollectionsDictionaryBenchmark(db);
 
 	return 0;
 }
\ No newline at end of file
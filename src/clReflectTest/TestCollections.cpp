@@ -1,4 +1,3 @@
-
 //
 // ===============================================================================
 // clReflect
@@ -9,8 +8,12 @@
 //
 
 #include <clcpp/clcpp.h>
-#include <vector>
-#include <map>
+#include <clutl/Serialise.h>
+#include <clutl/StdContainers.h>
+
+#include <stdio.h>
+
+#include "Timer.h"
 
 
 clcpp_reflect(TestCollections)
@@ -18,8 +21,165 @@ namespace TestCollections
 {
 	struct Struct
 	{
-		//std::vector<int> x;
+		std::vector<int> ints;
+		std::vector<float> floats;
+		std::string name;
+		std::map<int, float> weights;
+	};
+
+	// Routing tables for comparing dictionary serialisation against building the maps directly
+	struct Routes
+	{
+		std::map<int, float> ordered;
+	#if defined(CLUTL_STD_UNORDERED_MAP)
+		std::unordered_map<int, float> hashed;
+	#endif
 	};
 }
 
-clcpp_reflect(std::vector)
+
+// Register each container instantiation used above
+clutl_std_vector(int)
+clutl_std_vector(float)
+clutl_std_string()
+clutl_std_map(int, float)
+#if defined(CLUTL_STD_UNORDERED_MAP)
+	clutl_std_unordered_map(int, float)
+#endif
+
+
+void TestCollectionsFunc(clcpp::Database& db)
+{
+	TestCollections::Struct a;
+	for (int i = 0; i < 100; i++)
+	{
+		a.ints.push_back(i * 3);
+		a.floats.push_back(i * 0.5f);
+		a.weights[i * 7] = i * 0.25f;
+	}
+	a.name = "Collection \"A\"\n";
+
+	// Round trip sequences and strings through JSON
+	const clcpp::Type* type = clcpp::GetType<TestCollections::Struct>();
+	clutl::WriteBuffer write_buffer;
+	clutl::SaveJSON(write_buffer, &a, type, 0, 0);
+	clutl::ReadBuffer read_buffer(write_buffer);
+	TestCollections::Struct b;
+	b.ints.push_back(123);
+	clutl::JSONError error = clutl::LoadJSON(read_buffer, &b, type);
+	if (error.code == clutl::JSONError::NONE && a.ints == b.ints && a.floats == b.floats && a.name == b.name)
+		printf("STD SEQUENCE PASS!\n");
+	else
+		printf("STD SEQUENCE FAIL!\n");
+
+	// Maps are saved as objects keyed by their integer keys
+	bool dict_pass = error.code == clutl::JSONError::NONE && a.weights == b.weights;
+	std::string json(write_buffer.GetData(), write_buffer.GetBytesWritten());
+	dict_pass &= json.find("\"weights\":{\"0\":") != std::string::npos;
+
+	// The push parser grows containers one value at a time as the chunks arrive
+	TestCollections::Struct c;
+	c.ints.push_back(123);
+	clutl::JSONPushParser parser(&c, type);
+	for (unsigned int i = 0; i < write_buffer.GetBytesWritten(); i += 7)
+	{
+		unsigned int length = write_buffer.GetBytesWritten() - i;
+		parser.Feed(write_buffer.GetData() + i, length < 7 ? length : 7);
+	}
+	dict_pass &= parser.Finish().code == clutl::JSONError::NONE && a.weights == c.weights &&
+		a.ints == c.ints && a.floats == c.floats && a.name == c.name;
+	if (dict_pass)
+		printf("STD DICT PASS!\n");
+	else
+		printf("STD DICT FAIL!\n");
+
+	// Vectors describe their values as a span so they can be stepped through directly
+	const clcpp::Field* ints_field = clcpp::FindPrimitive(type->AsClass()->fields, clcpp::internal::HashNameString("ints"));
+	clcpp::ReadIterator ints_reader(ints_field->type->AsTemplateType(), &a.ints);
+	if (ints_reader.m_Span.data == (char*)&a.ints[0] && ints_reader.m_Span.stride == sizeof(int) && ints_reader.m_Count == a.ints.size())
+		printf("STD SPAN PASS!\n");
+	else
+		printf("STD SPAN FAIL!\n");
+
+	// Add values in bulk and one at a time beyond the initial count, growing the vector
+	std::vector<int> ranges;
+	clcpp::WriteIterator ranges_writer;
+	ranges_writer.Initialise(ints_field->type->AsTemplateType(), &ranges, 0);
+	ranges_writer.Reserve(1001);
+	int* range = (int*)ranges_writer.AddEmptyRange(1000);
+	for (int i = 0; i < 1000; i++)
+		range[i] = i;
+	*(int*)ranges_writer.AddEmpty() = 1000;
+	bool ranges_pass = ranges.size() == 1001 && ranges.capacity() == 1001;
+	for (int i = 0; i < 1001; i++)
+		ranges_pass &= ranges[i] == i;
+	if (ranges_pass)
+		printf("STD RANGE PASS!\n");
+	else
+		printf("STD RANGE FAIL!\n");
+
+	// Copy the map through its reflected iterators
+	const clcpp::Field* field = clcpp::FindPrimitive(type->AsClass()->fields, clcpp::internal::HashNameString("weights"));
+	const clcpp::TemplateType* map_type = field->type->AsTemplateType();
+	clcpp::ReadIterator reader(map_type, &a.weights);
+	clcpp::WriteIterator writer;
+	writer.Initialise(map_type, &b.weights, reader.m_Count);
+	for (unsigned int i = 0; i < reader.m_Count; i++)
+	{
+		clcpp::ContainerKeyValue kv = reader.GetKeyValue();
+		*(float*)writer.AddEmpty((void*)kv.key) = *(const float*)kv.value;
+		reader.MoveNext();
+	}
+	if (reader.m_Count == 100 && a.weights == b.weights)
+		printf("STD MAP PASS!\n");
+	else
+		printf("STD MAP FAIL!\n");
+}
+
+
+void TestCollectionsDictionaryBenchmark(clcpp::Database& db)
+{
+	const clcpp::Type* type = db.GetType(db.GetName("TestCollections::Routes").hash);
+	if (type == 0)
+	{
+		printf("STD DICT BENCHMARK FAIL!\n");
+		return;
+	}
+
+	// Reference timings for building the maps directly
+	const int nb_entries = 1000000;
+	TestCollections::Routes a;
+	double start = GetTimeMs();
+	for (int i = 0; i < nb_entries; i++)
+		a.ordered[i * 3] = i * 0.5f;
+	double ordered_time = GetTimeMs() - start;
+	printf("STD DICT MAP BUILD: %.2fms\n", ordered_time);
+#if defined(CLUTL_STD_UNORDERED_MAP)
+	start = GetTimeMs();
+	a.hashed.reserve(nb_entries);
+	for (int i = 0; i < nb_entries; i++)
+		a.hashed[i * 3] = i * 0.5f;
+	double hashed_time = GetTimeMs() - start;
+	printf("STD DICT UNORDERED MAP BUILD: %.2fms\n", hashed_time);
+#endif
+
+	start = GetTimeMs();
+	clutl::WriteBuffer write_buffer;
+	clutl::SaveJSON(write_buffer, &a, type, 0, 0);
+	printf("STD DICT SAVE: %.2fms, %d bytes\n", GetTimeMs() - start, write_buffer.GetBytesWritten());
+
+	start = GetTimeMs();
+	TestCollections::Routes b;
+	clutl::ReadBuffer read_buffer(write_buffer);
+	clutl::JSONError error = clutl::LoadJSON(read_buffer, &b, type);
+	printf("STD DICT LOAD: %.2fms\n", GetTimeMs() - start);
+
+	bool pass = error.code == clutl::JSONError::NONE && a.ordered == b.ordered;
+#if defined(CLUTL_STD_UNORDERED_MAP)
+	pass &= a.hashed == b.hashed;
+#endif
+	if (pass)
+		printf("STD DICT BENCHMARK PASS!\n");
+	else
+		printf("STD DICT BENCHMARK FAIL!\n");
+}
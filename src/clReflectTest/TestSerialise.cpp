@@ -10,6 +10,7 @@
 
 #include <clcpp/clcpp.h>
 #include <clutl/Serialise.h>
+#include <clutl/StdContainers.h>
 
 
 clcpp_reflect(Stuff)
@@ -65,10 +66,95 @@ namespace Stuff
 		SomeEnum e;
 		NestedStruct n;
 	};
+
+
+	struct ContainerStruct
+	{
+		int id;
+		std::vector<int> values;
+		std::string name;
+		std::map<int, float> weights;
+		int samples[3];
+	};
+
+
+	struct ViewStruct
+	{
+		int id;
+		clutl::StringView name;
+	};
+
+
+	struct ImageNode
+	{
+		int value;
+		const char* name;
+		ImageNode* next;
+	};
+
+
+	// Template instances have no reflected fields, so their pointers can't be patched in an image
+	template <typename TYPE> struct ImageRef
+	{
+		TYPE* ptr;
+	};
+
+
+	struct ImageRefNode
+	{
+		ImageRef<ImageNode> ref;
+	};
 };
 
 
+clutl_std_vector(int)
+clutl_std_string()
+clutl_std_map(int, float)
+
+
 #include <stdio.h>
+#include <string.h>
+
+
+namespace
+{
+	bool Equals(const Stuff::NestedStruct& a, const Stuff::NestedStruct& b)
+	{
+		return a.a == b.a && a.b == b.b && a.c == b.c && a.d == b.d && a.e == b.e &&
+			a.f == b.f && a.g == b.g && a.h == b.h && a.i == b.i;
+	}
+
+
+	bool Equals(const Stuff::DerivedStruct& a, const Stuff::DerivedStruct& b)
+	{
+		// Versioned binary doesn't save base classes
+		return a.x == b.x && a.y == b.y && a.z == b.z && a.w == b.w && a.e == b.e && Equals(a.n, b.n);
+	}
+
+
+	bool Equals(const Stuff::ContainerStruct& a, const Stuff::ContainerStruct& b)
+	{
+		return a.id == b.id && a.values == b.values && a.name == b.name && a.weights == b.weights &&
+			a.samples[0] == b.samples[0] && a.samples[1] == b.samples[1] && a.samples[2] == b.samples[2];
+	}
+
+
+	// Saves pointers to two nodes as their index plus one
+	struct NodePtrSave : public clutl::IPtrSave
+	{
+		NodePtrSave(const Stuff::ImageNode* a, const Stuff::ImageNode* b) : a(a), b(b) { }
+		bool CanSavePtr(void* ptr, const clcpp::Field*, const clcpp::Type*)
+		{
+			return ptr == a || ptr == b;
+		}
+		unsigned int SavePtr(void* ptr)
+		{
+			return ptr == a ? 1 : 2;
+		}
+		const Stuff::ImageNode* a;
+		const Stuff::ImageNode* b;
+	};
+}
 
 
 void TestSerialise(clcpp::Database& db)
@@ -76,8 +162,261 @@ void TestSerialise(clcpp::Database& db)
 	clutl::WriteBuffer write_buffer;
 
 	Stuff::DerivedStruct src;
+	src.x = -5;
+	src.e = Stuff::VAL_C;
+	src.n.b = 300;
+	src.n.i = 123456;
 	clutl::SaveVersionedBinary(write_buffer, &src, clcpp::GetType<Stuff::DerivedStruct>());
 	clutl::ReadBuffer read_buffer(write_buffer);
 	Stuff::DerivedStruct dest(Stuff::NO_INIT);
-	clutl::LoadVersionedBinary(read_buffer, &dest, clcpp::GetType<Stuff::DerivedStruct>());
+	bool pass = clutl::LoadVersionedBinary(read_buffer, &dest, clcpp::GetType<Stuff::DerivedStruct>());
+	pass &= read_buffer.GetBytesRemaining() == 0 && Equals(src, dest);
+
+	// Truncated data and objects of a different type fail to load
+	clutl::ReadBuffer truncated_read_buffer(write_buffer.GetData(), write_buffer.GetBytesWritten() - 1);
+	Stuff::DerivedStruct truncated_dest(Stuff::NO_INIT);
+	pass &= !clutl::LoadVersionedBinary(truncated_read_buffer, &truncated_dest, clcpp::GetType<Stuff::DerivedStruct>());
+	clutl::ReadBuffer mismatch_read_buffer(write_buffer);
+	Stuff::NestedStruct mismatch_dest;
+	pass &= !clutl::LoadVersionedBinary(mismatch_read_buffer, &mismatch_dest, db.GetType(db.GetName("Stuff::NestedStruct").hash));
+
+	// Pretend the layout of NestedStruct has changed since saving so that its fields are
+	// matched by name using the layout saved in the stream
+	clcpp::Class* nested_type = (clcpp::Class*)db.GetType(db.GetName("Stuff::NestedStruct").hash);
+	unsigned int layout_fingerprint = nested_type->layout_fingerprint;
+	nested_type->layout_fingerprint = ~layout_fingerprint;
+	clutl::ReadBuffer convert_read_buffer(write_buffer);
+	Stuff::DerivedStruct convert_dest(Stuff::NO_INIT);
+	clutl::LoadVersionedBinary(convert_read_buffer, &convert_dest, clcpp::GetType<Stuff::DerivedStruct>());
+	nested_type->layout_fingerprint = layout_fingerprint;
+	pass &= layout_fingerprint != 0 && convert_read_buffer.GetBytesRemaining() == 0 && Equals(src, convert_dest);
+
+	// Objects saved through a stream only describe their layouts the first time
+	clutl::VersionedBinaryStream save_stream;
+	clutl::WriteBuffer stream_write_buffer;
+	clutl::SaveVersionedBinary(stream_write_buffer, &src, clcpp::GetType<Stuff::DerivedStruct>(), &save_stream);
+	unsigned int first_size = stream_write_buffer.GetBytesWritten();
+	src.x = 17;
+	clutl::SaveVersionedBinary(stream_write_buffer, &src, clcpp::GetType<Stuff::DerivedStruct>(), &save_stream);
+	pass &= stream_write_buffer.GetBytesWritten() - first_size < first_size;
+	clutl::VersionedBinaryStream load_stream;
+	clutl::ReadBuffer stream_read_buffer(stream_write_buffer);
+	Stuff::DerivedStruct stream_dest(Stuff::NO_INIT);
+	clutl::LoadVersionedBinary(stream_read_buffer, &stream_dest, clcpp::GetType<Stuff::DerivedStruct>(), &load_stream);
+	pass &= stream_dest.x == -5;
+	clutl::LoadVersionedBinary(stream_read_buffer, &stream_dest, clcpp::GetType<Stuff::DerivedStruct>(), &load_stream);
+	pass &= stream_read_buffer.GetBytesRemaining() == 0 && Equals(src, stream_dest);
+
+	// Containers are saved through their iterators
+	const clcpp::Type* container_type = db.GetType(db.GetName("Stuff::ContainerStruct").hash);
+	if (container_type != 0)
+	{
+		Stuff::ContainerStruct container_src;
+		container_src.id = 7;
+		container_src.name = "containers";
+		for (int i = 0; i < 100; i++)
+			container_src.values.push_back(i * i);
+		container_src.weights[1] = 0.5f;
+		container_src.weights[-20] = 4.0f;
+		container_src.samples[0] = 1;
+		container_src.samples[1] = 2;
+		container_src.samples[2] = 3;
+
+		clutl::WriteBuffer container_write_buffer;
+		clutl::SaveVersionedBinary(container_write_buffer, &container_src, container_type);
+		clutl::ReadBuffer container_read_buffer(container_write_buffer);
+		Stuff::ContainerStruct container_dest;
+		clutl::LoadVersionedBinary(container_read_buffer, &container_dest, container_type);
+		pass &= container_read_buffer.GetBytesRemaining() == 0 && Equals(container_src, container_dest);
+	}
+	else
+	{
+		pass = false;
+	}
+
+	if (pass)
+		printf("VERSIONED BINARY PASS!\n");
+	else
+		printf("VERSIONED BINARY FAIL!\n");
+
+	// A cycle of nodes sharing a string is saved as an image and loaded by patching its pointers
+	const clcpp::Type* node_type = db.GetType(db.GetName("Stuff::ImageNode").hash);
+	pass = node_type != 0;
+	if (pass)
+	{
+		Stuff::ImageNode a = { 1, "node", 0 };
+		Stuff::ImageNode b = { 2, a.name, &a };
+		a.next = &b;
+
+		clutl::WriteBuffer image_write_buffer;
+		const void* objects[] = { &a };
+		pass = clutl::SaveImage(image_write_buffer, objects, &node_type, 1);
+
+		// Copy to memory with the alignment the image requires
+		unsigned int image_size = image_write_buffer.GetBytesWritten();
+		char* image_data = new char[image_size + 16];
+		char* image = image_data + ((16 - (clcpp::pointer_type)image_data % 16) % 16);
+		memcpy(image, image_write_buffer.GetData(), image_size);
+
+		void* root = 0;
+		pass = pass && clutl::LoadImage(image, image_size, &root, &node_type, 1);
+		Stuff::ImageNode* node_a = (Stuff::ImageNode*)root;
+		pass = pass && node_a->value == 1 && node_a->next->value == 2 && node_a->next->next == node_a &&
+			node_a->name == node_a->next->name && strcmp(node_a->name, "node") == 0;
+		delete [] image_data;
+
+		// Load the image straight from a file mapped copy-on-write, leaving the file untouched
+		const char* image_filename = "TestSerialise.image";
+		FILE* image_fp = fopen(image_filename, "wb");
+		pass = pass && image_fp != 0;
+		if (image_fp != 0)
+		{
+			fwrite(image_write_buffer.GetData(), 1, image_size, image_fp);
+			fclose(image_fp);
+		}
+		clutl::MappedFile image_file;
+		pass = pass && image_file.Open(image_filename, clutl::MappedFile::COPY_ON_WRITE) && image_file.GetSize() == image_size;
+		pass = pass && clutl::LoadImage(image_file.GetWritableData(), image_size, &root, &node_type, 1);
+		if (pass)
+		{
+			Stuff::ImageNode* mapped_node_a = (Stuff::ImageNode*)root;
+			pass = mapped_node_a->value == 1 && mapped_node_a->next->value == 2 && mapped_node_a->next->next == mapped_node_a &&
+				strcmp(mapped_node_a->name, "node") == 0;
+		}
+		clutl::MappedFile unpatched_file;
+		pass = pass && unpatched_file.Open(image_filename) && unpatched_file.GetWritableData() == 0 &&
+			memcmp(unpatched_file.GetData(), image_write_buffer.GetData(), image_size) == 0;
+		image_file.Close();
+		unpatched_file.Close();
+		remove(image_filename);
+	}
+
+	// Graphs reaching template instances other than clcpp::CArray can't be saved
+	const clcpp::Type* ref_node_type = db.GetType(db.GetName("Stuff::ImageRefNode").hash);
+	pass = pass && ref_node_type != 0;
+	if (pass)
+	{
+		Stuff::ImageNode node = { 1, "node", 0 };
+		Stuff::ImageRefNode ref_node;
+		ref_node.ref.ptr = &node;
+
+		clutl::WriteBuffer image_write_buffer;
+		const void* objects[] = { &ref_node };
+		pass = !clutl::SaveImage(image_write_buffer, objects, &ref_node_type, 1) && image_write_buffer.GetBytesWritten() == 0;
+	}
+
+	if (pass)
+		printf("IMAGE PASS!\n");
+	else
+		printf("IMAGE FAIL!\n");
+
+	// The same cycle saved as versioned binary is relinked once both nodes have been loaded
+	pass = node_type != 0;
+	if (pass)
+	{
+		Stuff::ImageNode a = { 1, "node", 0 };
+		Stuff::ImageNode b = { 2, a.name, &a };
+		a.next = &b;
+
+		NodePtrSave ptr_save(&a, &b);
+		clutl::WriteBuffer ptr_write_buffer;
+		clutl::SaveVersionedBinary(ptr_write_buffer, &a, node_type, 0, &ptr_save);
+		clutl::SaveVersionedBinary(ptr_write_buffer, &b, node_type, 0, &ptr_save);
+
+		Stuff::ImageNode loaded[2];
+		clutl::PtrFixups ptr_fixups;
+		clutl::ReadBuffer ptr_read_buffer(ptr_write_buffer);
+		for (int i = 0; i < 2; i++)
+		{
+			clutl::LoadVersionedBinary(ptr_read_buffer, loaded + i, node_type, 0, &ptr_fixups);
+			ptr_fixups.AddObject(i + 1, loaded + i);
+		}
+
+		// Strings weren't saved so are nulled along with the node pointers
+		pass = ptr_fixups.Resolve() == 0 && ptr_read_buffer.GetBytesRemaining() == 0 &&
+			loaded[0].value == 1 && loaded[0].next == loaded + 1 && loaded[1].next == loaded &&
+			loaded[0].name == 0 && loaded[1].name == 0;
+
+		// MessagePack records its pointers in the same way, with unsaved pointers loaded from nil
+		clutl::WriteBuffer msgpack_write_buffer;
+		clutl::SaveMsgPack(msgpack_write_buffer, &a, node_type, &ptr_save);
+		clutl::SaveMsgPack(msgpack_write_buffer, &b, node_type, &ptr_save);
+
+		Stuff::ImageNode msgpack_loaded[2] = { { 0, "stale", 0 }, { 0, "stale", 0 } };
+		clutl::PtrFixups msgpack_ptr_fixups;
+		clutl::ReadBuffer msgpack_read_buffer(msgpack_write_buffer);
+		for (int i = 0; i < 2; i++)
+		{
+			pass = pass && clutl::LoadMsgPack(msgpack_read_buffer, msgpack_loaded + i, node_type, &msgpack_ptr_fixups).code == clutl::MsgPackError::NONE;
+			msgpack_ptr_fixups.AddObject(i + 1, msgpack_loaded + i);
+		}
+
+		pass = pass && msgpack_ptr_fixups.Resolve() == 0 && msgpack_read_buffer.GetBytesRemaining() == 0 &&
+			msgpack_loaded[1].value == 2 && msgpack_loaded[0].next == msgpack_loaded + 1 && msgpack_loaded[1].next == msgpack_loaded &&
+			msgpack_loaded[0].name == 0 && msgpack_loaded[1].name == 0;
+	}
+
+	if (pass)
+		printf("POINTER FIXUPS PASS!\n");
+	else
+		printf("POINTER FIXUPS FAIL!\n");
+
+	// Deltas carry the changed base, nested, container and string view fields in both forms
+	const clcpp::Type* view_type = db.GetType(db.GetName("Stuff::ViewStruct").hash);
+	pass = container_type != 0 && view_type != 0;
+	for (unsigned int flags = 0; pass && flags <= clutl::DeltaFlags::FIELD_BITMASKS; flags++)
+	{
+		Stuff::DerivedStruct delta_src;
+		Stuff::DerivedStruct delta_dest;
+		delta_src.v1 = 0.5f;
+		delta_src.n.h = 99;
+		clutl::WriteBuffer delta_write_buffer;
+		clutl::SaveDelta(delta_write_buffer, &delta_src, &delta_dest, clcpp::GetType<Stuff::DerivedStruct>(), flags);
+		clutl::ReadBuffer delta_read_buffer(delta_write_buffer);
+		pass = clutl::ApplyDelta(delta_read_buffer, &delta_dest, clcpp::GetType<Stuff::DerivedStruct>(), flags) &&
+			delta_read_buffer.GetBytesRemaining() == 0 && Equals(delta_src, delta_dest) && delta_dest.v1 == 0.5f;
+
+		Stuff::ContainerStruct container_baseline;
+		Stuff::ContainerStruct container_src;
+		container_baseline.id = container_src.id = 1;
+		container_baseline.samples[0] = container_src.samples[0] = 0;
+		container_baseline.samples[1] = container_src.samples[1] = 0;
+		container_baseline.samples[2] = container_src.samples[2] = 0;
+		container_src.values.push_back(3);
+		container_src.weights[4] = 5.0f;
+		Stuff::ContainerStruct container_dest = container_baseline;
+		clutl::WriteBuffer container_delta_buffer;
+		clutl::SaveDelta(container_delta_buffer, &container_src, &container_baseline, container_type, flags);
+		clutl::ReadBuffer container_read_buffer(container_delta_buffer);
+		pass = pass && clutl::ApplyDelta(container_read_buffer, &container_dest, container_type, flags) &&
+			container_read_buffer.GetBytesRemaining() == 0 && Equals(container_src, container_dest);
+
+		// Views are compared by their characters, so only the one whose contents change is saved
+		char view_chars[] = "alpha alpha";
+		Stuff::ViewStruct view_baseline[2];
+		for (int i = 0; i < 2; i++)
+		{
+			view_baseline[i].id = i;
+			view_baseline[i].name.data = view_chars;
+			view_baseline[i].name.length = 5;
+		}
+		Stuff::ViewStruct view_src[2] = { view_baseline[0], view_baseline[1] };
+		view_src[0].name.data = view_chars + 6;
+		view_src[1].name.data = "alphb";
+		clutl::WriteBuffer view_delta_buffer;
+		for (int i = 0; i < 2; i++)
+			clutl::SaveDelta(view_delta_buffer, view_src + i, view_baseline + i, view_type, flags);
+		clutl::ReadBuffer view_read_buffer(view_delta_buffer);
+		for (int i = 0; pass && i < 2; i++)
+			pass = clutl::ApplyDelta(view_read_buffer, view_baseline + i, view_type, flags);
+		pass = pass && view_read_buffer.GetBytesRemaining() == 0 && view_baseline[0].name.data == view_chars &&
+			view_baseline[1].name.length == 5 && memcmp(view_baseline[1].name.data, "alphb", 5) == 0 &&
+			view_baseline[1].name.data >= view_delta_buffer.GetData() &&
+			view_baseline[1].name.data < view_delta_buffer.GetData() + view_delta_buffer.GetBytesWritten();
+	}
+
+	if (pass)
+		printf("DELTA PASS!\n");
+	else
+		printf("DELTA FAIL!\n");
 }
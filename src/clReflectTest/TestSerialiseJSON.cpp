@@ -12,6 +12,7 @@
 #include <clutl/Serialise.h>
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 
@@ -28,6 +29,62 @@ namespace
 	// pair without string
 
 
+	class StringAllocator : public clcpp::IAllocator
+	{
+	public:
+		void* Alloc(clcpp::size_type size)
+		{
+			return malloc(size);
+		}
+		void Free(void* ptr)
+		{
+			free(ptr);
+		}
+	};
+
+
+	unsigned int ClearJSONKeys(const clcpp::Type* type)
+	{
+		// Fields are only visited while they still have keys, which stops recursive types looping
+		unsigned int nb_cleared = 0;
+		for (unsigned int i = 0; i < type->base_types.size; i++)
+			nb_cleared += ClearJSONKeys(type->base_types[i]);
+
+		if (type->kind == clcpp::Primitive::KIND_TEMPLATE_TYPE)
+		{
+			const clcpp::TemplateType* template_type = type->AsTemplateType();
+			for (int i = 0; i < clcpp::TemplateType::MAX_NB_ARGS; i++)
+			{
+				if (template_type->parameter_types[i] != 0)
+					nb_cleared += ClearJSONKeys(template_type->parameter_types[i]);
+			}
+		}
+
+		else if (type->kind == clcpp::Primitive::KIND_CLASS)
+		{
+			const clcpp::CArray<const clcpp::Field*>& fields = type->AsClass()->fields;
+			for (unsigned int i = 0; i < fields.size; i++)
+			{
+				clcpp::Field* field = const_cast<clcpp::Field*>(fields[i]);
+				if (field->json_key != 0)
+				{
+					field->json_key = 0;
+					field->json_key_length = 0;
+					nb_cleared += 1 + ClearJSONKeys(field->type);
+				}
+			}
+		}
+
+		return nb_cleared;
+	}
+
+
+	void AppendToBuffer(const void* data, unsigned int length, void* user_data)
+	{
+		((clutl::WriteBuffer*)user_data)->Write(data, length);
+	}
+
+
 	void Test(const char* name, const char* test)
 	{
 		printf("---------------------\n");
@@ -39,6 +96,14 @@ namespace
 		clutl::ReadBuffer read_buffer(write_buffer);
 
 		clutl::JSONError error = clutl::LoadJSON(read_buffer, 0, (clcpp::Type*)0);
+
+		// Feeding the push parser a byte at a time should give the same result
+		clutl::JSONPushParser push_parser(0, 0);
+		for (const char* c = test; *c; c++)
+			push_parser.Feed(c, 1);
+		clutl::JSONError push_error = push_parser.Finish();
+		if (push_error.code != error.code || push_error.line != error.line || push_error.column != error.column)
+			printf("PUSH MISMATCH (%d, %d): %d\n", push_error.line, push_error.column, push_error.code);
 		if (error.code == clutl::JSONError::NONE)
 		{
 			printf("PASS\n");
@@ -336,6 +401,30 @@ namespace jsontest
 			return true;
 		}
 	};
+
+
+	struct StringViews
+	{
+		clutl::StringView plain;
+		clutl::StringView escaped;
+		int value;
+	};
+
+
+	struct Config
+	{
+		Config()
+			: version(0)
+			, scale(1)
+			, mode(VALUE_A)
+		{
+		}
+
+		int version;
+		double scale;
+		Value mode;
+		BaseStruct limits;
+	};
 }
 
 
@@ -423,4 +512,177 @@ void TestSerialiseJSON(clcpp::Database& db)
 		printf("STRUCT PASS!\n");
 	else
 		printf("STRUCT FAIL!\n");
+
+	// The keys pre-encoded with -json_keys must give the same output as encoding field names on save
+	clutl::WriteBuffer names_buffer;
+	unsigned int nb_keys = ClearJSONKeys(clcpp::GetType<jsontest::AllFields>());
+	clutl::SaveJSON(names_buffer, &a, clcpp::GetType<jsontest::AllFields>(), 0, clutl::JSONFlags::EMIT_HEX_FLOATS);
+	if (nb_keys != 0 && names_buffer.GetBytesWritten() == write_buffer.GetBytesWritten() &&
+		memcmp(names_buffer.GetData(), write_buffer.GetData(), write_buffer.GetBytesWritten()) == 0)
+		printf("JSON KEYS PASS!\n");
+	else
+		printf("JSON KEYS FAIL!\n");
+
+	// Stream the same object through a chunk smaller than most values and check the output matches,
+	// once with a single chunk and once double-buffered
+	bool stream_pass = true;
+	for (int i = 0; i < 2; i++)
+	{
+		clutl::WriteBuffer stream_output;
+		clutl::CallbackSink sink(AppendToBuffer, &stream_output);
+		clutl::WriteBuffer stream_buffer(&sink, 16, i == 1);
+		clutl::SaveJSON(stream_buffer, &a, clcpp::GetType<jsontest::AllFields>(), 0, clutl::JSONFlags::EMIT_HEX_FLOATS);
+		stream_buffer.Flush();
+		stream_pass = stream_pass && stream_output.GetBytesWritten() == write_buffer.GetBytesWritten() &&
+			stream_buffer.GetBytesFlushed() == write_buffer.GetBytesWritten() &&
+			memcmp(stream_output.GetData(), write_buffer.GetData(), write_buffer.GetBytesWritten()) == 0;
+	}
+	if (stream_pass)
+		printf("STREAM PASS!\n");
+	else
+		printf("STREAM FAIL!\n");
+
+	// Saving into reserved virtual memory gives the same output without ever moving the data
+	clutl::WriteBuffer virtual_buffer(clutl::WriteBuffer::VIRTUAL_MEMORY, 1 << 20);
+	const char* virtual_data = virtual_buffer.GetData();
+	clutl::SaveJSON(virtual_buffer, &a, clcpp::GetType<jsontest::AllFields>(), 0, clutl::JSONFlags::EMIT_HEX_FLOATS);
+	if (virtual_buffer.GetBytesWritten() == write_buffer.GetBytesWritten() &&
+		memcmp(virtual_buffer.GetData(), write_buffer.GetData(), write_buffer.GetBytesWritten()) == 0 &&
+		(!virtual_buffer.IsVirtual() || virtual_buffer.GetData() == virtual_data))
+		printf("VIRTUAL PASS!\n");
+	else
+		printf("VIRTUAL FAIL!\n");
+
+	// Load the same output from a file, straight from its mapped pages
+	const char* mapped_filename = "TestSerialiseJSON.json";
+	FILE* mapped_fp = fopen(mapped_filename, "wb");
+	bool mapped_pass = mapped_fp != 0;
+	if (mapped_fp != 0)
+	{
+		fwrite(write_buffer.GetData(), 1, write_buffer.GetBytesWritten(), mapped_fp);
+		fclose(mapped_fp);
+	}
+	clutl::MappedFile mapped_file;
+	mapped_pass = mapped_pass && mapped_file.Open(mapped_filename) && mapped_file.GetSize() == write_buffer.GetBytesWritten();
+	jsontest::AllFields mapped_fields(jsontest::NO_INIT);
+	if (mapped_pass)
+	{
+		clutl::ReadBuffer mapped_buffer(mapped_file);
+		mapped_pass = clutl::LoadJSON(mapped_buffer, &mapped_fields, clcpp::GetType<jsontest::AllFields>()).code == clutl::JSONError::NONE && a == mapped_fields;
+	}
+	mapped_file.Close();
+	remove(mapped_filename);
+	if (mapped_pass)
+		printf("MAPPED PASS!\n");
+	else
+		printf("MAPPED FAIL!\n");
+
+	// Save into segments smaller than most values, twice to reuse the segments, and gather them
+	StringAllocator segment_allocator;
+	clutl::WriteBuffer segmented_buffer(&segment_allocator, 16);
+	clutl::WriteBuffer segmented_output;
+	clutl::CallbackSink segmented_sink(AppendToBuffer, &segmented_output);
+	for (int i = 0; i < 2; i++)
+	{
+		segmented_buffer.Reset();
+		segmented_output.Reset();
+		clutl::SaveJSON(segmented_buffer, &a, clcpp::GetType<jsontest::AllFields>(), 0, clutl::JSONFlags::EMIT_HEX_FLOATS);
+		segmented_buffer.SendSegments(&segmented_sink);
+	}
+	if (segmented_output.GetBytesWritten() == write_buffer.GetBytesWritten() &&
+		memcmp(segmented_output.GetData(), write_buffer.GetData(), write_buffer.GetBytesWritten()) == 0)
+		printf("SEGMENTED PASS!\n");
+	else
+		printf("SEGMENTED FAIL!\n");
+
+	// Load the object again, feeding the push parser chunks of varying sizes
+	jsontest::AllFields c(jsontest::NO_INIT);
+	clutl::JSONPushParser push_parser(&c, clcpp::GetType<jsontest::AllFields>());
+	const char* data = write_buffer.GetData();
+	unsigned int data_size = write_buffer.GetBytesWritten();
+	for (unsigned int pos = 0, chunk_size = 1; pos < data_size; pos += chunk_size, chunk_size = chunk_size % 7 + 1)
+		push_parser.Feed(data + pos, pos + chunk_size < data_size ? chunk_size : data_size - pos);
+	clutl::JSONError push_error = push_parser.Finish();
+	if (push_error.code == clutl::JSONError::NONE && a == c)
+		printf("PUSH PASS!\n");
+	else
+		printf("PUSH FAIL!\n");
+
+	// Round trip a few records through JSON Lines, separated by a blank line
+	jsontest::AllFields records[3];
+	clutl::WriteBuffer lines_buffer;
+	clutl::SaveJSONLines(lines_buffer, records, 2, clcpp::GetType<jsontest::AllFields>(), 0, clutl::JSONFlags::EMIT_HEX_FLOATS);
+	lines_buffer.WriteChar('\n');
+	clutl::SaveJSONLines(lines_buffer, records + 2, 1, clcpp::GetType<jsontest::AllFields>(), 0, clutl::JSONFlags::EMIT_HEX_FLOATS);
+	clutl::ReadBuffer lines_read_buffer(lines_buffer);
+	jsontest::AllFields loaded_records[3] = { jsontest::NO_INIT, jsontest::NO_INIT, jsontest::NO_INIT };
+	unsigned int nb_loaded_records = 0;
+	clutl::JSONError lines_error = clutl::LoadJSONLines(lines_read_buffer, loaded_records, 3, clcpp::GetType<jsontest::AllFields>(), nb_loaded_records);
+	if (lines_error.code == clutl::JSONError::NONE && nb_loaded_records == 3 &&
+		records[0] == loaded_records[0] && records[1] == loaded_records[1] && records[2] == loaded_records[2])
+		printf("LINES PASS!\n");
+	else
+		printf("LINES FAIL!\n");
+
+	// Unescaped strings should point into the input, escaped ones are decoded into the allocator
+	const char* views_json = "{ \"plain\" : \"plain text\", \"escaped\" : \"a\\\"b\\n\\u00e9\", \"value\" : 7 }";
+	const clcpp::Type* views_type = db.GetType(db.GetName("jsontest::StringViews").hash);
+	StringAllocator string_allocator;
+	clutl::ReadBuffer views_read_buffer(views_json, strlen(views_json));
+	jsontest::StringViews views;
+	clutl::JSONError views_error = clutl::LoadJSON(views_read_buffer, &views, views_type, &string_allocator);
+	bool views_pass = views_error.code == clutl::JSONError::NONE && views.value == 7 &&
+		views.plain.data >= views_json && views.plain.data < views_json + strlen(views_json) &&
+		views.plain.length == 10 && memcmp(views.plain.data, "plain text", 10) == 0 &&
+		views.escaped.length == 6 && memcmp(views.escaped.data, "a\"b\n\xc3\xa9", 6) == 0;
+
+	// Saving escapes the strings again so that they round trip
+	clutl::WriteBuffer views_buffer;
+	clutl::SaveJSON(views_buffer, &views, views_type, 0, 0);
+	clutl::ReadBuffer views_reload_buffer(views_buffer);
+	jsontest::StringViews views_reload;
+	views_error = clutl::LoadJSON(views_reload_buffer, &views_reload, views_type, &string_allocator);
+	views_pass = views_pass && views_error.code == clutl::JSONError::NONE &&
+		views_reload.escaped.length == 6 && memcmp(views_reload.escaped.data, views.escaped.data, 6) == 0;
+
+	// Without an allocator, escaped strings are left undecoded in the input
+	clutl::ReadBuffer views_raw_buffer(views_json, strlen(views_json));
+	jsontest::StringViews views_raw;
+	views_error = clutl::LoadJSON(views_raw_buffer, &views_raw, views_type);
+	views_pass = views_pass && views_error.code == clutl::JSONError::NONE && views_raw.value == 7 &&
+		views_raw.escaped.length == 12 && memcmp(views_raw.escaped.data, "a\\\"b\\n\\u00e9", 12) == 0;
+	string_allocator.Free((void*)views.escaped.data);
+	string_allocator.Free((void*)views_reload.escaped.data);
+	if (views_pass)
+		printf("STRINGVIEW PASS!\n");
+	else
+		printf("STRINGVIEW FAIL!\n");
+
+	// The first load comes from JSON and writes the cache, which the second load uses
+	const char* config_json = "{ \"version\" : 3, \"scale\" : 2.5, \"mode\" : \"YUP\", \"limits\" : { \"a\" : 1, \"d\" : 4 } }";
+	const char* config_cache = "TestSerialiseJSON.jsonbin";
+	const clcpp::Type* config_type = db.GetType(db.GetName("jsontest::Config").hash);
+	bool from_cache[3];
+	jsontest::Config configs[3];
+	bool cache_pass = true;
+	for (int i = 0; i < 2; i++)
+	{
+		clutl::ReadBuffer config_buffer(config_json, strlen(config_json));
+		cache_pass &= clutl::LoadJSONCached(config_buffer, config_cache, &configs[i], config_type, &from_cache[i]).code == clutl::JSONError::NONE;
+	}
+
+	// Any change to the JSON invalidates the cache
+	const char* changed_json = "{ \"version\" : 4, \"scale\" : 2.5, \"mode\" : \"YUP\", \"limits\" : { \"a\" : 1, \"d\" : 4 } }";
+	clutl::ReadBuffer changed_buffer(changed_json, strlen(changed_json));
+	clutl::LoadJSONCached(changed_buffer, config_cache, &configs[2], config_type, &from_cache[2]);
+	remove(config_cache);
+
+	cache_pass = cache_pass && !from_cache[0] && from_cache[1] && !from_cache[2] &&
+		configs[1].version == 3 && configs[1].scale == 2.5 && configs[1].mode == jsontest::YUP &&
+		configs[1].limits.a == 1 && configs[1].limits.b == 101 && configs[1].limits.d == 4 &&
+		configs[2].version == 4;
+	if (cache_pass)
+		printf("CACHE PASS!\n");
+	else
+		printf("CACHE FAIL!\n");
 }
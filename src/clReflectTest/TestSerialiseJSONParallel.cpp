@@ -0,0 +1,303 @@
+//
+// ===============================================================================
+// clReflect
+// -------------------------------------------------------------------------------
+// Copyright (c) 2011-2012 Don Williamson & clReflect Authors (see AUTHORS file)
+// Released under MIT License (see LICENSE file)
+// ===============================================================================
+//
+
+#include <clcpp/clcpp.h>
+#include <clutl/Serialise.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#if defined(CLCPP_USING_MSVC)
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#include "Timer.h"
+
+
+clcpp_reflect(jsonparallel)
+namespace jsonparallel
+{
+	struct Element
+	{
+		int id;
+		float position[3];
+		double weight;
+		unsigned int flags;
+	};
+
+	struct Elements
+	{
+		Element elements[131072];
+	};
+
+	struct Record
+	{
+		int id;
+		double weight;
+		Element elements[16];
+	};
+}
+
+
+namespace
+{
+	const unsigned int MAX_NB_THREADS = 32;
+
+
+	//
+	// Minimal pool that starts a thread per worker for each run, with indices striped across them
+	//
+	class ThreadPool : public clutl::IParallelFor
+	{
+	public:
+		ThreadPool(unsigned int nb_threads)
+			: m_NbThreads(nb_threads)
+			, m_Function(0)
+			, m_Data(0)
+			, m_Count(0)
+		{
+		}
+
+		void Run(Function function, void* data, unsigned int count)
+		{
+			m_Function = function;
+			m_Data = data;
+			m_Count = count;
+
+			// The calling thread runs the first worker
+			for (unsigned int i = 1; i < m_NbThreads; i++)
+			{
+				m_Workers[i].pool = this;
+				m_Workers[i].index = i;
+			#if defined(CLCPP_USING_MSVC)
+				m_Threads[i] = CreateThread(0, 0, ThreadMain, &m_Workers[i], 0, 0);
+			#else
+				pthread_create(&m_Threads[i], 0, ThreadMain, &m_Workers[i]);
+			#endif
+			}
+
+			RunWorker(0);
+
+			for (unsigned int i = 1; i < m_NbThreads; i++)
+			{
+			#if defined(CLCPP_USING_MSVC)
+				WaitForSingleObject(m_Threads[i], INFINITE);
+				CloseHandle(m_Threads[i]);
+			#else
+				pthread_join(m_Threads[i], 0);
+			#endif
+			}
+		}
+
+	private:
+		struct Worker
+		{
+			ThreadPool* pool;
+			unsigned int index;
+		};
+
+	#if defined(CLCPP_USING_MSVC)
+		static DWORD WINAPI ThreadMain(void* param)
+	#else
+		static void* ThreadMain(void* param)
+	#endif
+		{
+			Worker* worker = (Worker*)param;
+			worker->pool->RunWorker(worker->index);
+			return 0;
+		}
+
+		void RunWorker(unsigned int worker_index)
+		{
+			for (unsigned int i = worker_index; i < m_Count; i += m_NbThreads)
+				m_Function(m_Data, i);
+		}
+
+		unsigned int m_NbThreads;
+		Function m_Function;
+		void* m_Data;
+		unsigned int m_Count;
+
+		Worker m_Workers[MAX_NB_THREADS];
+	#if defined(CLCPP_USING_MSVC)
+		HANDLE m_Threads[MAX_NB_THREADS];
+	#else
+		pthread_t m_Threads[MAX_NB_THREADS];
+	#endif
+	};
+
+
+	bool BuffersMatch(const clutl::WriteBuffer& a, const clutl::WriteBuffer& b)
+	{
+		return a.GetBytesWritten() == b.GetBytesWritten() &&
+			memcmp(a.GetData(), b.GetData(), a.GetBytesWritten()) == 0;
+	}
+
+
+	void InitElement(jsonparallel::Element& element, unsigned int i)
+	{
+		element.id = i;
+		element.position[0] = i * 0.25f;
+		element.position[1] = i * -1.5f;
+		element.position[2] = i * 3.125f;
+		element.weight = 1.0 / (i + 1);
+		element.flags = i * 2654435761U;
+	}
+
+
+	// Each thread repeatedly saves and loads its own copy of a record
+	struct ConcurrentTest
+	{
+		const clcpp::Type* type;
+		const jsonparallel::Record* record;
+		const clutl::WriteBuffer* reference;
+		unsigned int nb_iterations;
+		bool failed[MAX_NB_THREADS];
+	};
+
+
+	void RunConcurrentTest(void* data, unsigned int index)
+	{
+		ConcurrentTest& test = *(ConcurrentTest*)data;
+		clutl::WriteBuffer output;
+		for (unsigned int i = 0; i < test.nb_iterations; i++)
+		{
+			// Both the saved record and the save of the record loaded from that must match the reference
+			output.Reset();
+			clutl::SaveJSON(output, test.record, test.type, 0, clutl::JSONFlags::EMIT_HEX_FLOATS);
+			if (!BuffersMatch(output, *test.reference))
+				test.failed[index] = true;
+
+			jsonparallel::Record loaded;
+			clutl::ReadBuffer read_buffer(output);
+			if (clutl::LoadJSON(read_buffer, &loaded, test.type).code != clutl::JSONError::NONE)
+				test.failed[index] = true;
+
+			output.Reset();
+			clutl::SaveJSON(output, &loaded, test.type, 0, clutl::JSONFlags::EMIT_HEX_FLOATS);
+			if (!BuffersMatch(output, *test.reference))
+				test.failed[index] = true;
+		}
+	}
+}
+
+
+void TestSerialiseJSONParallel(clcpp::Database& db)
+{
+	// The types aren't referenced by GetType so look them up by name
+	const clcpp::Type* type = db.GetType(db.GetName("jsonparallel::Elements").hash);
+	if (type == 0)
+	{
+		printf("PARALLEL FAIL!\n");
+		return;
+	}
+
+	jsonparallel::Elements* elements = new jsonparallel::Elements;
+	const unsigned int nb_elements = sizeof(elements->elements) / sizeof(elements->elements[0]);
+	for (unsigned int i = 0; i < nb_elements; i++)
+		InitElement(elements->elements[i], i);
+
+	// Reference serial save, keeping the best of a few runs for each timing
+	const int nb_runs = 3;
+	clutl::WriteBuffer serial_output;
+	double serial_time = 0;
+	for (int i = 0; i < nb_runs; i++)
+	{
+		serial_output.Reset();
+		double start = GetTimeMs();
+		clutl::SaveJSON(serial_output, elements, type, 0);
+		double time = GetTimeMs() - start;
+		if (i == 0 || time < serial_time)
+			serial_time = time;
+	}
+	printf("PARALLEL SERIAL: %.2fms, %d bytes\n", serial_time, serial_output.GetBytesWritten());
+
+	bool all_match = true;
+	for (unsigned int nb_threads = 1; nb_threads <= MAX_NB_THREADS; nb_threads *= 2)
+	{
+		ThreadPool pool(nb_threads);
+		clutl::WriteBuffer output;
+		double parallel_time = 0;
+		for (int i = 0; i < nb_runs; i++)
+		{
+			output.Reset();
+			double start = GetTimeMs();
+			clutl::SaveJSON(output, elements, type, 0, 0, &pool, 4096);
+			double time = GetTimeMs() - start;
+			if (i == 0 || time < parallel_time)
+				parallel_time = time;
+		}
+
+		bool match = BuffersMatch(output, serial_output);
+		all_match &= match;
+		printf("PARALLEL %2d THREADS: %.2fms (%.2fx)%s\n", nb_threads, parallel_time, serial_time / parallel_time, match ? "" : " MISMATCH");
+	}
+
+	if (all_match)
+		printf("PARALLEL PASS!\n");
+	else
+		printf("PARALLEL FAIL!\n");
+
+	delete elements;
+}
+
+
+void TestSerialiseJSONConcurrent(clcpp::Database& db)
+{
+	const clcpp::Type* type = db.GetType(db.GetName("jsonparallel::Record").hash);
+	if (type == 0)
+	{
+		printf("CONCURRENT FAIL!\n");
+		return;
+	}
+
+	jsonparallel::Record record;
+	record.id = 42;
+	record.weight = 0.1;
+	for (unsigned int i = 0; i < sizeof(record.elements) / sizeof(record.elements[0]); i++)
+		InitElement(record.elements[i], i);
+
+	clutl::WriteBuffer reference;
+	clutl::SaveJSON(reference, &record, type, 0, clutl::JSONFlags::EMIT_HEX_FLOATS);
+
+	// Measure throughput of save/load round trips on all threads at once
+	double single_thread_rate = 0;
+	bool all_passed = true;
+	for (unsigned int nb_threads = 1; nb_threads <= MAX_NB_THREADS; nb_threads *= 2)
+	{
+		ConcurrentTest test;
+		test.type = type;
+		test.record = &record;
+		test.reference = &reference;
+		test.nb_iterations = 2000;
+		memset(test.failed, 0, sizeof(test.failed));
+
+		ThreadPool pool(nb_threads);
+		double start = GetTimeMs();
+		pool.Run(RunConcurrentTest, &test, nb_threads);
+		double time = GetTimeMs() - start;
+
+		bool passed = true;
+		for (unsigned int i = 0; i < nb_threads; i++)
+			passed &= !test.failed[i];
+		all_passed &= passed;
+
+		double rate = nb_threads * test.nb_iterations / (time / 1000.0);
+		if (nb_threads == 1)
+			single_thread_rate = rate;
+		printf("CONCURRENT %2d THREADS: %.0f round trips/s (%.2fx)%s\n", nb_threads, rate, rate / single_thread_rate, passed ? "" : " MISMATCH");
+	}
+
+	if (all_passed)
+		printf("CONCURRENT PASS!\n");
+	else
+		printf("CONCURRENT FAIL!\n");
+}
@@ -0,0 +1,212 @@
+
+//
+// ===============================================================================
+// clReflect
+// -------------------------------------------------------------------------------
+// Copyright (c) 2011-2012 Don Williamson & clReflect Authors (see AUTHORS file)
+// Released under MIT License (see LICENSE file)
+// ===============================================================================
+//
+
+#include <clcpp/clcpp.h>
+#include <clutl/Serialise.h>
+#include <clutl/StdContainers.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "Timer.h"
+
+
+clcpp_reflect(msgpacktest)
+namespace msgpacktest
+{
+	enum Shape
+	{
+		SHAPE_NONE,
+		SHAPE_CIRCLE,
+		SHAPE_BOX,
+	};
+
+	struct Point
+	{
+		float x, y;
+	};
+
+	struct Base
+	{
+		int id;
+	};
+
+	struct Record : public Base
+	{
+		Shape shape;
+		Point origin;
+		int samples[4];
+		double weight;
+		bool visible;
+		short offset;
+		unsigned long long big;
+		std::string name;
+		std::vector<float> path;
+		std::map<int, float> weights;
+
+		clcpp_attr(transient)
+		int cached;
+	};
+
+	// Only uses what versioned binary supports so that all three formats can be compared
+	struct Sample
+	{
+		int id;
+		unsigned int flags;
+		float x, y, z;
+		double time;
+		Shape shape;
+	};
+}
+
+
+clutl_std_vector(float)
+clutl_std_string()
+clutl_std_map(int, float)
+
+
+namespace
+{
+	bool Equals(const msgpacktest::Record& a, const msgpacktest::Record& b)
+	{
+		bool equal = a.id == b.id && a.shape == b.shape && a.origin.x == b.origin.x && a.origin.y == b.origin.y &&
+			a.weight == b.weight && a.visible == b.visible && a.offset == b.offset && a.big == b.big &&
+			a.name == b.name && a.path == b.path && a.weights == b.weights;
+		for (int i = 0; i < 4; i++)
+			equal &= a.samples[i] == b.samples[i];
+		return equal;
+	}
+
+
+	bool Equals(const msgpacktest::Sample& a, const msgpacktest::Sample& b)
+	{
+		return a.id == b.id && a.flags == b.flags && a.x == b.x && a.y == b.y && a.z == b.z &&
+			a.time == b.time && a.shape == b.shape;
+	}
+
+
+	void BenchmarkFormat(const char* name, int format, const msgpacktest::Sample* samples, int nb_samples, const clcpp::Type* type)
+	{
+		double start = GetTimeMs();
+		clutl::WriteBuffer write_buffer;
+		for (int i = 0; i < nb_samples; i++)
+		{
+			switch (format)
+			{
+			case 0: clutl::SaveJSON(write_buffer, samples + i, type, 0, clutl::JSONFlags::EMIT_HEX_FLOATS); break;
+			case 1: clutl::SaveVersionedBinary(write_buffer, samples + i, type); break;
+			case 2: clutl::SaveMsgPack(write_buffer, samples + i, type, 0); break;
+			}
+		}
+		double save_time = GetTimeMs() - start;
+
+		start = GetTimeMs();
+		clutl::ReadBuffer read_buffer(write_buffer);
+		msgpacktest::Sample loaded;
+		bool pass = true;
+		for (int i = 0; i < nb_samples; i++)
+		{
+			switch (format)
+			{
+			case 0: pass &= clutl::LoadJSON(read_buffer, &loaded, type).code == clutl::JSONError::NONE; break;
+			case 1: pass &= clutl::LoadVersionedBinary(read_buffer, &loaded, type); break;
+			case 2: pass &= clutl::LoadMsgPack(read_buffer, &loaded, type).code == clutl::MsgPackError::NONE; break;
+			}
+			pass &= Equals(samples[i], loaded);
+		}
+		double load_time = GetTimeMs() - start;
+
+		printf("MSGPACK BENCHMARK %s: %d bytes, save %.2fms, load %.2fms %s\n",
+			name, write_buffer.GetBytesWritten(), save_time, load_time, pass ? "PASS!" : "FAIL!");
+	}
+}
+
+
+void TestSerialiseMsgPack(clcpp::Database& db)
+{
+	const clcpp::Type* record_type = db.GetType(db.GetName("msgpacktest::Record").hash);
+	const clcpp::Type* sample_type = db.GetType(db.GetName("msgpacktest::Sample").hash);
+	if (record_type == 0 || sample_type == 0)
+	{
+		printf("MSGPACK FAIL!\n");
+		return;
+	}
+
+	msgpacktest::Record a;
+	a.id = 42;
+	a.shape = msgpacktest::SHAPE_BOX;
+	a.origin.x = 1.5f;
+	a.origin.y = -2.25f;
+	for (int i = 0; i < 4; i++)
+		a.samples[i] = i * -1000;
+	a.weight = 0.125;
+	a.visible = true;
+	a.offset = -300;
+	a.big = 0x123456789ABCDEFULL;
+	a.name = "a name long enough to need more than a fixstr header";
+	for (int i = 0; i < 20; i++)
+	{
+		a.path.push_back(i * 0.5f);
+		a.weights[i * -70000] = i * 2.0f;
+	}
+	a.cached = 7;
+
+	// Round trip with both field name and field hash keys
+	bool pass = true;
+	unsigned int flags[] = { 0, clutl::MsgPackFlags::HASH_FIELD_KEYS };
+	for (int i = 0; i < 2; i++)
+	{
+		clutl::WriteBuffer write_buffer;
+		clutl::SaveMsgPack(write_buffer, &a, record_type, 0, flags[i]);
+		clutl::ReadBuffer read_buffer(write_buffer);
+		msgpacktest::Record b;
+		b.cached = 0;
+		clutl::MsgPackError error = clutl::LoadMsgPack(read_buffer, &b, record_type);
+		pass &= error.code == clutl::MsgPackError::NONE && read_buffer.GetBytesRemaining() == 0 && Equals(a, b) && b.cached == 0;
+
+		// Truncated data must be reported without reading past the end
+		clutl::ReadBuffer truncated_buffer(write_buffer.GetData(), write_buffer.GetBytesWritten() - 3);
+		msgpacktest::Record c;
+		pass &= clutl::LoadMsgPack(truncated_buffer, &c, record_type).code == clutl::MsgPackError::UNEXPECTED_END_OF_DATA;
+	}
+
+	// Deeply nested arrays must be rejected before they overflow the stack
+	const int nb_nested = 100000;
+	char* nested_data = new char[nb_nested];
+	memset(nested_data, 0x91, nb_nested);
+	clutl::ReadBuffer nested_buffer(nested_data, nb_nested);
+	msgpacktest::Record d;
+	pass &= clutl::LoadMsgPack(nested_buffer, &d, record_type).code == clutl::MsgPackError::NESTING_TOO_DEEP;
+	delete [] nested_data;
+
+	if (pass)
+		printf("MSGPACK PASS!\n");
+	else
+		printf("MSGPACK FAIL!\n");
+
+	// Compare size and speed against the other serialisers
+	const int nb_samples = 100000;
+	msgpacktest::Sample* samples = new msgpacktest::Sample[nb_samples];
+	for (int i = 0; i < nb_samples; i++)
+	{
+		msgpacktest::Sample& s = samples[i];
+		s.id = i;
+		s.flags = i & 0xFF;
+		s.x = i * 0.25f;
+		s.y = -i * 0.5f;
+		s.z = 1.0f;
+		s.time = i / 60.0;
+		s.shape = (msgpacktest::Shape)(i % 3);
+	}
+	BenchmarkFormat("JSON", 0, samples, nb_samples, sample_type);
+	BenchmarkFormat("VERSIONED BINARY", 1, samples, nb_samples, sample_type);
+	BenchmarkFormat("MSGPACK", 2, samples, nb_samples, sample_type);
+	delete [] samples;
+}
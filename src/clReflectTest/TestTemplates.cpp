@@ -42,7 +42,7 @@ namespace TestTemplates
 
 	// Trigger a few warnings
 	template <int INT> struct InvalidIntArgTemplate { };
-	template <typename A, typename B, typename C, typename D, typename E> struct TooManyArgsTemplate { };
+	template <typename A, typename B, typename C, typename D, typename E, typename F, typename G> struct TooManyArgsTemplate { };
 
 
 	struct Fields
@@ -89,6 +89,6 @@ namespace TestTemplates
 
 		NonReflectedTemplate<int> NonReflectedTemplateInt;
 
-		TooManyArgsTemplate<int, int, int, int, int> TooManyArgsTemplateInt;
+		TooManyArgsTemplate<int, int, int, int, int, int, int> TooManyArgsTemplateInt;
 	};
 }
@@ -0,0 +1,34 @@
+//
+// ===============================================================================
+// clReflect, Timer.h - High resolution timer for the performance tests.
+// -------------------------------------------------------------------------------
+// Copyright (c) 2011-2012 Don Williamson & clReflect Authors (see AUTHORS file)
+// Released under MIT License (see LICENSE file)
+// ===============================================================================
+//
+
+#pragma once
+
+
+#include <clcpp/clcpp.h>
+
+#if defined(CLCPP_USING_MSVC)
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+
+
+inline double GetTimeMs()
+{
+#if defined(CLCPP_USING_MSVC)
+	LARGE_INTEGER frequency, counter;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+	return counter.QuadPart * 1000.0 / frequency.QuadPart;
+#else
+	timeval tv;
+	gettimeofday(&tv, 0);
+	return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+#endif
+}
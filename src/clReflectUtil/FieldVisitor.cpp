@@ -53,11 +53,26 @@ namespace
 
 	void VisitContainerFields(clcpp::ReadIterator& reader, const clutl::IFieldVisitor& visitor, clutl::VisitFieldType visit_type)
 	{
-		// Visit each entry in the container - keys are discarded
+		// Visit each entry in the container, including its key if it has one
 		clcpp::Qualifier qualifer(reader.m_ValueIsPtr ? clcpp::Qualifier::POINTER : clcpp::Qualifier::VALUE, false);
+		clcpp::Qualifier key_qualifier(reader.m_KeyIsPtr ? clcpp::Qualifier::POINTER : clcpp::Qualifier::VALUE, true);
+
+		// Step through contiguous values directly
+		if (char* value = reader.m_Span.data)
+		{
+			for (unsigned int i = 0; i < reader.m_Count; i++, value += reader.m_Span.stride)
+				VisitField(value, reader.m_ValueType, qualifer, visitor, visit_type);
+			return;
+		}
+
 		for (unsigned int i = 0; i < reader.m_Count; i++)
 		{
 			clcpp::ContainerKeyValue kv = reader.GetKeyValue();
+
+			// Keys are const as changing them would break the container's ordering
+			if (reader.m_KeyType != 0)
+				VisitField((char*)kv.key, reader.m_KeyType, key_qualifier, visitor, visit_type);
+
 			VisitField((char*)kv.value, reader.m_ValueType, qualifer, visitor, visit_type);
 			reader.MoveNext();
 		}
@@ -143,18 +143,23 @@ namespace
 			return false;
 		}
 
+		// Accumulate directly from the input, two digits per step while they're available
+		const char* start = ctx.PeekChars();
+		const char* end = start + ctx.Remaining();
+		const char* pos = start;
 		uintval = 0;
-		do 
+		while (end - pos >= 2 && isdigit(pos[0]) && isdigit(pos[1]))
 		{
-			// Consume and accumulate the digit
-			ctx.ConsumeChar();
-			uintval = (uintval * 10) + (c - '0');
+			uintval = uintval * 100 + (pos[0] - '0') * 10 + (pos[1] - '0');
+			pos += 2;
+		}
+		if (pos != end && isdigit(*pos))
+			uintval = uintval * 10 + (*pos++ - '0');
+		ctx.ConsumeChars(pos - start);
 
-			// Peek at the next character and leave if its not a digit
-			if (ctx.ReadOverflows(0))
-				return false;
-			c = ctx.PeekChar();
-		} while (isdigit(c));
+		// Integers must be followed by another character
+		if (ctx.ReadOverflows(0))
+			return false;
 
 		return true;
 	}
@@ -349,6 +354,9 @@ clutl::JSONContext::JSONContext(clutl::ReadBuffer& read_buffer)
 	, m_Line(1)
 	, m_LinePosition(0)
 	, m_StackPosition(0xFFFFFFFF)
+	, m_StringAllocator(0)
+	, m_CopyAllStrings(false)
+	, m_PtrFixups(0)
 {
 }
 
@@ -407,10 +415,24 @@ void clutl::JSONContext::SetError(clutl::JSONError::Code code)
 }
 
 
+void clutl::JSONContext::SetStringAllocator(clcpp::IAllocator* allocator, bool copy_all_strings)
+{
+	m_StringAllocator = allocator;
+	m_CopyAllStrings = copy_all_strings;
+}
+
+
+void clutl::JSONContext::SetPtrFixups(clutl::PtrFixups* ptr_fixups)
+{
+	m_PtrFixups = ptr_fixups;
+}
+
+
 void clutl::JSONContext::IncLine()
 {
+	// Called before the newline is consumed, with the new line starting after it
 	m_Line++;
-	m_LinePosition = m_ReadBuffer.GetBytesRead();
+	m_LinePosition = m_ReadBuffer.GetBytesRead() + 1;
 }
 
 
@@ -301,6 +301,42 @@ void clutl::ObjectGroup::Resize(bool increase)
 }
 
 
+clutl::ObjectGroupPtrs::ObjectGroupPtrs(const ObjectGroup* object_group)
+	: m_ObjectGroup(object_group)
+{
+}
+
+
+bool clutl::ObjectGroupPtrs::CanSavePtr(void* ptr, const clcpp::Field* field, const clcpp::Type* type)
+{
+	// Only pointers to named objects can be saved
+	if (type == 0 || type->kind != clcpp::Primitive::KIND_CLASS)
+		return false;
+	if (!(type->AsClass()->flag_attributes & FLAG_ATTR_IS_OBJECT))
+		return false;
+	return ((Object*)ptr)->unique_id != 0;
+}
+
+
+unsigned int clutl::ObjectGroupPtrs::SavePtr(void* ptr)
+{
+	return ((Object*)ptr)->unique_id;
+}
+
+
+void* clutl::ObjectGroupPtrs::LoadPtr(unsigned int hash, const clcpp::Type* type)
+{
+	Object* object = m_ObjectGroup->FindObjectSearchParents(hash);
+	if (object == 0 || object->type == 0 || type == 0)
+		return 0;
+
+	// Don't point fields at objects of an unrelated type
+	if (object->type != type && !object->type->DerivesFrom(type->name.hash))
+		return 0;
+	return object;
+}
+
+
 clutl::ObjectIterator::ObjectIterator(const ObjectGroup* object_group)
 	: m_ObjectGroup(object_group)
 	, m_Position(0)
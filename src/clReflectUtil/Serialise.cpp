@@ -25,10 +25,287 @@
 extern "C" void* CLCPP_CDECL memcpy(void* dst, const void* src, clcpp::size_type size) __THROW __nonnull ((1, 2));
 
 
+#if defined(CLCPP_PLATFORM_WINDOWS)
+
+	// Low-level CRT file descriptor output
+	extern "C" int CLCPP_CDECL _write(int fd, const void* buffer, unsigned int count);
+
+	// Windows virtual memory functions
+	extern "C" __declspec(dllimport) void* __stdcall VirtualAlloc(void* address, clcpp::size_type size, unsigned long allocation_type, unsigned long protect);
+	extern "C" __declspec(dllimport) int __stdcall VirtualFree(void* address, clcpp::size_type size, unsigned long free_type);
+	#define MEM_COMMIT 0x1000
+	#define MEM_RESERVE 0x2000
+	#define MEM_RELEASE 0x8000
+	#define PAGE_NOACCESS 0x01
+	#define PAGE_READONLY 0x02
+	#define PAGE_READWRITE 0x04
+	#define PAGE_WRITECOPY 0x08
+
+	// Windows file mapping functions
+	extern "C" __declspec(dllimport) void* __stdcall CreateFileA(const char* filename, unsigned long access, unsigned long share_mode, void* security, unsigned long creation, unsigned long flags, void* template_file);
+	extern "C" __declspec(dllimport) int __stdcall GetFileSizeEx(void* file, clcpp::int64* size);
+	extern "C" __declspec(dllimport) void* __stdcall CreateFileMappingA(void* file, void* security, unsigned long protect, unsigned long size_high, unsigned long size_low, const char* name);
+	extern "C" __declspec(dllimport) void* __stdcall MapViewOfFile(void* mapping, unsigned long access, unsigned long offset_high, unsigned long offset_low, clcpp::size_type size);
+	extern "C" __declspec(dllimport) int __stdcall UnmapViewOfFile(const void* address);
+	extern "C" __declspec(dllimport) int __stdcall CloseHandle(void* handle);
+	#define GENERIC_READ 0x80000000
+	#define FILE_SHARE_READ 0x01
+	#define OPEN_EXISTING 3
+	#define FILE_ATTRIBUTE_NORMAL 0x80
+	#define FILE_MAP_COPY 0x01
+	#define FILE_MAP_READ 0x04
+	#define INVALID_HANDLE_VALUE ((void*)-1)
+
+#elif defined(CLCPP_PLATFORM_POSIX)
+
+	// POSIX file descriptor output
+	// http://pubs.opengroup.org/onlinepubs/009695399/functions/write.html
+	extern "C" long write(int fd, const void* buffer, clcpp::size_type count);
+
+	// POSIX gathered file descriptor output
+	// http://pubs.opengroup.org/onlinepubs/009695399/functions/writev.html
+	struct iovec
+	{
+		void* iov_base;
+		clcpp::size_type iov_len;
+	};
+	extern "C" long writev(int fd, const iovec* iov, int iovcnt);
+
+	// POSIX memory mapping, with anonymous mappings supported by both Linux and Mac
+	// http://pubs.opengroup.org/onlinepubs/009695399/functions/mmap.html
+	// http://pubs.opengroup.org/onlinepubs/009695399/functions/mprotect.html
+	extern "C" void* mmap(void* address, clcpp::size_type length, int prot, int flags, int fd, long offset);
+	extern "C" int munmap(void* address, clcpp::size_type length);
+	extern "C" int mprotect(void* address, clcpp::size_type length, int prot);
+	#define PROT_NONE 0x0
+	#define PROT_READ 0x1
+	#define PROT_WRITE 0x2
+	#define MAP_PRIVATE 0x02
+	#if defined(__APPLE__)
+		#define MAP_ANONYMOUS 0x1000
+		#define MAP_NORESERVE 0x40
+	#else
+		#define MAP_ANONYMOUS 0x20
+		#define MAP_NORESERVE 0x4000
+	#endif
+	#define MAP_FAILED ((void*)-1)
+
+	// POSIX file access for mapping files
+	// http://pubs.opengroup.org/onlinepubs/009695399/functions/open.html
+	// http://pubs.opengroup.org/onlinepubs/009695399/functions/lseek.html
+	extern "C" int open(const char* path, int flags, ...);
+	extern "C" int close(int fd);
+	extern "C" long lseek(int fd, long offset, int whence);
+	#define O_RDONLY 0
+	#define SEEK_END 2
+
+#endif
+
+
+namespace
+{
+	int WriteFileDescriptor(int fd, const void* data, unsigned int length)
+	{
+	#if defined(CLCPP_PLATFORM_WINDOWS)
+		return _write(fd, data, length);
+	#elif defined(CLCPP_PLATFORM_POSIX)
+		return (int)write(fd, data, length);
+	#endif
+	}
+
+
+	// Virtual memory is reserved and committed in multiples of this, which is a multiple of the
+	// page size on all supported platforms
+	const unsigned int VIRTUAL_GRANULARITY = 64 * 1024;
+
+
+	unsigned int RoundUpToGranularity(unsigned int size)
+	{
+		// Sizes that would wrap are clamped to the largest multiple
+		if (size > 0u - VIRTUAL_GRANULARITY)
+			return 0u - VIRTUAL_GRANULARITY;
+		return (size + VIRTUAL_GRANULARITY - 1) & ~(VIRTUAL_GRANULARITY - 1);
+	}
+
+
+	char* ReserveVirtual(unsigned int size)
+	{
+		// Returns null where virtual memory isn't supported
+	#if defined(CLCPP_PLATFORM_WINDOWS)
+		return (char*)VirtualAlloc(0, size, MEM_RESERVE, PAGE_NOACCESS);
+	#elif defined(CLCPP_PLATFORM_POSIX)
+		void* data = mmap(0, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		return data != MAP_FAILED ? (char*)data : 0;
+	#else
+		return 0;
+	#endif
+	}
+
+
+	bool CommitVirtual(char* data, unsigned int size)
+	{
+	#if defined(CLCPP_PLATFORM_WINDOWS)
+		return VirtualAlloc(data, size, MEM_COMMIT, PAGE_READWRITE) != 0;
+	#elif defined(CLCPP_PLATFORM_POSIX)
+		return mprotect(data, size, PROT_READ | PROT_WRITE) == 0;
+	#else
+		return false;
+	#endif
+	}
+
+
+	void ReleaseVirtual(char* data, unsigned int size)
+	{
+	#if defined(CLCPP_PLATFORM_WINDOWS)
+		VirtualFree(data, 0, MEM_RELEASE);
+	#elif defined(CLCPP_PLATFORM_POSIX)
+		munmap(data, size);
+	#endif
+	}
+
+
+	// Empty files can't be mapped so are given this instead
+	const char EMPTY_FILE_DATA[1] = { 0 };
+
+
+	const char* MapFile(const char* filename, unsigned int& size, bool copy_on_write)
+	{
+		// The mapping remains after the file is closed, until it's unmapped
+	#if defined(CLCPP_PLATFORM_WINDOWS)
+		void* file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+		if (file == INVALID_HANDLE_VALUE)
+			return 0;
+
+		const char* data = 0;
+		clcpp::int64 file_size;
+		if (GetFileSizeEx(file, &file_size) && file_size >= 0 && file_size <= 0xFFFFFFFF)
+		{
+			size = (unsigned int)file_size;
+			if (size == 0)
+			{
+				data = EMPTY_FILE_DATA;
+			}
+			else
+			{
+				void* mapping = CreateFileMappingA(file, 0, copy_on_write ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, 0);
+				if (mapping != 0)
+				{
+					data = (const char*)MapViewOfFile(mapping, copy_on_write ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+					CloseHandle(mapping);
+				}
+			}
+		}
+
+		CloseHandle(file);
+		return data;
+
+	#elif defined(CLCPP_PLATFORM_POSIX)
+		int fd = open(filename, O_RDONLY);
+		if (fd < 0)
+			return 0;
+
+		const char* data = 0;
+		long file_size = lseek(fd, 0, SEEK_END);
+		if (file_size >= 0 && (clcpp::uint64)file_size <= 0xFFFFFFFF)
+		{
+			size = (unsigned int)file_size;
+			if (size == 0)
+			{
+				data = EMPTY_FILE_DATA;
+			}
+			else
+			{
+				// Private mappings never write back to the file, so can be writable with it opened read-only
+				void* mapped = mmap(0, size, copy_on_write ? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, fd, 0);
+				if (mapped != MAP_FAILED)
+					data = (const char*)mapped;
+			}
+		}
+
+		close(fd);
+		return data;
+
+	#else
+		return 0;
+	#endif
+	}
+
+
+	void UnmapFile(const char* data, unsigned int size)
+	{
+		if (data == EMPTY_FILE_DATA)
+			return;
+	#if defined(CLCPP_PLATFORM_WINDOWS)
+		UnmapViewOfFile(data);
+	#elif defined(CLCPP_PLATFORM_POSIX)
+		munmap((void*)data, size);
+	#endif
+	}
+}
+
+
+clutl::FileDescriptorSink::FileDescriptorSink(int fd)
+	: m_FD(fd)
+	, m_Error(false)
+{
+}
+
+
+void clutl::FileDescriptorSink::Write(const void* data, unsigned int length)
+{
+	// Writes can complete partially so keep going until all data has been sent
+	const char* data_ptr = (const char*)data;
+	while (length != 0 && !m_Error)
+	{
+		int written = WriteFileDescriptor(m_FD, data_ptr, length);
+		if (written <= 0)
+		{
+			m_Error = true;
+			break;
+		}
+
+		data_ptr += written;
+		length -= written;
+	}
+}
+
+
+clutl::CallbackSink::CallbackSink(Callback callback, void* user_data)
+	: m_Callback(callback)
+	, m_UserData(user_data)
+{
+}
+
+
+void clutl::CallbackSink::Write(const void* data, unsigned int length)
+{
+	m_Callback(data, length, m_UserData);
+}
+
+
+// Header at the start of each segment allocation, followed by its data
+struct clutl::WriteBuffer::Segment
+{
+	Segment* next;
+	unsigned int size;
+	unsigned int capacity;
+};
+
+
 clutl::WriteBuffer::WriteBuffer()
 	: m_Data(0)
 	, m_DataEnd(0)
 	, m_DataWrite(0)
+	, m_Sink(0)
+	, m_SpareData(0)
+	, m_SpareDataEnd(0)
+	, m_BytesFlushed(0)
+	, m_VirtualReserve(0)
+	, m_SegmentAllocator(0)
+	, m_SegmentSize(0)
+	, m_FirstSegment(0)
+	, m_LastSegment(0)
+	, m_FreeSegments(0)
 {
 	// Use a default capacity to prevent Write having to do too much checking
 	unsigned int default_capacity = 32;
@@ -42,6 +319,16 @@ clutl::WriteBuffer::WriteBuffer(unsigned int initial_capacity)
 	: m_Data(0)
 	, m_DataEnd(0)
 	, m_DataWrite(0)
+	, m_Sink(0)
+	, m_SpareData(0)
+	, m_SpareDataEnd(0)
+	, m_BytesFlushed(0)
+	, m_VirtualReserve(0)
+	, m_SegmentAllocator(0)
+	, m_SegmentSize(0)
+	, m_FirstSegment(0)
+	, m_LastSegment(0)
+	, m_FreeSegments(0)
 {
 	// Allocate initial capacity
 	m_Data = new char[initial_capacity];
@@ -50,39 +337,172 @@ clutl::WriteBuffer::WriteBuffer(unsigned int initial_capacity)
 }
 
 
+clutl::WriteBuffer::WriteBuffer(VirtualMemory, unsigned int reserve_size, unsigned int initial_capacity)
+	: m_Data(0)
+	, m_DataEnd(0)
+	, m_DataWrite(0)
+	, m_Sink(0)
+	, m_SpareData(0)
+	, m_SpareDataEnd(0)
+	, m_BytesFlushed(0)
+	, m_VirtualReserve(0)
+	, m_SegmentAllocator(0)
+	, m_SegmentSize(0)
+	, m_FirstSegment(0)
+	, m_LastSegment(0)
+	, m_FreeSegments(0)
+{
+	// Reserve the address space and commit the initial capacity
+	unsigned int reserve = RoundUpToGranularity(reserve_size);
+	unsigned int capacity = RoundUpToGranularity(initial_capacity != 0 ? initial_capacity : 1);
+	if (capacity <= reserve && (m_Data = ReserveVirtual(reserve)) != 0)
+	{
+		if (CommitVirtual(m_Data, capacity))
+		{
+			m_VirtualReserve = reserve;
+			m_DataEnd = m_Data + capacity;
+			m_DataWrite = m_Data;
+			return;
+		}
+		ReleaseVirtual(m_Data, reserve);
+	}
+
+	// Fall back to a heap buffer
+	m_Data = new char[initial_capacity];
+	m_DataEnd = m_Data + initial_capacity;
+	m_DataWrite = m_Data;
+}
+
+
+clutl::WriteBuffer::WriteBuffer(IWriteSink* sink, unsigned int chunk_size, bool double_buffer)
+	: m_Data(0)
+	, m_DataEnd(0)
+	, m_DataWrite(0)
+	, m_Sink(sink)
+	, m_SpareData(0)
+	, m_SpareDataEnd(0)
+	, m_BytesFlushed(0)
+	, m_VirtualReserve(0)
+	, m_SegmentAllocator(0)
+	, m_SegmentSize(0)
+	, m_FirstSegment(0)
+	, m_LastSegment(0)
+	, m_FreeSegments(0)
+{
+	clcpp::internal::Assert(sink != 0 && chunk_size != 0);
+
+	// Allocate the chunk data
+	m_Data = new char[chunk_size];
+	m_DataEnd = m_Data + chunk_size;
+	m_DataWrite = m_Data;
+	if (double_buffer)
+	{
+		m_SpareData = new char[chunk_size];
+		m_SpareDataEnd = m_SpareData + chunk_size;
+	}
+}
+
+
+clutl::WriteBuffer::WriteBuffer(clcpp::IAllocator* allocator, unsigned int segment_size)
+	: m_Data(0)
+	, m_DataEnd(0)
+	, m_DataWrite(0)
+	, m_Sink(0)
+	, m_SpareData(0)
+	, m_SpareDataEnd(0)
+	, m_BytesFlushed(0)
+	, m_VirtualReserve(0)
+	, m_SegmentAllocator(allocator)
+	, m_SegmentSize(segment_size)
+	, m_FirstSegment(0)
+	, m_LastSegment(0)
+	, m_FreeSegments(0)
+{
+	clcpp::internal::Assert(allocator != 0 && segment_size != 0);
+	NextSegment(0);
+}
+
+
 clutl::WriteBuffer::~WriteBuffer()
 {
-	if (m_Data != 0)
-		delete [] m_Data;
+	// Ensure the sink no longer references any chunks before releasing them
+	Flush();
+
+	FreeData();
+	if (m_SpareData != 0)
+		delete [] m_SpareData;
 }
 
 
 void clutl::WriteBuffer::Reset()
 {
+	if (m_SegmentAllocator != 0)
+	{
+		// Keep all segments of the standard size for reuse, starting again with one of them
+		while (m_FirstSegment != 0)
+		{
+			Segment* segment = m_FirstSegment;
+			m_FirstSegment = segment->next;
+			if (segment->capacity == m_SegmentSize)
+			{
+				segment->next = m_FreeSegments;
+				m_FreeSegments = segment;
+			}
+			else
+			{
+				m_SegmentAllocator->Free(segment);
+			}
+		}
+		m_LastSegment = 0;
+		m_BytesFlushed = 0;
+		NextSegment(0);
+	}
+
 	m_DataWrite = m_Data;
 }
 
 
 void* clutl::WriteBuffer::Alloc(unsigned int length)
 {
-	// TODO: On platforms that support virtual memory, copy can be eliminated
+	// Streaming buffers make space by flushing the current chunk
+	if (m_Sink != 0 && m_DataWrite + length > m_DataEnd && m_DataWrite != m_Data)
+		FlushChunk();
+
+	// Segmented buffers always make space by starting a new segment
+	if (m_SegmentAllocator != 0 && m_DataWrite + length > m_DataEnd)
+		NextSegment(length);
+
+	// Streaming buffers only get here when a single allocation is bigger than a chunk
 	if (m_DataWrite + length > m_DataEnd)
 	{
-		// Repeatedly calculate a new capacity of 1.5x until the new data fits
-		unsigned int new_capacity = m_DataEnd - m_Data;
+		// Repeatedly calculate a new capacity of 1.5x until the new data fits (always growing tiny chunks)
+		unsigned int capacity = m_DataEnd - m_Data;
+		unsigned int new_capacity = capacity;
 		unsigned int write_pos = m_DataWrite - m_Data;
 		while (write_pos + length > new_capacity)
-			new_capacity += new_capacity / 2;
-
-		// Allocate the new data and copy over
-		char* new_data = new char[new_capacity];
-		memcpy(new_data, m_Data, m_DataWrite - m_Data);
-		delete [] m_Data;
-
-		// Swap in the new buffer
-		m_Data = new_data;
-		m_DataEnd = m_Data + new_capacity;
-		m_DataWrite = m_Data + write_pos;
+			new_capacity += new_capacity / 2 + 1;
+
+		// Virtual memory buffers commit more of their reserved space in place, with no copy
+		unsigned int commit_capacity = RoundUpToGranularity(new_capacity);
+		if (commit_capacity > m_VirtualReserve)
+			commit_capacity = m_VirtualReserve;
+		if (m_VirtualReserve != 0 && write_pos + length <= commit_capacity && CommitVirtual(m_DataEnd, commit_capacity - capacity))
+		{
+			m_DataEnd = m_Data + commit_capacity;
+		}
+
+		else
+		{
+			// Allocate the new data and copy over, moving virtual memory buffers to the heap
+			char* new_data = new char[new_capacity];
+			memcpy(new_data, m_Data, m_DataWrite - m_Data);
+			FreeData();
+
+			// Swap in the new buffer
+			m_Data = new_data;
+			m_DataEnd = m_Data + new_capacity;
+			m_DataWrite = m_Data + write_pos;
+		}
 	}
 
 	// Advance the write pointer by the desired amount
@@ -124,6 +544,226 @@ void clutl::WriteBuffer::SeekRel(int offset)
 }
 
 
+void clutl::WriteBuffer::Flush()
+{
+	if (m_Sink == 0)
+		return;
+
+	if (m_DataWrite != m_Data)
+		FlushChunk();
+	m_Sink->WaitForWrite();
+}
+
+
+bool clutl::WriteBuffer::WriteSegments(int fd) const
+{
+#if defined(CLCPP_PLATFORM_POSIX)
+	if (m_SegmentAllocator != 0)
+	{
+		const Segment* segment = m_FirstSegment;
+		unsigned int offset = 0;
+		while (true)
+		{
+			// Gather the next batch of segments, starting partway into the first after a partial write
+			iovec iov[64];
+			int nb_iov = 0;
+			unsigned int iov_offset = offset;
+			for (const Segment* i = segment; i != 0 && nb_iov < 64; i = i->next, iov_offset = 0)
+			{
+				unsigned int size = GetSegmentSize(i);
+				if (size > iov_offset)
+				{
+					iov[nb_iov].iov_base = (char*)(i + 1) + iov_offset;
+					iov[nb_iov].iov_len = size - iov_offset;
+					nb_iov++;
+				}
+			}
+			if (nb_iov == 0)
+				return true;
+
+			long written = writev(fd, iov, nb_iov);
+			if (written <= 0)
+				return false;
+
+			// Move past all the data that was written
+			while (written >= (long)(GetSegmentSize(segment) - offset))
+			{
+				written -= GetSegmentSize(segment) - offset;
+				segment = segment->next;
+				offset = 0;
+				if (segment == 0)
+					return true;
+			}
+			offset += written;
+		}
+	}
+#endif
+
+	// Write each segment in turn where there's no gathered output
+	FileDescriptorSink sink(fd);
+	SendSegments(&sink);
+	return !sink.HasError();
+}
+
+
+void clutl::WriteBuffer::SendSegments(IWriteSink* sink) const
+{
+	if (m_SegmentAllocator == 0)
+	{
+		// Other buffers are a single segment
+		if (m_DataWrite != m_Data)
+			sink->Write(m_Data, m_DataWrite - m_Data);
+	}
+	else
+	{
+		for (const Segment* segment = m_FirstSegment; segment != 0; segment = segment->next)
+		{
+			unsigned int size = GetSegmentSize(segment);
+			if (size != 0)
+				sink->Write(segment + 1, size);
+		}
+	}
+
+	sink->WaitForWrite();
+}
+
+
+void clutl::WriteBuffer::FreeData()
+{
+	if (m_SegmentAllocator != 0)
+	{
+		// Both the segments in use and those kept for reuse
+		Segment* lists[2] = { m_FirstSegment, m_FreeSegments };
+		for (int i = 0; i < 2; i++)
+		{
+			while (lists[i] != 0)
+			{
+				Segment* next = lists[i]->next;
+				m_SegmentAllocator->Free(lists[i]);
+				lists[i] = next;
+			}
+		}
+		m_FirstSegment = 0;
+		m_LastSegment = 0;
+		m_FreeSegments = 0;
+		m_Data = 0;
+	}
+	else if (m_VirtualReserve != 0)
+		ReleaseVirtual(m_Data, m_VirtualReserve);
+	else if (m_Data != 0)
+		delete [] m_Data;
+	m_VirtualReserve = 0;
+}
+
+
+void clutl::WriteBuffer::FlushChunk()
+{
+	unsigned int length = m_DataWrite - m_Data;
+	if (m_SpareData != 0)
+	{
+		// Wait for the sink to finish with the spare chunk before handing it the current one
+		m_Sink->WaitForWrite();
+		m_Sink->Write(m_Data, length);
+
+		// Continue writing to the spare chunk while the sink consumes the current one
+		char* data = m_Data;
+		char* data_end = m_DataEnd;
+		m_Data = m_SpareData;
+		m_DataEnd = m_SpareDataEnd;
+		m_SpareData = data;
+		m_SpareDataEnd = data_end;
+	}
+	else
+	{
+		// Only one chunk so it has to be consumed before writing can continue
+		m_Sink->Write(m_Data, length);
+		m_Sink->WaitForWrite();
+	}
+
+	m_BytesFlushed += length;
+	m_DataWrite = m_Data;
+}
+
+
+void clutl::WriteBuffer::NextSegment(unsigned int length)
+{
+	// Complete the current segment
+	if (m_LastSegment != 0)
+	{
+		m_LastSegment->size = m_DataWrite - m_Data;
+		m_BytesFlushed += m_LastSegment->size;
+	}
+
+	// Reuse a segment if the data fits, otherwise allocate one that's big enough
+	Segment* segment;
+	if (length <= m_SegmentSize && m_FreeSegments != 0)
+	{
+		segment = m_FreeSegments;
+		m_FreeSegments = segment->next;
+	}
+	else
+	{
+		unsigned int capacity = length > m_SegmentSize ? length : m_SegmentSize;
+		segment = (Segment*)m_SegmentAllocator->Alloc(sizeof(Segment) + capacity);
+		segment->capacity = capacity;
+	}
+
+	// Add to the end of the list and continue writing there
+	segment->next = 0;
+	segment->size = 0;
+	if (m_LastSegment != 0)
+		m_LastSegment->next = segment;
+	else
+		m_FirstSegment = segment;
+	m_LastSegment = segment;
+	m_Data = (char*)(segment + 1);
+	m_DataEnd = m_Data + segment->capacity;
+	m_DataWrite = m_Data;
+}
+
+
+unsigned int clutl::WriteBuffer::GetSegmentSize(const Segment* segment) const
+{
+	// The current segment is still being written to
+	return segment == m_LastSegment ? m_DataWrite - m_Data : segment->size;
+}
+
+
+clutl::MappedFile::MappedFile()
+	: m_Data(0)
+	, m_Size(0)
+	, m_Writable(false)
+{
+}
+
+
+clutl::MappedFile::~MappedFile()
+{
+	Close();
+}
+
+
+bool clutl::MappedFile::Open(const char* filename, Mode mode)
+{
+	Close();
+	m_Data = MapFile(filename, m_Size, mode == COPY_ON_WRITE);
+	if (m_Data == 0)
+		m_Size = 0;
+	m_Writable = m_Data != 0 && mode == COPY_ON_WRITE;
+	return m_Data != 0;
+}
+
+
+void clutl::MappedFile::Close()
+{
+	if (m_Data != 0)
+		UnmapFile(m_Data, m_Size);
+	m_Data = 0;
+	m_Size = 0;
+	m_Writable = false;
+}
+
+
 clutl::ReadBuffer::ReadBuffer(const WriteBuffer& write_buffer)
 	: m_Data(write_buffer.GetData())
 	, m_DataEnd(write_buffer.GetData() + write_buffer.GetBytesWritten())
@@ -132,6 +772,22 @@ clutl::ReadBuffer::ReadBuffer(const WriteBuffer& write_buffer)
 }
 
 
+clutl::ReadBuffer::ReadBuffer(const void* data, unsigned int length)
+	: m_Data((const char*)data)
+	, m_DataEnd((const char*)data + length)
+	, m_DataRead((const char*)data)
+{
+}
+
+
+clutl::ReadBuffer::ReadBuffer(const MappedFile& mapped_file)
+	: m_Data(mapped_file.GetData())
+	, m_DataEnd(mapped_file.GetData() + mapped_file.GetSize())
+	, m_DataRead(mapped_file.GetData())
+{
+}
+
+
 void clutl::ReadBuffer::Read(void* data, unsigned int length)
 {
 	// Copy from the buffer and move on length bytes
@@ -153,3 +809,135 @@ void clutl::ReadBuffer::SeekRel(int offset)
 	clcpp::internal::Assert(m_DataRead + offset <= m_DataEnd && "Seek overflow");
 	m_DataRead += offset;
 }
+
+
+namespace
+{
+	struct PtrFixup
+	{
+		void** ptr;
+		unsigned int hash;
+		const clcpp::Type* type;
+	};
+
+
+	struct PtrObject
+	{
+		unsigned int hash;
+		void* object;
+	};
+
+
+	PtrObject* FindPtrObject(const clutl::WriteBuffer& objects, unsigned int hash)
+	{
+		// Returns the matching entry or the empty entry where it should go
+		PtrObject* entries = (PtrObject*)objects.GetData();
+		unsigned int mask = objects.GetBytesWritten() / sizeof(PtrObject) - 1;
+		unsigned int index = (hash * 2654435761U) & mask;
+		while (entries[index].hash != 0 && entries[index].hash != hash)
+			index = (index + 1) & mask;
+		return entries + index;
+	}
+
+
+	void ClearPtrObjects(clutl::WriteBuffer& objects, unsigned int capacity)
+	{
+		objects.Reset();
+		PtrObject* entries = (PtrObject*)objects.Alloc(capacity * sizeof(PtrObject));
+		for (unsigned int i = 0; i < capacity; i++)
+		{
+			entries[i].hash = 0;
+			entries[i].object = 0;
+		}
+	}
+}
+
+
+clutl::PtrFixups::PtrFixups()
+	: m_NbObjects(0)
+{
+}
+
+
+void clutl::PtrFixups::AddPtr(void** ptr, unsigned int hash, const clcpp::Type* type)
+{
+	*ptr = 0;
+	if (hash == 0)
+		return;
+
+	PtrFixup fixup;
+	fixup.ptr = ptr;
+	fixup.hash = hash;
+	fixup.type = type;
+	m_Ptrs.Write(&fixup, sizeof(fixup));
+}
+
+
+void clutl::PtrFixups::AddObject(unsigned int hash, void* object)
+{
+	clcpp::internal::Assert(hash != 0 && "Zero hashes are reserved for null pointers");
+
+	// Keep the table at most half full, re-inserting all entries when it grows
+	unsigned int capacity = m_Objects.GetBytesWritten() / sizeof(PtrObject);
+	if ((m_NbObjects + 1) * 2 > capacity)
+	{
+		WriteBuffer old_objects(capacity * sizeof(PtrObject));
+		old_objects.Write(m_Objects.GetData(), capacity * sizeof(PtrObject));
+		ClearPtrObjects(m_Objects, capacity ? capacity * 2 : 64);
+
+		const PtrObject* old_entries = (const PtrObject*)old_objects.GetData();
+		for (unsigned int i = 0; i < capacity; i++)
+		{
+			if (old_entries[i].hash != 0)
+				*FindPtrObject(m_Objects, old_entries[i].hash) = old_entries[i];
+		}
+	}
+
+	PtrObject* entry = FindPtrObject(m_Objects, hash);
+	if (entry->hash == 0)
+		m_NbObjects++;
+	entry->hash = hash;
+	entry->object = object;
+}
+
+
+unsigned int clutl::PtrFixups::Resolve(IPtrLoad* ptr_load)
+{
+	unsigned int nb_unresolved = 0;
+	const PtrFixup* fixups = (const PtrFixup*)m_Ptrs.GetData();
+	unsigned int nb_fixups = m_Ptrs.GetBytesWritten() / sizeof(PtrFixup);
+	for (unsigned int i = 0; i < nb_fixups; i++)
+	{
+		const PtrFixup& fixup = fixups[i];
+		void* object = FindObject(fixup.hash);
+		if (object == 0 && ptr_load != 0)
+			object = ptr_load->LoadPtr(fixup.hash, fixup.type);
+		*fixup.ptr = object;
+		nb_unresolved += object == 0;
+	}
+
+	m_Ptrs.Reset();
+	return nb_unresolved;
+}
+
+
+void clutl::PtrFixups::Reset()
+{
+	m_Ptrs.Reset();
+	m_Objects.Reset();
+	m_NbObjects = 0;
+}
+
+
+unsigned int clutl::PtrFixups::GetNbPtrs() const
+{
+	return m_Ptrs.GetBytesWritten() / sizeof(PtrFixup);
+}
+
+
+void* clutl::PtrFixups::FindObject(unsigned int hash) const
+{
+	if (m_NbObjects == 0)
+		return 0;
+	return FindPtrObject(m_Objects, hash)->object;
+}
@@ -0,0 +1,627 @@
+//
+// ===============================================================================
+// clReflect
+// -------------------------------------------------------------------------------
+// Copyright (c) 2011-2012 Don Williamson & clReflect Authors (see AUTHORS file)
+// Released under MIT License (see LICENSE file)
+// ===============================================================================
+//
+
+#include "SerialiseInternal.h"
+
+#include <clutl/Serialise.h>
+#include <clcpp/Containers.h>
+
+
+// Standard C library functions, copy and compare bytes
+// http://pubs.opengroup.org/onlinepubs/009695399/functions/memcpy.html
+// http://pubs.opengroup.org/onlinepubs/009695399/functions/memcmp.html
+
+#ifdef __GNUC__
+	#define __THROW	throw ()
+	#define __nonnull(params) __attribute__ ((__nonnull__ params))
+#else
+	#define __THROW
+	#define __nonnull(params)
+#endif
+
+extern "C" void* CLCPP_CDECL memcpy(void* dst, const void* src, clcpp::size_type size) __THROW __nonnull ((1, 2));
+extern "C" int CLCPP_CDECL memcmp(const void* a, const void* b, clcpp::size_type size) __THROW __nonnull ((1, 2));
+
+
+// Varints and type queries shared with the other serialisers
+using namespace clutl::internal;
+
+
+namespace
+{
+	//
+	// A delta describes the fields of a class that differ from a baseline object:
+	//
+	//    keyed:    nb_changed, { name_hash, value }...
+	//    bitmask:  { changed_bits }..., { value }...
+	//
+	// Fields are numbered in class field array order followed by the fields of each base class,
+	// with only fields that can be saved counted. Bitmasks have one bit per field, low bits first,
+	// padded to whole bytes. Name hashes are 32-bit values and counts are variable-length integers.
+	//
+	// Changed values of built-in types and enums are written as they are in memory. Nested classes
+	// are written as deltas against the same field of the baseline, so unchanged nested objects
+	// only cost their empty count or bitmask. Containers that differ in any way are written in full
+	// as their value count followed by each key and value, with classes inside them written as
+	// deltas against nothing, which includes every field. String views are compared by their
+	// characters and written in full as their length followed by the characters.
+	//
+
+	// Largest key that can be loaded into temporary storage
+	const unsigned int MAX_KEY_SIZE = 16;
+
+
+	bool IsDeltaType(const clcpp::Type* type)
+	{
+		switch (type->kind)
+		{
+		case (clcpp::Primitive::KIND_TYPE):
+		case (clcpp::Primitive::KIND_ENUM):
+		case (clcpp::Primitive::KIND_CLASS):
+			return true;
+
+		case (clcpp::Primitive::KIND_TEMPLATE_TYPE):
+			{
+				// Containers of values with keys that can be loaded into temporary storage
+				if (type->ci == 0)
+					return false;
+				const clcpp::TemplateType* template_type = type->AsTemplateType();
+				bool has_key = (type->ci->flags & clcpp::ContainerInfo::HAS_KEY) != 0;
+				for (unsigned int i = 0; i < (has_key ? 2u : 1u); i++)
+				{
+					if (template_type->parameter_types[i] == 0 || template_type->parameter_ptrs[i])
+						return false;
+				}
+				if (has_key)
+				{
+					const clcpp::Type* key_type = template_type->parameter_types[0];
+					if (!IsCharContainer(key_type) && (key_type->kind == clcpp::Primitive::KIND_CLASS ||
+						key_type->kind == clcpp::Primitive::KIND_TEMPLATE_TYPE || key_type->size > MAX_KEY_SIZE))
+						return false;
+				}
+				return IsDeltaType(template_type->parameter_types[has_key ? 1 : 0]);
+			}
+
+		default:
+			return false;
+		}
+	}
+
+
+	bool IsDeltaField(const clcpp::Field* field)
+	{
+		// Pointers can't be compared by value
+		return !(field->flag_attributes & clcpp::FlagAttribute::TRANSIENT) &&
+			field->qualifier.op == clcpp::Qualifier::VALUE && IsDeltaType(field->type);
+	}
+
+
+	unsigned int CountDeltaFields(const clcpp::Type* type)
+	{
+		unsigned int nb_fields = 0;
+		if (type->kind == clcpp::Primitive::KIND_CLASS)
+		{
+			const clcpp::CArray<const clcpp::Field*>& fields = type->AsClass()->fields;
+			for (unsigned int i = 0; i < fields.size; i++)
+				nb_fields += IsDeltaField(fields[i]);
+		}
+
+		for (unsigned int i = 0; i < type->base_types.size; i++)
+			nb_fields += CountDeltaFields(type->base_types[i]);
+
+		return nb_fields;
+	}
+
+
+	const clcpp::Field* FindDeltaField(const clcpp::Type* type, unsigned int hash)
+	{
+		if (type->kind == clcpp::Primitive::KIND_CLASS)
+		{
+			const clcpp::Field* field = clcpp::FindPrimitive(type->AsClass()->fields, hash);
+			if (field != 0)
+				return IsDeltaField(field) ? field : 0;
+		}
+
+		for (unsigned int i = 0; i < type->base_types.size; i++)
+		{
+			if (const clcpp::Field* field = FindDeltaField(type->base_types[i], hash))
+				return field;
+		}
+
+		return 0;
+	}
+
+
+	// ----------------------------------------------------------------------------------------------------
+	// Comparison
+	// ----------------------------------------------------------------------------------------------------
+
+
+	bool Equals(const char* a, const char* b, const clcpp::Type* type, unsigned int count);
+
+
+	bool StringViewEquals(const char* a, const char* b)
+	{
+		const clutl::StringView& view_a = *(const clutl::StringView*)a;
+		const clutl::StringView& view_b = *(const clutl::StringView*)b;
+		return view_a.length == view_b.length && (view_a.length == 0 || memcmp(view_a.data, view_b.data, view_a.length) == 0);
+	}
+
+
+	bool ClassEquals(const char* a, const char* b, const clcpp::Type* type)
+	{
+		if (type->kind == clcpp::Primitive::KIND_CLASS)
+		{
+			const clcpp::CArray<const clcpp::Field*>& fields = type->AsClass()->fields;
+			for (unsigned int i = 0; i < fields.size; i++)
+			{
+				const clcpp::Field* field = fields[i];
+				if (IsDeltaField(field) && !Equals(a + field->offset, b + field->offset, field->type, GetFieldCount(field)))
+					return false;
+			}
+		}
+
+		for (unsigned int i = 0; i < type->base_types.size; i++)
+		{
+			if (!ClassEquals(a, b, type->base_types[i]))
+				return false;
+		}
+
+		return true;
+	}
+
+
+	bool ContainerEquals(const char* a, const char* b, const clcpp::TemplateType* type)
+	{
+		clcpp::ReadIterator reader_a(type, a);
+		clcpp::ReadIterator reader_b(type, b);
+		if (reader_a.m_Count != reader_b.m_Count)
+			return false;
+
+		// Contiguous values that are trivially copyable are compared in one go
+		const clcpp::Type* value_type = reader_a.m_ValueType;
+		if (reader_a.m_KeyType == 0 && reader_a.m_Span.data != 0 && reader_b.m_Span.data != 0 &&
+			reader_a.m_Span.stride == value_type->size && reader_b.m_Span.stride == value_type->size && IsMemoryImage(value_type))
+			return memcmp(reader_a.m_Span.data, reader_b.m_Span.data, reader_a.m_Count * value_type->size) == 0;
+
+		// Keyed containers that hold the same values in a different order are treated as changed
+		for (unsigned int i = 0; i < reader_a.m_Count; i++, reader_a.MoveNext(), reader_b.MoveNext())
+		{
+			clcpp::ContainerKeyValue kv_a = reader_a.GetKeyValue();
+			clcpp::ContainerKeyValue kv_b = reader_b.GetKeyValue();
+			if (reader_a.m_KeyType != 0 && !Equals((const char*)kv_a.key, (const char*)kv_b.key, reader_a.m_KeyType, 1))
+				return false;
+			if (!Equals((const char*)kv_a.value, (const char*)kv_b.value, value_type, 1))
+				return false;
+		}
+
+		return true;
+	}
+
+
+	bool Equals(const char* a, const char* b, const clcpp::Type* type, unsigned int count)
+	{
+		if (IsMemoryImage(type))
+			return memcmp(a, b, type->size * count) == 0;
+
+		bool is_string_view = IsStringView(type);
+		for (unsigned int i = 0; i < count; i++, a += type->size, b += type->size)
+		{
+			if (is_string_view)
+			{
+				if (!StringViewEquals(a, b))
+					return false;
+			}
+			else if (type->kind == clcpp::Primitive::KIND_CLASS)
+			{
+				if (!ClassEquals(a, b, type))
+					return false;
+			}
+			else if (!ContainerEquals(a, b, type->AsTemplateType()))
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+
+	// ----------------------------------------------------------------------------------------------------
+	// Saving
+	// ----------------------------------------------------------------------------------------------------
+
+
+	// A field that differs from the baseline and its index within the bitmask
+	struct ChangedField
+	{
+		const clcpp::Field* field;
+		unsigned int index;
+	};
+
+
+	void SaveValue(clutl::WriteBuffer& out, const char* object, const char* baseline, const clcpp::Type* type, unsigned int count, unsigned int flags, clutl::WriteBuffer& changed);
+
+
+	void FindChangedFields(clutl::WriteBuffer& changed, const char* object, const char* baseline, const clcpp::Type* type, unsigned int& nb_fields)
+	{
+		if (type->kind == clcpp::Primitive::KIND_CLASS)
+		{
+			const clcpp::CArray<const clcpp::Field*>& fields = type->AsClass()->fields;
+			for (unsigned int i = 0; i < fields.size; i++)
+			{
+				const clcpp::Field* field = fields[i];
+				if (!IsDeltaField(field))
+					continue;
+				unsigned int index = nb_fields++;
+
+				// Without a baseline every field has changed
+				if (baseline != 0 && Equals(object + field->offset, baseline + field->offset, field->type, GetFieldCount(field)))
+					continue;
+				ChangedField changed_field = { field, index };
+				changed.Write(&changed_field, sizeof(changed_field));
+			}
+		}
+
+		for (unsigned int i = 0; i < type->base_types.size; i++)
+			FindChangedFields(changed, object, baseline, type->base_types[i], nb_fields);
+	}
+
+
+	void SaveClassDelta(clutl::WriteBuffer& out, const char* object, const char* baseline, const clcpp::Type* type, unsigned int flags, clutl::WriteBuffer& changed)
+	{
+		// Trivially copyable objects that haven't changed are caught before visiting each field
+		if (baseline != 0 && IsMemoryImage(type) && memcmp(object, baseline, type->size) == 0)
+			baseline = object;
+
+		// Changed fields are found before anything is written so that the delta can be written front to back.
+		// Nested deltas gather their own changed fields after these and remove them once written.
+		unsigned int first_changed = changed.GetBytesWritten();
+		unsigned int nb_fields = 0;
+		if (baseline != object)
+			FindChangedFields(changed, object, baseline, type, nb_fields);
+		unsigned int nb_changed = (changed.GetBytesWritten() - first_changed) / sizeof(ChangedField);
+
+		if (flags & clutl::DeltaFlags::FIELD_BITMASKS)
+		{
+			// Changed fields are found in index order so each byte of the bitmask takes the next few
+			const ChangedField* changed_fields = (const ChangedField*)(changed.GetData() + first_changed);
+			unsigned int nb_bytes = (CountDeltaFields(type) + 7) / 8;
+			for (unsigned int i = 0, j = 0; i < nb_bytes; i++)
+			{
+				unsigned char bits = 0;
+				for (; j < nb_changed && (changed_fields[j].index >> 3) == i; j++)
+					bits |= (unsigned char)(1 << (changed_fields[j].index & 7));
+				out.Write(&bits, sizeof(bits));
+			}
+		}
+		else
+		{
+			WriteVarint(out, nb_changed);
+		}
+
+		for (unsigned int i = 0; i < nb_changed; i++)
+		{
+			// Nested deltas may have moved the changed fields
+			ChangedField changed_field = ((const ChangedField*)(changed.GetData() + first_changed))[i];
+			const clcpp::Field* field = changed_field.field;
+			if (!(flags & clutl::DeltaFlags::FIELD_BITMASKS))
+				out.Write(&field->name.hash, sizeof(field->name.hash));
+			SaveValue(out, object + field->offset, baseline ? baseline + field->offset : 0, field->type, GetFieldCount(field), flags, changed);
+		}
+
+		changed.SeekRel(first_changed - changed.GetBytesWritten());
+	}
+
+
+	void SaveStringView(clutl::WriteBuffer& out, const char* object)
+	{
+		const clutl::StringView& view = *(const clutl::StringView*)object;
+		WriteVarint(out, view.length);
+		if (view.length != 0)
+			out.Write(view.data, view.length);
+	}
+
+
+	void SaveContainer(clutl::WriteBuffer& out, const char* object, const clcpp::TemplateType* type, unsigned int flags, clutl::WriteBuffer& changed)
+	{
+		clcpp::ReadIterator reader(type, object);
+		WriteVarint(out, reader.m_Count);
+
+		// Trivially copyable contiguous values are written in one go
+		const clcpp::Type* value_type = reader.m_ValueType;
+		if (reader.m_KeyType == 0 && reader.m_Span.data != 0 && reader.m_Span.stride == value_type->size && IsMemoryImage(value_type))
+		{
+			out.Write(reader.m_Span.data, reader.m_Count * value_type->size);
+			return;
+		}
+
+		for (unsigned int i = 0; i < reader.m_Count; i++, reader.MoveNext())
+		{
+			clcpp::ContainerKeyValue kv = reader.GetKeyValue();
+			if (reader.m_KeyType != 0)
+				SaveValue(out, (const char*)kv.key, 0, reader.m_KeyType, 1, flags, changed);
+			SaveValue(out, (const char*)kv.value, 0, value_type, 1, flags, changed);
+		}
+	}
+
+
+	void SaveValue(clutl::WriteBuffer& out, const char* object, const char* baseline, const clcpp::Type* type, unsigned int count, unsigned int flags, clutl::WriteBuffer& changed)
+	{
+		switch (type->kind)
+		{
+		case (clcpp::Primitive::KIND_TYPE):
+		case (clcpp::Primitive::KIND_ENUM):
+			out.Write(object, type->size * count);
+			break;
+
+		case (clcpp::Primitive::KIND_CLASS):
+			for (unsigned int i = 0; i < count; i++)
+			{
+				if (IsStringView(type))
+					SaveStringView(out, object + i * type->size);
+				else
+					SaveClassDelta(out, object + i * type->size, baseline ? baseline + i * type->size : 0, type, flags, changed);
+			}
+			break;
+
+		case (clcpp::Primitive::KIND_TEMPLATE_TYPE):
+			for (unsigned int i = 0; i < count; i++)
+				SaveContainer(out, object + i * type->size, type->AsTemplateType(), flags, changed);
+			break;
+
+		default:
+			clcpp::internal::Assert(false && "Invalid primitive kind for type");
+		}
+	}
+
+
+	// ----------------------------------------------------------------------------------------------------
+	// Applying
+	// ----------------------------------------------------------------------------------------------------
+
+
+	// All apply functions return the end of the data they read, or null if it's invalid. Values are
+	// skipped when there's no object to write them to.
+	const char* ApplyValue(const char* src, const char* end, char* object, const clcpp::Type* type, unsigned int count, unsigned int flags);
+
+
+	const char* ApplyClassFields(const char* src, const char* end, char* object, const clcpp::Type* type, unsigned int flags, const unsigned char* bitmask, unsigned int& index)
+	{
+		if (type->kind == clcpp::Primitive::KIND_CLASS)
+		{
+			const clcpp::CArray<const clcpp::Field*>& fields = type->AsClass()->fields;
+			for (unsigned int i = 0; i < fields.size; i++)
+			{
+				const clcpp::Field* field = fields[i];
+				if (!IsDeltaField(field))
+					continue;
+				if (bitmask[index >> 3] & (1 << (index & 7)))
+				{
+					src = ApplyValue(src, end, object ? object + field->offset : 0, field->type, GetFieldCount(field), flags);
+					if (src == 0)
+						return 0;
+				}
+				index++;
+			}
+		}
+
+		for (unsigned int i = 0; i < type->base_types.size; i++)
+		{
+			if ((src = ApplyClassFields(src, end, object, type->base_types[i], flags, bitmask, index)) == 0)
+				return 0;
+		}
+
+		return src;
+	}
+
+
+	const char* ApplyClassDelta(const char* src, const char* end, char* object, const clcpp::Type* type, unsigned int flags)
+	{
+		if (flags & clutl::DeltaFlags::FIELD_BITMASKS)
+		{
+			unsigned int nb_fields = CountDeltaFields(type);
+			unsigned int bitmask_size = (nb_fields + 7) / 8;
+			if (bitmask_size > (unsigned int)(end - src))
+				return 0;
+			const unsigned char* bitmask = (const unsigned char*)src;
+			unsigned int index = 0;
+			return ApplyClassFields(src + bitmask_size, end, object, type, flags, bitmask, index);
+		}
+
+		// Each changed field is located by name
+		unsigned int nb_changed;
+		if ((src = ReadVarint(src, end, nb_changed)) == 0)
+			return 0;
+		for (unsigned int i = 0; i < nb_changed; i++)
+		{
+			unsigned int hash;
+			if ((unsigned int)(end - src) < sizeof(hash))
+				return 0;
+			memcpy(&hash, src, sizeof(hash));
+			src += sizeof(hash);
+
+			// Fields that can't be found leave the rest of the data unreadable
+			const clcpp::Field* field = FindDeltaField(type, hash);
+			if (field == 0)
+				return 0;
+			src = ApplyValue(src, end, object ? object + field->offset : 0, field->type, GetFieldCount(field), flags);
+			if (src == 0)
+				return 0;
+		}
+
+		return src;
+	}
+
+
+	const char* ApplyStringView(const char* src, const char* end, char* object)
+	{
+		// Views point straight into the delta data
+		unsigned int length;
+		if ((src = ReadVarint(src, end, length)) == 0 || length > (unsigned int)(end - src))
+			return 0;
+		if (object != 0)
+		{
+			clutl::StringView& view = *(clutl::StringView*)object;
+			view.data = length != 0 ? src : 0;
+			view.length = length;
+		}
+		return src + length;
+	}
+
+
+	const char* ApplyContainer(const char* src, const char* end, char* object, const clcpp::TemplateType* type, unsigned int flags)
+	{
+		unsigned int count;
+		if ((src = ReadVarint(src, end, count)) == 0)
+			return 0;
+
+		// Don't allocate more values than the data could possibly hold, assuming at least one byte each
+		if (count > (unsigned int)(end - src))
+			return 0;
+
+		clcpp::WriteIterator writer;
+		if (object != 0)
+		{
+			writer.Initialise(type, object, count);
+			if (!writer.IsInitialised())
+				return 0;
+		}
+
+		// Prefer writing values straight into contiguous memory, skipping those beyond the container's capacity
+		bool has_key = (type->ci->flags & clcpp::ContainerInfo::HAS_KEY) != 0;
+		const clcpp::Type* key_type = has_key ? type->parameter_types[0] : 0;
+		const clcpp::Type* value_type = type->parameter_types[has_key ? 1 : 0];
+		char* values = 0;
+		unsigned int stride = 0;
+		unsigned int nb_values = count;
+		if (object != 0 && !has_key)
+		{
+			if (writer.m_Span.data != 0)
+			{
+				values = writer.m_Span.data;
+				stride = writer.m_Span.stride;
+				nb_values = writer.m_Count < count ? writer.m_Count : count;
+			}
+			else if ((values = (char*)writer.AddEmptyRange(count)) != 0)
+			{
+				stride = value_type->size;
+			}
+		}
+
+		// Trivially copyable values are copied in one go
+		if (values != 0 && stride == value_type->size && IsMemoryImage(value_type))
+		{
+			if (value_type->size != 0 && count > (unsigned int)(end - src) / value_type->size)
+				return 0;
+			memcpy(values, src, nb_values * stride);
+			return src + count * value_type->size;
+		}
+
+		// Aligned storage for any key that isn't a string
+		clcpp::uint64 key_data[MAX_KEY_SIZE / sizeof(clcpp::uint64)];
+		clutl::StringView key_view;
+
+		for (unsigned int i = 0; i < count; i++)
+		{
+			void* key = 0;
+			if (key_type != 0 && IsCharContainer(key_type))
+			{
+				// Strings are given to the container as a view of the data
+				unsigned int length;
+				if ((src = ReadVarint(src, end, length)) == 0 || length > (unsigned int)(end - src))
+					return 0;
+				key_view.data = src;
+				key_view.length = length;
+				src += length;
+				key = &key_view;
+			}
+			else if (key_type != 0)
+			{
+				if (key_type->size > (unsigned int)(end - src))
+					return 0;
+				memcpy(key_data, src, key_type->size);
+				src += key_type->size;
+				key = key_data;
+			}
+
+			char* value = 0;
+			if (object != 0)
+			{
+				if (key != 0)
+					value = (char*)writer.AddEmpty(key);
+				else if (values != 0)
+					value = i < nb_values ? values + i * stride : 0;
+				else
+					value = (char*)writer.AddEmpty();
+			}
+
+			if ((src = ApplyValue(src, end, value, value_type, 1, flags)) == 0)
+				return 0;
+		}
+
+		return src;
+	}
+
+
+	const char* ApplyValue(const char* src, const char* end, char* object, const clcpp::Type* type, unsigned int count, unsigned int flags)
+	{
+		switch (type->kind)
+		{
+		case (clcpp::Primitive::KIND_TYPE):
+		case (clcpp::Primitive::KIND_ENUM):
+			{
+				if (type->size * count > (unsigned int)(end - src))
+					return 0;
+				if (object != 0)
+					memcpy(object, src, type->size * count);
+				return src + type->size * count;
+			}
+
+		case (clcpp::Primitive::KIND_CLASS):
+			for (unsigned int i = 0; src != 0 && i < count; i++)
+			{
+				if (IsStringView(type))
+					src = ApplyStringView(src, end, object ? object + i * type->size : 0);
+				else
+					src = ApplyClassDelta(src, end, object ? object + i * type->size : 0, type, flags);
+			}
+			return src;
+
+		case (clcpp::Primitive::KIND_TEMPLATE_TYPE):
+			for (unsigned int i = 0; src != 0 && i < count; i++)
+				src = ApplyContainer(src, end, object ? object + i * type->size : 0, type->AsTemplateType(), flags);
+			return src;
+
+		default:
+			return 0;
+		}
+	}
+}
+
+
+void clutl::SaveDelta(WriteBuffer& out, const void* object, const void* baseline, const clcpp::Type* type, unsigned int flags)
+{
+	clcpp::internal::Assert(type->kind == clcpp::Primitive::KIND_CLASS && "Deltas can only be saved for classes");
+	WriteBuffer changed;
+	SaveClassDelta(out, (const char*)object, (const char*)baseline, type, flags, changed);
+}
+
+
+bool clutl::ApplyDelta(ReadBuffer& in, void* object, const clcpp::Type* type, unsigned int flags)
+{
+	clcpp::internal::Assert(type->kind == clcpp::Primitive::KIND_CLASS && "Deltas can only be applied to classes");
+
+	// Invalid data leaves nothing after it that can be located
+	const char* data = in.ReadAt(in.GetBytesRead());
+	const char* end = data + in.GetBytesRemaining();
+	const char* data_end = ApplyClassDelta(data, end, (char*)object, type, flags);
+	in.SeekRel((data_end ? data_end : end) - data);
+	return data_end != 0;
+}
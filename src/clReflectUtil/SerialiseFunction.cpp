@@ -133,7 +133,7 @@ void clutl::ParameterObjectCache::DeleteObjects()
 }
 
 
-bool clutl::BuildParameterObjectCache_JSON(clutl::ParameterObjectCache& poc, const clcpp::Function* function, clutl::ReadBuffer& parameter_source)
+bool clutl::BuildParameterObjectCache_JSON(clutl::ParameterObjectCache& poc, const clcpp::Function* function, clutl::ReadBuffer& parameter_source, clutl::IPtrLoad* ptr_load)
 {
 	// Reuse the incoming cache
 	poc.Init(function);
@@ -152,6 +152,9 @@ bool clutl::BuildParameterObjectCache_JSON(clutl::ParameterObjectCache& poc, con
 
 	// Check for parameter opening list
 	JSONContext ctx(parameter_source);
+	PtrFixups ptr_fixups;
+	if (ptr_load != 0)
+		ctx.SetPtrFixups(&ptr_fixups);
 	JSONToken t = LexerNextToken(ctx);
 	if (t.type != JSON_TOKEN_LBRACKET)
 		return false;
@@ -168,9 +171,8 @@ bool clutl::BuildParameterObjectCache_JSON(clutl::ParameterObjectCache& poc, con
 			return false;
 	}
 
-	// TODO: What about patching up pointers?
-
-	return true;
+	// Patch pointers now that all parameters are loaded, failing if any object can't be found
+	return ptr_fixups.Resolve(ptr_load) == 0;
 }
 
 
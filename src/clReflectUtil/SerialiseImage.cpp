@@ -0,0 +1,476 @@
+
+//
+// ===============================================================================
+// clReflect
+// -------------------------------------------------------------------------------
+// Copyright (c) 2011-2012 Don Williamson & clReflect Authors (see AUTHORS file)
+// Released under MIT License (see LICENSE file)
+// ===============================================================================
+//
+
+#include <clutl/Serialise.h>
+
+
+// Standard C library function, copy bytes
+// http://pubs.opengroup.org/onlinepubs/009695399/functions/memcpy.html
+
+#ifdef __GNUC__
+	#define __THROW	throw ()
+	#define __nonnull(params) __attribute__ ((__nonnull__ params))
+#else
+	#define __THROW
+	#define __nonnull(params)
+#endif
+
+extern "C" void* CLCPP_CDECL memcpy(void* dst, const void* src, clcpp::size_type size) __THROW __nonnull ((1, 2));
+
+
+namespace
+{
+	//
+	// An image is laid out in the same way as the memory-mapped reflection database:
+	//
+	//    header, { root }..., { relocation }..., padding, data
+	//
+	// The data is a copy of each object in the graph, aligned to IMAGE_ALIGNMENT. Every non-null
+	// pointer within the data is replaced by the offset of the object it points to from the start
+	// of the image, which can never be zero, and the offset of each of these pointers is listed in
+	// the relocation table. Loading adds the address of the image to each listed pointer.
+	//
+	const unsigned int IMAGE_SIGNATURE = 0x6D696C63;
+	const unsigned int IMAGE_VERSION = 1;
+	const unsigned int IMAGE_ALIGNMENT = 16;
+
+
+	struct ImageHeader
+	{
+		unsigned int signature;
+		unsigned int version;
+		unsigned int pointer_size;
+		unsigned int data_offset;
+		unsigned int data_size;
+		unsigned int nb_objects;
+		unsigned int nb_relocations;
+	};
+
+
+	struct ImageRoot
+	{
+		unsigned int type_hash;
+		unsigned int type_size;
+		unsigned int offset;
+	};
+
+
+	// Source objects that have been copied into the image data, keyed by their address
+	struct CopiedObject
+	{
+		const void* object;
+		unsigned int offset;
+		unsigned int size;
+	};
+
+
+	// A copied object whose pointers are yet to be patched
+	struct PendingObject
+	{
+		unsigned int offset;
+		const char* object;
+		const clcpp::Type* type;
+		unsigned int count;
+
+		// The object is an array of count pointers to type
+		bool is_pointer;
+	};
+
+
+	struct SaveContext
+	{
+		clutl::WriteBuffer data;
+		clutl::WriteBuffer relocations;
+		clutl::WriteBuffer pending;
+
+		// Open-addressed hash table with a power of two capacity, grown when half full
+		clutl::WriteBuffer copies;
+		unsigned int nb_copies;
+
+		// Name hash of the clcpp::CArray template
+		unsigned int carray_hash;
+
+		// Set when an object that can't be saved is reached
+		bool failed;
+	};
+
+
+	unsigned int AlignOffset(unsigned int offset, unsigned int alignment)
+	{
+		return (offset + alignment - 1) & ~(alignment - 1);
+	}
+
+
+	void ZeroBytes(char* data, unsigned int size)
+	{
+		for (unsigned int i = 0; i < size; i++)
+			data[i] = 0;
+	}
+
+
+	unsigned int HashAddress(const void* object)
+	{
+		// Fibonacci hashing of the address, dropping the low bits that alignment leaves empty
+		clcpp::uint64 address = (clcpp::pointer_type)object;
+		return (unsigned int)((address >> 3) ^ (address >> 32)) * 2654435761U;
+	}
+
+
+	CopiedObject* FindCopy(SaveContext& ctx, const void* object)
+	{
+		// Returns the matching entry or the empty entry where it should go
+		CopiedObject* copies = (CopiedObject*)ctx.copies.GetData();
+		unsigned int mask = ctx.copies.GetBytesWritten() / sizeof(CopiedObject) - 1;
+		unsigned int index = HashAddress(object) & mask;
+		while (copies[index].object != 0 && copies[index].object != object)
+			index = (index + 1) & mask;
+		return copies + index;
+	}
+
+
+	void GrowCopies(SaveContext& ctx)
+	{
+		// Re-insert all existing entries into a table of twice the size
+		unsigned int capacity = ctx.copies.GetBytesWritten() / sizeof(CopiedObject);
+		clutl::WriteBuffer old_copies(capacity * sizeof(CopiedObject));
+		old_copies.Write(ctx.copies.GetData(), capacity * sizeof(CopiedObject));
+
+		ctx.copies.Reset();
+		CopiedObject* copies = (CopiedObject*)ctx.copies.Alloc(capacity * 2 * sizeof(CopiedObject));
+		ZeroBytes((char*)copies, capacity * 2 * sizeof(CopiedObject));
+
+		const CopiedObject* old = (const CopiedObject*)old_copies.GetData();
+		for (unsigned int i = 0; i < capacity; i++)
+		{
+			if (old[i].object != 0)
+				*FindCopy(ctx, old[i].object) = old[i];
+		}
+	}
+
+
+	unsigned int CopyObject(SaveContext& ctx, const char* object, unsigned int size, const clcpp::Type* type, unsigned int count, bool is_pointer)
+	{
+		// Objects that have already been copied with at least the same size are shared
+		CopiedObject* copy = FindCopy(ctx, object);
+		if (copy->object != 0 && copy->size >= size)
+			return copy->offset;
+
+		unsigned int end = ctx.data.GetBytesWritten();
+		unsigned int offset = AlignOffset(end, IMAGE_ALIGNMENT);
+		char* dest = (char*)ctx.data.Alloc(offset - end + size);
+		ZeroBytes(dest, offset - end);
+		memcpy(dest + offset - end, object, size);
+
+		// Pointers in the copy are patched once the object reaches the front of the queue
+		if (type != 0)
+		{
+			PendingObject pending;
+			pending.offset = offset;
+			pending.object = object;
+			pending.type = type;
+			pending.count = count;
+			pending.is_pointer = is_pointer;
+			ctx.pending.Write(&pending, sizeof(pending));
+		}
+
+		// Record the copy, replacing any smaller copy of the same object
+		if (copy->object == 0)
+		{
+			if (++ctx.nb_copies * 2 > ctx.copies.GetBytesWritten() / sizeof(CopiedObject))
+			{
+				GrowCopies(ctx);
+				copy = FindCopy(ctx, object);
+			}
+		}
+		copy->object = object;
+		copy->offset = offset;
+		copy->size = size;
+		return offset;
+	}
+
+
+	void SetPointer(SaveContext& ctx, unsigned int slot, clcpp::pointer_type value)
+	{
+		// Data may have moved since the slot was located
+		memcpy((char*)ctx.data.GetData() + slot, &value, sizeof(void*));
+	}
+
+
+	void SavePointer(SaveContext& ctx, unsigned int slot, const void* ptr, const clcpp::Type* type)
+	{
+		// Pointers to types with no known size can't be followed and are cleared, along with null pointers
+		if (ptr == 0 || type == 0 || type->size == 0)
+		{
+			SetPointer(ctx, slot, 0);
+			return;
+		}
+
+		// Strings are copied up to and including their null terminator
+		unsigned int offset;
+		if (type->builtin_kind == clcpp::BuiltinKind::CHAR)
+		{
+			const char* str = (const char*)ptr;
+			unsigned int length = 0;
+			while (str[length] != 0)
+				length++;
+			offset = CopyObject(ctx, str, length + 1, 0, 0, false);
+		}
+		else
+		{
+			offset = CopyObject(ctx, (const char*)ptr, type->size, type, 1, false);
+		}
+
+		// Data offsets are made relative to the image once its header size is known
+		SetPointer(ctx, slot, offset);
+		ctx.relocations.Write(&slot, sizeof(slot));
+	}
+
+
+	void PatchObject(SaveContext& ctx, unsigned int offset, const char* object, const clcpp::Type* type);
+
+
+	void PatchField(SaveContext& ctx, unsigned int offset, const char* object, const clcpp::Field* field)
+	{
+		unsigned int count = field->ci ? field->ci->count : 1;
+		bool is_pointer = field->qualifier.op != clcpp::Qualifier::VALUE;
+		unsigned int stride = is_pointer ? sizeof(void*) : field->type->size;
+
+		// Transient fields aren't saved so are cleared in the image
+		if (field->flag_attributes & clcpp::FlagAttribute::TRANSIENT)
+		{
+			ZeroBytes((char*)ctx.data.GetData() + offset, stride * count);
+			return;
+		}
+
+		for (unsigned int i = 0; i < count; i++)
+		{
+			if (is_pointer)
+				SavePointer(ctx, offset + i * stride, *(void* const*)(object + i * stride), field->type);
+			else
+				PatchObject(ctx, offset + i * stride, object + i * stride, field->type);
+		}
+	}
+
+
+	void PatchClass(SaveContext& ctx, unsigned int offset, const char* object, const clcpp::Type* type)
+	{
+		if (type->kind == clcpp::Primitive::KIND_CLASS)
+		{
+			const clcpp::Class* class_type = type->AsClass();
+
+			// String views own no data so their characters are copied alongside them
+			if (class_type->flag_attributes & clutl::FLAG_ATTR_IS_STRING_VIEW)
+			{
+				const clutl::StringView& view = *(const clutl::StringView*)object;
+				unsigned int slot = offset + (unsigned int)((const char*)&view.data - object);
+				if (view.data == 0 || view.length == 0)
+				{
+					SetPointer(ctx, slot, 0);
+					return;
+				}
+				unsigned int data_offset = CopyObject(ctx, view.data, view.length, 0, 0, false);
+				SetPointer(ctx, slot, data_offset);
+				ctx.relocations.Write(&slot, sizeof(slot));
+				return;
+			}
+
+			const clcpp::CArray<const clcpp::Field*>& fields = class_type->fields;
+			for (unsigned int i = 0; i < fields.size; i++)
+			{
+				const clcpp::Field* field = fields[i];
+				PatchField(ctx, offset + field->offset, object + field->offset, field);
+			}
+		}
+
+		// Base types share the same object
+		for (unsigned int i = 0; i < type->base_types.size; i++)
+			PatchClass(ctx, offset, object, type->base_types[i]);
+	}
+
+
+	void PatchCArray(SaveContext& ctx, unsigned int offset, const char* object, const clcpp::TemplateType* type)
+	{
+		// The allocator isn't part of the image and its array can't be freed
+		const clcpp::CArray<char>& carray = *(const clcpp::CArray<char>*)object;
+		unsigned int slot = offset + (unsigned int)((const char*)&carray.data - object);
+		unsigned int allocator_slot = offset + (unsigned int)((const char*)&carray.allocator - object);
+		SetPointer(ctx, allocator_slot, 0);
+
+		const clcpp::Type* value_type = type->parameter_types[0];
+		if (carray.data == 0 || carray.size == 0 || value_type == 0 || value_type->size == 0)
+		{
+			SetPointer(ctx, slot, 0);
+			return;
+		}
+
+		bool is_pointer = type->parameter_ptrs[0];
+		unsigned int data_offset = CopyObject(ctx, carray.data, (is_pointer ? sizeof(void*) : value_type->size) * carray.size, value_type, carray.size, is_pointer);
+		SetPointer(ctx, slot, data_offset);
+		ctx.relocations.Write(&slot, sizeof(slot));
+	}
+
+
+	void PatchObject(SaveContext& ctx, unsigned int offset, const char* object, const clcpp::Type* type)
+	{
+		switch (type->kind)
+		{
+		case (clcpp::Primitive::KIND_CLASS):
+			PatchClass(ctx, offset, object, type);
+			break;
+
+		case (clcpp::Primitive::KIND_TEMPLATE_TYPE):
+			if (type->parent != 0 && type->parent->name.hash == ctx.carray_hash)
+			{
+				PatchCArray(ctx, offset, object, type->AsTemplateType());
+				break;
+			}
+
+			// Other containers own memory that can't be relocated, and all other template instances
+			// have no reflected fields through which their pointers could be patched
+			ctx.failed = true;
+			break;
+
+		default:
+			break;
+		}
+	}
+
+
+	void PatchPending(SaveContext& ctx, const PendingObject& pending)
+	{
+		if (pending.is_pointer)
+		{
+			const void* const* ptrs = (const void* const*)pending.object;
+			for (unsigned int i = 0; i < pending.count; i++)
+				SavePointer(ctx, pending.offset + i * sizeof(void*), ptrs[i], pending.type);
+			return;
+		}
+
+		// Built-in types and enums have nothing to patch
+		if (pending.type->kind != clcpp::Primitive::KIND_CLASS && pending.type->kind != clcpp::Primitive::KIND_TEMPLATE_TYPE)
+			return;
+		for (unsigned int i = 0; i < pending.count; i++)
+			PatchObject(ctx, pending.offset + i * pending.type->size, pending.object + i * pending.type->size, pending.type);
+	}
+
+
+	bool IsInImage(clcpp::pointer_type offset, clcpp::pointer_type size, const ImageHeader& header, unsigned int image_size)
+	{
+		return offset >= header.data_offset && offset <= image_size && size <= image_size - offset;
+	}
+}
+
+
+bool clutl::SaveImage(WriteBuffer& out, const void* const* objects, const clcpp::Type* const* types, unsigned int nb_objects)
+{
+	SaveContext ctx;
+	ctx.nb_copies = 0;
+	ctx.carray_hash = clcpp::internal::HashNameString("clcpp::CArray");
+	ctx.failed = false;
+	ZeroBytes((char*)ctx.copies.Alloc(64 * sizeof(CopiedObject)), 64 * sizeof(CopiedObject));
+
+	// Copy the roots first so that they're patched in order and easily located
+	WriteBuffer roots;
+	for (unsigned int i = 0; i < nb_objects; i++)
+	{
+		clcpp::internal::Assert(objects[i] != 0 && types[i] != 0 && types[i]->size != 0 && "Image objects must have a type with a known size");
+		ImageRoot root;
+		root.type_hash = types[i]->name.hash;
+		root.type_size = types[i]->size;
+		root.offset = CopyObject(ctx, (const char*)objects[i], types[i]->size, types[i], 1, false);
+		roots.Write(&root, sizeof(root));
+	}
+
+	// Breadth-first walk of the graph, copying every object reached through a pointer before it's patched
+	for (unsigned int i = 0; i < ctx.pending.GetBytesWritten() / sizeof(PendingObject) && !ctx.failed; i++)
+	{
+		PendingObject pending = ((const PendingObject*)ctx.pending.GetData())[i];
+		PatchPending(ctx, pending);
+	}
+	if (ctx.failed)
+		return false;
+
+	ImageHeader header;
+	header.signature = IMAGE_SIGNATURE;
+	header.version = IMAGE_VERSION;
+	header.pointer_size = sizeof(void*);
+	header.nb_objects = nb_objects;
+	header.nb_relocations = ctx.relocations.GetBytesWritten() / sizeof(unsigned int);
+	header.data_offset = AlignOffset(sizeof(header) + roots.GetBytesWritten() + ctx.relocations.GetBytesWritten(), IMAGE_ALIGNMENT);
+	header.data_size = ctx.data.GetBytesWritten();
+
+	// Make all offsets relative to the start of the image
+	ImageRoot* image_roots = (ImageRoot*)roots.GetData();
+	for (unsigned int i = 0; i < nb_objects; i++)
+		image_roots[i].offset += header.data_offset;
+	unsigned int* relocations = (unsigned int*)ctx.relocations.GetData();
+	for (unsigned int i = 0; i < header.nb_relocations; i++)
+	{
+		clcpp::pointer_type value;
+		memcpy(&value, ctx.data.GetData() + relocations[i], sizeof(void*));
+		SetPointer(ctx, relocations[i], value + header.data_offset);
+		relocations[i] += header.data_offset;
+	}
+
+	out.Write(&header, sizeof(header));
+	out.Write(roots.GetData(), roots.GetBytesWritten());
+	out.Write(ctx.relocations.GetData(), ctx.relocations.GetBytesWritten());
+	char padding[IMAGE_ALIGNMENT] = { 0 };
+	out.Write(padding, header.data_offset - (sizeof(header) + roots.GetBytesWritten() + ctx.relocations.GetBytesWritten()));
+	out.Write(ctx.data.GetData(), ctx.data.GetBytesWritten());
+	return true;
+}
+
+
+bool clutl::LoadImage(void* image, unsigned int size, void** objects, const clcpp::Type* const* types, unsigned int nb_objects)
+{
+	// The image must be aligned as it was saved for its objects to be aligned
+	char* base = (char*)image;
+	if (((clcpp::pointer_type)base & (IMAGE_ALIGNMENT - 1)) != 0 || size < sizeof(ImageHeader))
+		return false;
+
+	ImageHeader header;
+	memcpy(&header, base, sizeof(header));
+	if (header.signature != IMAGE_SIGNATURE || header.version != IMAGE_VERSION || header.pointer_size != sizeof(void*))
+		return false;
+	if (header.nb_objects != nb_objects || header.data_offset > size || header.data_size != size - header.data_offset)
+		return false;
+	clcpp::uint64 tables_size = (clcpp::uint64)nb_objects * sizeof(ImageRoot) + (clcpp::uint64)header.nb_relocations * sizeof(unsigned int);
+	if (sizeof(header) + tables_size > header.data_offset)
+		return false;
+
+	// Roots must be the requested types
+	const ImageRoot* roots = (const ImageRoot*)(base + sizeof(header));
+	for (unsigned int i = 0; i < nb_objects; i++)
+	{
+		if (roots[i].type_hash != types[i]->name.hash || roots[i].type_size != types[i]->size ||
+			!IsInImage(roots[i].offset, types[i]->size, header, size) || (roots[i].offset & (IMAGE_ALIGNMENT - 1)) != 0)
+			return false;
+	}
+
+	// Patch every pointer in one pass, checking that it lies within the data and points into it.
+	// A failure leaves the image partially patched.
+	const unsigned int* relocations = (const unsigned int*)(roots + nb_objects);
+	for (unsigned int i = 0; i < header.nb_relocations; i++)
+	{
+		unsigned int slot = relocations[i];
+		if (!IsInImage(slot, sizeof(void*), header, size) || (slot & (sizeof(void*) - 1)) != 0)
+			return false;
+
+		clcpp::pointer_type& ptr = *(clcpp::pointer_type*)(base + slot);
+		if (!IsInImage(ptr, 0, header, size) || ptr == size)
+			return false;
+		ptr += (clcpp::pointer_type)base;
+	}
+
+	for (unsigned int i = 0; i < nb_objects; i++)
+		objects[i] = base + roots[i].offset;
+	return true;
+}
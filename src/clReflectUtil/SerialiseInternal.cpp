@@ -0,0 +1,154 @@
+//
+// ===============================================================================
+// clReflect
+// -------------------------------------------------------------------------------
+// Copyright (c) 2011-2012 Don Williamson & clReflect Authors (see AUTHORS file)
+// Released under MIT License (see LICENSE file)
+// ===============================================================================
+//
+
+#include "SerialiseInternal.h"
+
+
+const unsigned int clutl::internal::g_LoadJSONHash = clcpp::internal::HashNameString("load_json");
+const unsigned int clutl::internal::g_SaveJSONHash = clcpp::internal::HashNameString("save_json");
+const unsigned int clutl::internal::g_PreSaveHash = clcpp::internal::HashNameString("pre_save");
+const unsigned int clutl::internal::g_PostLoadHash = clcpp::internal::HashNameString("post_load");
+
+
+bool clutl::internal::IsStringView(const clcpp::Type* type)
+{
+	return type->kind == clcpp::Primitive::KIND_CLASS &&
+		(type->AsClass()->flag_attributes & clutl::FLAG_ATTR_IS_STRING_VIEW) != 0;
+}
+
+
+bool clutl::internal::IsCharContainer(const clcpp::Type* type)
+{
+	if (type->kind != clcpp::Primitive::KIND_TEMPLATE_TYPE || type->ci == 0 || (type->ci->flags & clcpp::ContainerInfo::HAS_KEY))
+		return false;
+	const clcpp::TemplateType* template_type = type->AsTemplateType();
+	const clcpp::Type* value_type = template_type->parameter_types[0];
+	return value_type != 0 && value_type->builtin_kind == clcpp::BuiltinKind::CHAR && !template_type->parameter_ptrs[0];
+}
+
+
+clutl::internal::KeyFormat clutl::internal::GetKeyFormat(const clcpp::Type* key_type, bool key_is_ptr)
+{
+	if (key_type == 0 || key_is_ptr)
+		return KEY_FORMAT_NONE;
+
+	switch (key_type->kind)
+	{
+	case clcpp::Primitive::KIND_TYPE:
+		// Booleans and decimals don't make sensible keys
+		switch (key_type->builtin_kind)
+		{
+		case clcpp::BuiltinKind::NONE:
+		case clcpp::BuiltinKind::BOOL:
+		case clcpp::BuiltinKind::FLOAT:
+		case clcpp::BuiltinKind::DOUBLE:
+			return KEY_FORMAT_NONE;
+		default:
+			return KEY_FORMAT_INTEGER;
+		}
+
+	case clcpp::Primitive::KIND_ENUM:
+		return KEY_FORMAT_ENUM;
+
+	default:
+		return IsStringView(key_type) || IsCharContainer(key_type) ? KEY_FORMAT_STRING : KEY_FORMAT_NONE;
+	}
+}
+
+
+const clcpp::Field* clutl::internal::FindFieldsRecursive(const clcpp::Type* type, unsigned int hash)
+{
+	// Check fields if this is a class
+	const clcpp::Field* field = 0;
+	if (type->kind == clcpp::Primitive::KIND_CLASS)
+		field = clcpp::FindPrimitive(type->AsClass()->fields, hash);
+
+	if (field == 0)
+	{
+		// Search up through the inheritance hierarchy
+		for (unsigned int i = 0; i < type->base_types.size; i++)
+		{
+			field = FindFieldsRecursive(type->base_types[i], hash);
+			if (field)
+				break;
+		}
+	}
+
+	return field;
+}
+
+
+void clutl::internal::WriteVarint(clutl::WriteBuffer& out, unsigned int value)
+{
+	unsigned char bytes[5];
+	unsigned int nb_bytes = 0;
+	while (value >= 0x80)
+	{
+		bytes[nb_bytes++] = (unsigned char)(value | 0x80);
+		value >>= 7;
+	}
+	bytes[nb_bytes++] = (unsigned char)value;
+	out.Write(bytes, nb_bytes);
+}
+
+
+const char* clutl::internal::ReadVarint(const char* src, const char* end, unsigned int& value)
+{
+	value = 0;
+	for (unsigned int shift = 0; shift < 35 && src < end; shift += 7)
+	{
+		unsigned char byte = (unsigned char)*src++;
+		if (shift == 28 && byte > 0x0F)
+			return 0;
+		value |= (unsigned int)(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0)
+			return src;
+	}
+	return 0;
+}
+
+
+unsigned int clutl::internal::GetFieldCount(const clcpp::Field* field)
+{
+	return field->ci ? field->ci->count : 1;
+}
+
+
+bool clutl::internal::IsMemoryImage(const clcpp::Type* type)
+{
+	switch (type->kind)
+	{
+	case (clcpp::Primitive::KIND_TYPE):
+		return true;
+
+	case (clcpp::Primitive::KIND_ENUM):
+		return type->size == sizeof(int);
+
+	case (clcpp::Primitive::KIND_CLASS):
+		{
+			// Fingerprinted classes only have value fields of built-in, enum or similar class types,
+			// leaving padding as the only difference between their saved data and their memory
+			const clcpp::Class* class_type = type->AsClass();
+			if (class_type->layout_fingerprint == 0)
+				return false;
+			unsigned int size = 0;
+			for (unsigned int i = 0; i < class_type->fields.size; i++)
+			{
+				const clcpp::Field* field = class_type->fields[i];
+				if (!IsMemoryImage(field->type))
+					return false;
+				size += field->type->size * GetFieldCount(field);
+			}
+			return size == class_type->size;
+		}
+
+	default:
+		return false;
+	}
+}
@@ -0,0 +1,65 @@
+//
+// ===============================================================================
+// clReflect, SerialiseInternal.h - Type queries shared by the serialisers.
+// -------------------------------------------------------------------------------
+// Copyright (c) 2011-2012 Don Williamson & clReflect Authors (see AUTHORS file)
+// Released under MIT License (see LICENSE file)
+// ===============================================================================
+//
+
+#pragma once
+
+
+#include <clutl/Serialise.h>
+
+
+namespace clutl
+{
+	namespace internal
+	{
+		// Hashes of the attributes naming custom load/save functions. These are computed during static
+		// initialisation, rather than on first use, so that no serialiser state is written while multiple
+		// threads may be loading or saving.
+		extern const unsigned int g_LoadJSONHash;
+		extern const unsigned int g_SaveJSONHash;
+		extern const unsigned int g_PreSaveHash;
+		extern const unsigned int g_PostLoadHash;
+
+
+		// Is this a class marked with the StringView custom flag?
+		bool IsStringView(const clcpp::Type* type);
+
+		// Unkeyed containers of char, such as std::string, are saved as strings
+		bool IsCharContainer(const clcpp::Type* type);
+
+
+		// How keys of keyed containers are written as map keys, with all other containers saved as
+		// arrays of values
+		enum KeyFormat
+		{
+			KEY_FORMAT_NONE,
+			KEY_FORMAT_INTEGER,
+			KEY_FORMAT_ENUM,
+			KEY_FORMAT_STRING,
+		};
+
+		KeyFormat GetKeyFormat(const clcpp::Type* key_type, bool key_is_ptr);
+
+
+		// Find a field by name hash in a class or any of its base classes
+		const clcpp::Field* FindFieldsRecursive(const clcpp::Type* type, unsigned int hash);
+
+
+		// Unsigned integers written 7 bits at a time, low bits first, with the top bit set on all but
+		// the last byte. Reading returns null if the data ends early or the value doesn't fit in 32 bits.
+		void WriteVarint(clutl::WriteBuffer& out, unsigned int value);
+		const char* ReadVarint(const char* src, const char* end, unsigned int& value);
+
+		// Number of elements in a field, which is more than one for C-arrays
+		unsigned int GetFieldCount(const clcpp::Field* field);
+
+		// Is the memory of this type exactly its field data, with no padding, pointers or containers,
+		// so that it can be saved, copied and compared as a whole?
+		bool IsMemoryImage(const clcpp::Type* type);
+	}
+}
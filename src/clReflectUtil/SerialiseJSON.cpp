@@ -9,11 +9,12 @@
 //
 // TODO:
 //    * Allow names to be specified as CRCs?
-//    * Escape sequences need converting.
 //    * Enums communicated by value (load integer checks for enum - could have a verify mode to ensure the constant exists).
 //    * Field names need to be in memory for JSON serialising to work.
 //
 
+#include "SerialiseInternal.h"
+
 #include <clutl/Serialise.h>
 #include <clutl/JSONLexer.h>
 #include <clcpp/Containers.h>
@@ -30,13 +31,14 @@
 #endif
 
 
-static void SetupTypeDispatchLUT();
+// Attribute hashes and type queries shared with the other serialisers
+using namespace clutl::internal;
 
 
 namespace
 {
 	// ----------------------------------------------------------------------------------------------------
-	// Perfect hash based load/save function dispatching
+	// Load/save function dispatching for built-in types
 	// ----------------------------------------------------------------------------------------------------
 
 
@@ -47,48 +49,21 @@ namespace
 
 	struct TypeDispatch
 	{
-		TypeDispatch()
-			: valid(false)
-			, save_number(0)
-			, load_integer(0)
-			, load_decimal(0)
-		{
-		}
-
-		bool valid;
 		SaveNumberFunc save_number;
 		LoadIntegerFunc load_integer;
 		LoadDecimalFunc load_decimal;
 	};
 
 
-	// A save function lookup table for all supported C++ types
-	static const int g_TypeDispatchMod = 47;
-	TypeDispatch g_TypeDispatchLUT[g_TypeDispatchMod];
-	bool g_TypeDispatchLUTReady = false;
+	// Functions for each built-in type, indexed by the builtin_kind the exporter assigns to it.
+	// Defined at the end of the file, after all the functions it references.
+	extern const TypeDispatch g_TypeDispatchLUT[clcpp::BuiltinKind::COUNT];
 
 
-	// For the given data set of basic type name hashes, this combines to make
-	// a perfect hash function with no collisions, allowing quick indexed lookup.
-	unsigned int GetTypeDispatchIndex(unsigned int hash)
+	const TypeDispatch& GetTypeDispatch(const clcpp::Type* type)
 	{
-		return hash % g_TypeDispatchMod;
-	}
-	unsigned int GetTypeDispatchIndex(const char* type_name)
-	{
-		return GetTypeDispatchIndex(clcpp::internal::HashNameString(type_name));
-	}
-
-
-	void AddTypeDispatch(const char* type_name, SaveNumberFunc save_func, LoadIntegerFunc loadi_func, LoadDecimalFunc loadd_func)
-	{
-		// Ensure there are no collisions before adding the functions
-		unsigned index = GetTypeDispatchIndex(type_name);
-		clcpp::internal::Assert(g_TypeDispatchLUT[index].valid == false && "Lookup table index collision");
-		g_TypeDispatchLUT[index].valid = true;
-		g_TypeDispatchLUT[index].save_number = save_func;
-		g_TypeDispatchLUT[index].load_integer = loadi_func;
-		g_TypeDispatchLUT[index].load_decimal = loadd_func;
+		clcpp::internal::Assert(type->builtin_kind < clcpp::BuiltinKind::COUNT && "Index is out of range");
+		return g_TypeDispatchLUT[type->builtin_kind];
 	}
 
 
@@ -117,14 +92,188 @@ namespace
 	}
 
 
-	void ParserString(const clutl::JSONToken& t, char* object, const clcpp::Type* type)
+	unsigned int ParseHexDigits(const char* digits)
+	{
+		// The lexer has already verified there are 4 valid digits
+		unsigned int value = 0;
+		for (int i = 0; i < 4; i++)
+		{
+			char c = digits[i];
+			value = value * 16 + (c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10);
+		}
+		return value;
+	}
+
+
+	unsigned int EncodeUTF8(char* dest, unsigned int code_point)
+	{
+		if (code_point < 0x80)
+		{
+			dest[0] = (char)code_point;
+			return 1;
+		}
+		if (code_point < 0x800)
+		{
+			dest[0] = (char)(0xC0 | (code_point >> 6));
+			dest[1] = (char)(0x80 | (code_point & 0x3F));
+			return 2;
+		}
+		if (code_point < 0x10000)
+		{
+			dest[0] = (char)(0xE0 | (code_point >> 12));
+			dest[1] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+			dest[2] = (char)(0x80 | (code_point & 0x3F));
+			return 3;
+		}
+		dest[0] = (char)(0xF0 | (code_point >> 18));
+		dest[1] = (char)(0x80 | ((code_point >> 12) & 0x3F));
+		dest[2] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+		dest[3] = (char)(0x80 | (code_point & 0x3F));
+		return 4;
+	}
+
+
+	unsigned int DecodeString(char* dest, const char* src, unsigned int length)
+	{
+		// Escape sequences have been validated by the lexer and never decode to more bytes than they occupy
+		char* pos = dest;
+		const char* end = src + length;
+		while (src != end)
+		{
+			char c = *src++;
+			if (c != '\\')
+			{
+				*pos++ = c;
+				continue;
+			}
+
+			c = *src++;
+			switch (c)
+			{
+			case 'b': *pos++ = '\b'; break;
+			case 'f': *pos++ = '\f'; break;
+			case 'n': *pos++ = '\n'; break;
+			case 'r': *pos++ = '\r'; break;
+			case 't': *pos++ = '\t'; break;
+
+			case 'u':
+			{
+				unsigned int code_point = ParseHexDigits(src);
+				src += 4;
+
+				// Combine UTF-16 surrogate pairs into one code point
+				if (code_point >= 0xD800 && code_point < 0xDC00 && end - src >= 6 && src[0] == '\\' && src[1] == 'u')
+				{
+					unsigned int low = ParseHexDigits(src + 2);
+					if (low >= 0xDC00 && low < 0xE000)
+					{
+						code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+						src += 6;
+					}
+				}
+
+				pos += EncodeUTF8(pos, code_point);
+				break;
+			}
+
+			// Quotes and slashes
+			default:
+				*pos++ = c;
+				break;
+			}
+		}
+
+		return pos - dest;
+	}
+
+
+	bool HasEscapes(const clutl::JSONToken& t)
+	{
+		for (int i = 0; i < t.length; i++)
+		{
+			if (t.val.string[i] == '\\')
+				return true;
+		}
+		return false;
+	}
+
+
+	void LoadCharContainer(const clutl::JSONToken& t, char* object, const clcpp::TemplateType* type)
+	{
+		// Decode any escape sequences first as the container needs to be sized up-front
+		const char* data = t.val.string;
+		unsigned int length = t.length;
+		clutl::WriteBuffer decoded;
+		if (HasEscapes(t))
+		{
+			char* decoded_data = (char*)decoded.Alloc(length);
+			length = DecodeString(decoded_data, data, length);
+			data = decoded_data;
+		}
+
+		clcpp::WriteIterator writer;
+		writer.Initialise(type, object, length);
+		if (!writer.IsInitialised())
+			return;
+
+		if (char* dest = writer.m_Span.data)
+		{
+			// Contiguous strings can be copied straight into, with no call per character
+			for (unsigned int i = 0; i < length; i++, dest += writer.m_Span.stride)
+				*dest = data[i];
+		}
+		else
+		{
+			for (unsigned int i = 0; i < length; i++)
+				*(char*)writer.AddEmpty() = data[i];
+		}
+	}
+
+
+	void LoadStringView(const clutl::JSONToken& t, clutl::StringView& view, clcpp::IAllocator* allocator, bool copy_all_strings)
+	{
+		bool has_escapes = HasEscapes(t);
+
+		// Point straight into the input if possible
+		if (!has_escapes && !copy_all_strings)
+		{
+			view.data = t.val.string;
+			view.length = t.length;
+			return;
+		}
+
+		// Without an allocator, escaped strings are left undecoded in the input and strings from
+		// transient input can't be kept at all
+		if (allocator == 0)
+		{
+			view.data = copy_all_strings ? 0 : t.val.string;
+			view.length = copy_all_strings ? 0 : t.length;
+			return;
+		}
+
+		char* data = (char*)allocator->Alloc(t.length != 0 ? t.length : 1);
+		view.data = data;
+		if (has_escapes)
+		{
+			view.length = DecodeString(data, t.val.string, t.length);
+		}
+		else
+		{
+			for (int i = 0; i < t.length; i++)
+				data[i] = t.val.string[i];
+			view.length = t.length;
+		}
+	}
+
+
+	void ParserString(const clutl::JSONToken& t, char* object, const clcpp::Type* type, clcpp::IAllocator* allocator, bool copy_all_strings)
 	{
 		// Was there an error expecting a string?
-		if (!t.IsValid())
+		if (!t.IsValid() || type == 0)
 			return;
 
 		// With enum fields, lookup the enum constant by name and assign if it exists
-		if (type && type->kind == clcpp::Primitive::KIND_ENUM)
+		if (type->kind == clcpp::Primitive::KIND_ENUM)
 		{
 			const clcpp::Enum* enum_type = type->AsEnum();
 			unsigned int constant_hash = clcpp::internal::HashData(t.val.string, t.length);
@@ -132,6 +281,16 @@ namespace
 			if (constant)
 				*(int*)object = constant->value;
 		}
+
+		else if (IsStringView(type))
+		{
+			LoadStringView(t, *(clutl::StringView*)object, allocator, copy_all_strings);
+		}
+
+		else if (IsCharContainer(type))
+		{
+			LoadCharContainer(t, object, type->AsTemplateType());
+		}
 	}
 
 
@@ -157,32 +316,35 @@ namespace
 	}
 
 
-	void LoadInteger(clutl::JSONContext& ctx, clcpp::int64 integer, char* object, const clcpp::Type* type, clcpp::Qualifier::Operator op)
+	void LoadInteger(clcpp::int64 integer, char* object, const clcpp::Type* type, clcpp::Qualifier::Operator op, clutl::PtrFixups* ptr_fixups)
 	{
 		if (type == 0)
 			return;
 
 		if (op == clcpp::Qualifier::POINTER)
 		{
-			*(unsigned int*)object = (unsigned int)integer;
+			// Pointers are loaded as the hash they were saved with, either to be patched later or
+			// left for the caller to patch
+			if (ptr_fixups != 0)
+				ptr_fixups->AddPtr((void**)object, (unsigned int)integer, type);
+			else
+				*(void**)object = (void*)(clcpp::pointer_type)(unsigned int)integer;
 		}
 
 		else
 		{
 			// Dispatch to the correct integer loader based on the field type
-			unsigned int index = GetTypeDispatchIndex(type->name.hash);
-			clcpp::internal::Assert(index < g_TypeDispatchMod && "Index is out of range");
-			LoadIntegerFunc func = g_TypeDispatchLUT[index].load_integer;
+			LoadIntegerFunc func = GetTypeDispatch(type).load_integer;
 			if (func)
 				func(object, integer);
 		}
 	}
 
 
-	void ParserInteger(clutl::JSONContext& ctx, const clutl::JSONToken& t, char* object, const clcpp::Type* type, clcpp::Qualifier::Operator op)
+	void ParserInteger(const clutl::JSONToken& t, char* object, const clcpp::Type* type, clcpp::Qualifier::Operator op, clutl::PtrFixups* ptr_fixups)
 	{
 		if (t.IsValid())
-			LoadInteger(ctx, t.val.integer, object, type, op);
+			LoadInteger(t.val.integer, object, type, op, ptr_fixups);
 	}
 
 
@@ -195,9 +357,7 @@ namespace
 		if (type)
 		{
 			// Dispatch to the correct decimal loader based on the field type
-			unsigned int index = GetTypeDispatchIndex(type->name.hash);
-			clcpp::internal::Assert(index < g_TypeDispatchMod && "Index is out of range");
-			LoadDecimalFunc func = g_TypeDispatchLUT[index].load_decimal;
+			LoadDecimalFunc func = GetTypeDispatch(type).load_decimal;
 			if (func)
 				func(object, t.val.decimal);
 		}
@@ -206,19 +366,48 @@ namespace
 
 	int ParserElements(clutl::JSONContext& ctx, clutl::JSONToken& t, clcpp::WriteIterator* writer, const clcpp::Type* type, clcpp::Qualifier::Operator op)
 	{
-		// Expect a value first
-		if (writer)
-			ParserValue(ctx, t, (char*)writer->AddEmpty(), type, op, 0);
-		else
-			ParserValue(ctx, t, 0, 0, op, 0);
+		// Contiguous values can be written to directly, either through the span the writer
+		// was initialised with or a single block allocation; those beyond the count are discarded
+		char* values = 0;
+		unsigned int stride = 0;
+		unsigned int nb_values = 0;
+		if (writer != 0)
+		{
+			if (writer->m_Span.data != 0)
+			{
+				values = writer->m_Span.data;
+				stride = writer->m_Span.stride;
+			}
+			else if (type != 0 && (values = (char*)writer->AddEmptyRange(writer->m_Count)) != 0)
+			{
+				stride = op == clcpp::Qualifier::POINTER ? sizeof(void*) : type->size;
+			}
+			nb_values = writer->m_Count;
+		}
 
-		if (t.type == clutl::JSON_TOKEN_COMMA)
+		for (unsigned int count = 1; ; count++)
 		{
+			// Expect a value first
+			if (values)
+			{
+				if (count <= nb_values)
+					ParserValue(ctx, t, values + (count - 1) * stride, type, op, 0);
+				else
+					ParserValue(ctx, t, 0, 0, op, 0);
+			}
+			else if (writer)
+			{
+				ParserValue(ctx, t, (char*)writer->AddEmpty(), type, op, 0);
+			}
+			else
+			{
+				ParserValue(ctx, t, 0, 0, op, 0);
+			}
+
+			if (t.type != clutl::JSON_TOKEN_COMMA)
+				return count;
 			t = LexerNextToken(ctx);
-			return 1 + ParserElements(ctx, t, writer, type, op);
 		}
-
-		return 1;
 	}
 
 
@@ -241,7 +430,8 @@ namespace
 			writer.Initialise(field, object);
 		}
 
-		else if (type && type->ci)
+		// Keyed containers need a key for each value so can't be loaded from arrays
+		else if (type && type->ci && !(type->ci->flags & clcpp::ContainerInfo::HAS_KEY))
 		{
 			// Do a pre-pass on the array to count the number of elements
 			// Really not very efficient for big collections of large objects
@@ -262,14 +452,142 @@ namespace
 	}
 
 
-	void ParserLiteralValue(clutl::JSONContext& ctx, const clutl::JSONToken& t, int integer, char* object, const clcpp::Type* type, clcpp::Qualifier::Operator op)
+	bool ParseIntegerKey(const clutl::JSONToken& t, clcpp::int64& integer)
+	{
+		// Optional sign followed by at least one decimal digit
+		int pos = 0;
+		bool negative = t.length > 0 && t.val.string[0] == '-';
+		if (negative)
+			pos++;
+		if (pos == t.length)
+			return false;
+
+		clcpp::uint64 value = 0;
+		for (; pos < t.length; pos++)
+		{
+			char c = t.val.string[pos];
+			if (c < '0' || c > '9')
+				return false;
+			value = value * 10 + (c - '0');
+		}
+
+		integer = negative ? -(clcpp::int64)value : (clcpp::int64)value;
+		return true;
+	}
+
+
+	bool LoadKey(const clutl::JSONToken& t, char* key, const clcpp::Type* key_type, KeyFormat key_format, clcpp::IAllocator* string_allocator, bool copy_all_strings, clutl::WriteBuffer& decoded)
+	{
+		switch (key_format)
+		{
+		case KEY_FORMAT_INTEGER:
+			{
+				clcpp::int64 integer;
+				if (!ParseIntegerKey(t, integer))
+					return false;
+				LoadInteger(integer, key, key_type, clcpp::Qualifier::VALUE, 0);
+				return true;
+			}
+
+		case KEY_FORMAT_ENUM:
+			{
+				unsigned int constant_hash = clcpp::internal::HashData(t.val.string, t.length);
+				const clcpp::EnumConstant* constant = clcpp::FindPrimitive(key_type->AsEnum()->constants, constant_hash);
+				if (constant == 0)
+					return false;
+				*(int*)key = constant->value;
+				return true;
+			}
+
+		case KEY_FORMAT_STRING:
+			{
+				clutl::StringView& view = *(clutl::StringView*)key;
+
+				// StringView keys are stored in the container so follow the same rules as StringView values
+				if (IsStringView(key_type))
+				{
+					LoadStringView(t, view, string_allocator, copy_all_strings);
+					return true;
+				}
+
+				// Other string containers copy their key from a view that only lasts for the insert
+				view.data = t.val.string;
+				view.length = t.length;
+				if (HasEscapes(t))
+				{
+					decoded.Reset();
+					char* decoded_data = (char*)decoded.Alloc(t.length);
+					view.data = decoded_data;
+					view.length = DecodeString(decoded_data, t.val.string, t.length);
+				}
+				return true;
+			}
+
+		default:
+			return false;
+		}
+	}
+
+
+	int ParserDictionaryMembers(clutl::JSONContext& ctx, clutl::JSONToken& t, clcpp::WriteIterator* writer)
+	{
+		KeyFormat key_format = writer ? GetKeyFormat(writer->m_KeyType, writer->m_KeyIsPtr) : KEY_FORMAT_NONE;
+		clcpp::Qualifier::Operator op = writer && writer->m_ValueIsPtr ? clcpp::Qualifier::POINTER : clcpp::Qualifier::VALUE;
+
+		// Aligned storage big enough for any supported key
+		clcpp::uint64 key_data[2];
+		clutl::WriteBuffer decoded;
+
+		for (int count = 1; ; count++)
+		{
+			clutl::JSONToken name = Expect(ctx, t, clutl::JSON_TOKEN_STRING);
+			if (!name.IsValid())
+				return count;
+			if (!Expect(ctx, t, clutl::JSON_TOKEN_COLON).IsValid())
+				return count;
+
+			// Skip values with keys that can't be converted
+			if (key_format != KEY_FORMAT_NONE && LoadKey(name, (char*)key_data, writer->m_KeyType, key_format, ctx.GetStringAllocator(), ctx.CopyAllStrings(), decoded))
+				ParserValue(ctx, t, (char*)writer->AddEmpty(key_data), writer->m_ValueType, op, 0);
+			else
+				ParserValue(ctx, t, 0, 0, clcpp::Qualifier::VALUE, 0);
+
+			if (t.type != clutl::JSON_TOKEN_COMMA)
+				return count;
+			t = LexerNextToken(ctx);
+		}
+	}
+
+
+	void ParserDictionary(clutl::JSONContext& ctx, clutl::JSONToken& t, char* object, const clcpp::TemplateType* type)
+	{
+		if (!Expect(ctx, t, clutl::JSON_TOKEN_LBRACE).IsValid())
+			return;
+
+		// Count the members up-front so that the container can reserve space for them
+		int count = 0;
+		if (t.type != clutl::JSON_TOKEN_RBRACE)
+		{
+			ctx.PushState(t);
+			count = ParserDictionaryMembers(ctx, t, 0);
+			ctx.PopState(t);
+		}
+
+		clcpp::WriteIterator writer;
+		writer.Initialise(type, object, count);
+		if (count != 0)
+			ParserDictionaryMembers(ctx, t, writer.IsInitialised() ? &writer : 0);
+	}
+
+
+	void ParserLiteralValue(const clutl::JSONToken& t, int integer, char* object, const clcpp::Type* type, clcpp::Qualifier::Operator op, clutl::PtrFixups* ptr_fixups)
 	{
 		if (t.IsValid())
-			LoadInteger(ctx, integer, object, type, op);
+			LoadInteger(integer, object, type, op, ptr_fixups);
 	}
 
 
-	void ParserValue(clutl::JSONContext& ctx, clutl::JSONToken& t, char* object, const clcpp::Type* type, clcpp::Qualifier::Operator op, const clcpp::Field* field)
+	bool CallCustomLoad(clutl::JSONToken& t, char* object, const clcpp::Type* type)
 	{
 		if (type && type->kind == clcpp::Primitive::KIND_CLASS)
 		{
@@ -279,27 +597,61 @@ namespace
 			if (class_type->flag_attributes & clcpp::FlagAttribute::CUSTOM_LOAD)
 			{
 				// Look it up
-				static unsigned int hash = clcpp::internal::HashNameString("load_json");
-				if (const clcpp::Attribute* attr = clcpp::FindPrimitive(class_type->attributes, hash))
+				if (const clcpp::Attribute* attr = clcpp::FindPrimitive(class_type->attributes, g_LoadJSONHash))
 				{
 					const clcpp::PrimitiveAttribute* name_attr = attr->AsPrimitiveAttribute();
 
-					// Call it and return immediately
+					// Call it and let the caller know the token has been consumed
 					clcpp::CallFunction((clcpp::Function*)name_attr->primitive, clcpp::ByRef(t), object);
-					t = LexerNextToken(ctx);
-					return;
+					return true;
+				}
+			}
+		}
+
+		return false;
+	}
+
+
+	void CallPostLoad(char* object, const clcpp::Type* type)
+	{
+		if (type && type->kind == clcpp::Primitive::KIND_CLASS)
+		{
+			const clcpp::Class* class_type = type->AsClass();
+
+			// Run any attached post-load functions
+			if (class_type->flag_attributes & clcpp::FlagAttribute::POST_LOAD)
+			{
+				if (const clcpp::Attribute* attr = clcpp::FindPrimitive(class_type->attributes, g_PostLoadHash))
+				{
+					const clcpp::PrimitiveAttribute* name_attr = attr->AsPrimitiveAttribute();
+					if (name_attr->primitive != 0)
+						clcpp::CallFunction((clcpp::Function*)name_attr->primitive, object);
 				}
 			}
 		}
+	}
+
+
+	void ParserValue(clutl::JSONContext& ctx, clutl::JSONToken& t, char* object, const clcpp::Type* type, clcpp::Qualifier::Operator op, const clcpp::Field* field)
+	{
+		// Custom load functions consume the current token and nothing more
+		if (CallCustomLoad(t, object, type))
+		{
+			t = LexerNextToken(ctx);
+			return;
+		}
 
 		switch (t.type)
 		{
-		case clutl::JSON_TOKEN_STRING: return ParserString(Expect(ctx, t, clutl::JSON_TOKEN_STRING), object, type);
-		case clutl::JSON_TOKEN_INTEGER: return ParserInteger(ctx, Expect(ctx, t, clutl::JSON_TOKEN_INTEGER), object, type, op);
+		case clutl::JSON_TOKEN_STRING: return ParserString(Expect(ctx, t, clutl::JSON_TOKEN_STRING), object, type, ctx.GetStringAllocator(), ctx.CopyAllStrings());
+		case clutl::JSON_TOKEN_INTEGER: return ParserInteger(Expect(ctx, t, clutl::JSON_TOKEN_INTEGER), object, type, op, ctx.GetPtrFixups());
 		case clutl::JSON_TOKEN_DECIMAL: return ParserDecimal(Expect(ctx, t, clutl::JSON_TOKEN_DECIMAL), object, type);
 		case clutl::JSON_TOKEN_LBRACE:
 			{
-				if (type)
+				// Keyed containers are loaded from objects, mapping member names to keys
+				if (type && type->ci && (type->ci->flags & clcpp::ContainerInfo::HAS_KEY))
+					ParserDictionary(ctx, t, object, type->AsTemplateType());
+				else if (type)
 					ParserObject(ctx, t, object, type);
 				else
 					ParserObject(ctx, t, 0, 0);
@@ -308,9 +660,9 @@ namespace
 				break;
 			}
 		case clutl::JSON_TOKEN_LBRACKET: return ParserArray(ctx, t, object, type, field);
-		case clutl::JSON_TOKEN_TRUE: return ParserLiteralValue(ctx, Expect(ctx, t, clutl::JSON_TOKEN_TRUE), 1, object, type, op);
-		case clutl::JSON_TOKEN_FALSE: return ParserLiteralValue(ctx, Expect(ctx, t, clutl::JSON_TOKEN_FALSE), 0, object, type, op);
-		case clutl::JSON_TOKEN_NULL: return ParserLiteralValue(ctx, Expect(ctx, t, clutl::JSON_TOKEN_NULL), 0, object, type, op);
+		case clutl::JSON_TOKEN_TRUE: return ParserLiteralValue(Expect(ctx, t, clutl::JSON_TOKEN_TRUE), 1, object, type, op, ctx.GetPtrFixups());
+		case clutl::JSON_TOKEN_FALSE: return ParserLiteralValue(Expect(ctx, t, clutl::JSON_TOKEN_FALSE), 0, object, type, op, ctx.GetPtrFixups());
+		case clutl::JSON_TOKEN_NULL: return ParserLiteralValue(Expect(ctx, t, clutl::JSON_TOKEN_NULL), 0, object, type, op, ctx.GetPtrFixups());
 
 		default:
 			ctx.SetError(clutl::JSONError::UNEXPECTED_TOKEN);
@@ -319,22 +671,20 @@ namespace
 	}
 
 
-	const clcpp::Field* FindFieldsRecursive(const clcpp::Type* type, unsigned int hash)
+	const clcpp::Field* FindPairField(const clutl::JSONToken& name, const clcpp::Type* type)
 	{
-		// Check fields if this is a class
+		// Lookup the field in the parent class, if the type is class
 		const clcpp::Field* field = 0;
-		if (type->kind == clcpp::Primitive::KIND_CLASS)
-			field = clcpp::FindPrimitive(type->AsClass()->fields, hash);
-
-		if (field == 0)
+		if (type && type->kind == clcpp::Primitive::KIND_CLASS)
 		{
-			// Search up through the inheritance hierarchy
-			for (unsigned int i = 0; i < type->base_types.size; i++)
-			{
-				field = FindFieldsRecursive(type->base_types[i], hash);
-				if (field)
-					break;
-			}
+			const clcpp::Class* class_type = type->AsClass();
+			unsigned int field_hash = clcpp::internal::HashData(name.val.string, name.length);
+
+			field = FindFieldsRecursive(class_type, field_hash);
+
+			// Don't load values for transient fields
+			if (field && (field->flag_attributes & clcpp::FlagAttribute::TRANSIENT))
+				field = 0;
 		}
 
 		return field;
@@ -348,20 +698,8 @@ namespace
 		if (!name.IsValid())
 			return;
 
-		// Lookup the field in the parent class, if the type is class
 		// We want to continue parsing even if there's a mismatch, to skip the invalid data
-		const clcpp::Field* field = 0;
-		if (type && type->kind == clcpp::Primitive::KIND_CLASS)
-		{
-			const clcpp::Class* class_type = type->AsClass();
-			unsigned int field_hash = clcpp::internal::HashData(name.val.string, name.length);
-
-			field = FindFieldsRecursive(class_type, field_hash);
-
-			// Don't load values for transient fields
-			if (field && (field->flag_attributes & clcpp::FlagAttribute::TRANSIENT))
-				field = 0;
-		}
+		const clcpp::Field* field = FindPairField(name, type);
 
 		if (!Expect(ctx, t, clutl::JSON_TOKEN_COLON).IsValid())
 			return;
@@ -400,30 +738,13 @@ namespace
 		}
 
 		ParserMembers(ctx, t, object, type);
-		
-		if (type && type->kind == clcpp::Primitive::KIND_CLASS)
-		{
-			const clcpp::Class* class_type = type->AsClass();
-
-			// Run any attached post-load functions
-			if (class_type->flag_attributes & clcpp::FlagAttribute::POST_LOAD)
-			{
-				static unsigned int hash = clcpp::internal::HashNameString("post_load");
-				if (const clcpp::Attribute* attr = clcpp::FindPrimitive(class_type->attributes, hash))
-				{
-					const clcpp::PrimitiveAttribute* name_attr = attr->AsPrimitiveAttribute();
-					if (name_attr->primitive != 0)
-						clcpp::CallFunction((clcpp::Function*)name_attr->primitive, object);
-				}
-			}
-		}
+		CallPostLoad(object, type);
 	}
 }
 
 
 clutl::JSONError clutl::LoadJSON(ReadBuffer& in, void* object, const clcpp::Type* type)
 {
-	SetupTypeDispatchLUT();
 	clutl::JSONContext ctx(in);
 	clutl::JSONToken t = LexerNextToken(ctx);
 	ParserObject(ctx, t, (char*)object, type);
@@ -431,15 +752,534 @@ clutl::JSONError clutl::LoadJSON(ReadBuffer& in, void* object, const clcpp::Type
 }
 
 
+clutl::JSONError clutl::LoadJSON(ReadBuffer& in, void* object, const clcpp::Type* type, clcpp::IAllocator* string_allocator, PtrFixups* ptr_fixups)
+{
+	clutl::JSONContext ctx(in);
+	ctx.SetStringAllocator(string_allocator);
+	ctx.SetPtrFixups(ptr_fixups);
+	clutl::JSONToken t = LexerNextToken(ctx);
+	ParserObject(ctx, t, (char*)object, type);
+	return ctx.GetError();
+}
+
+
 clutl::JSONError clutl::LoadJSON(clutl::JSONContext& ctx, void* object, const clcpp::Field* field)
 {
-	SetupTypeDispatchLUT();
 	clutl::JSONToken t = LexerNextToken(ctx);
 	ParserValue(ctx, t, (char*)object, field->type, field->qualifier.op, field);
 	return ctx.GetError();
 }
 
 
+namespace
+{
+	// ----------------------------------------------------------------------------------------------------
+	// Resumable JSON parser state
+	// ----------------------------------------------------------------------------------------------------
+
+
+	enum PushLexState
+	{
+		PUSH_LEX_NONE,
+		PUSH_LEX_STRING,
+		PUSH_LEX_ATOM,
+	};
+
+
+	// An object or array that's currently being parsed
+	struct PushFrame
+	{
+		enum Kind { OBJECT, ARRAY };
+		enum State { FIRST, KEY, COLON, VALUE, COMMA };
+
+		Kind kind;
+		State state;
+
+		// Object being populated, null when its data is being skipped
+		char* object;
+		const clcpp::Type* type;
+
+		// Field of the pair currently being parsed within an object
+		const clcpp::Field* field;
+
+		// Remaining elements of a C-Array being populated, or the value of the current key of a
+		// keyed container
+		const clcpp::Type* element_type;
+		clcpp::Qualifier::Operator element_op;
+		unsigned int element_size;
+		char* element;
+		char* elements_end;
+
+		// Iterator for a container being populated, owned by the frame
+		clcpp::WriteIterator* writer;
+		KeyFormat key_format;
+	};
+
+
+	PushFrame& PushParserFrame(clutl::WriteBuffer& stack, PushFrame::Kind kind, char* object, const clcpp::Type* type)
+	{
+		PushFrame& frame = *(PushFrame*)stack.Alloc(sizeof(PushFrame));
+		frame.kind = kind;
+		frame.state = PushFrame::FIRST;
+		frame.object = object;
+		frame.type = type;
+		frame.field = 0;
+		frame.element_type = 0;
+		frame.element_op = clcpp::Qualifier::VALUE;
+		frame.element_size = 0;
+		frame.element = 0;
+		frame.elements_end = 0;
+		frame.writer = 0;
+		frame.key_format = KEY_FORMAT_NONE;
+		return frame;
+	}
+
+
+	PushFrame& PushContainerFrame(clutl::WriteBuffer& stack, PushFrame::Kind kind, char* object, const clcpp::Type* type)
+	{
+		// The final size isn't known until the container closes so it starts empty and grows
+		// as each value is added
+		clcpp::WriteIterator* writer = new clcpp::WriteIterator;
+		writer->Initialise(type->AsTemplateType(), object, 0);
+		if (!writer->IsInitialised())
+		{
+			delete writer;
+			return PushParserFrame(stack, kind, 0, 0);
+		}
+
+		PushFrame& frame = PushParserFrame(stack, kind, object, type);
+		frame.writer = writer;
+		frame.element_type = writer->m_ValueType;
+		frame.element_op = writer->m_ValueIsPtr ? clcpp::Qualifier::POINTER : clcpp::Qualifier::VALUE;
+		if (kind == PushFrame::OBJECT)
+			frame.key_format = GetKeyFormat(writer->m_KeyType, writer->m_KeyIsPtr);
+		return frame;
+	}
+
+
+	PushFrame* TopParserFrame(clutl::WriteBuffer& stack)
+	{
+		if (stack.GetBytesWritten() == 0)
+			return 0;
+		return (PushFrame*)(stack.GetData() + stack.GetBytesWritten() - sizeof(PushFrame));
+	}
+
+
+	void PopParserFrame(clutl::WriteBuffer& stack)
+	{
+		PushFrame* frame = TopParserFrame(stack);
+		delete frame->writer;
+		stack.SeekRel(-(int)sizeof(PushFrame));
+	}
+
+
+	bool IsTokenDelimiter(char c)
+	{
+		switch (c)
+		{
+		case ' ':
+		case '\t':
+		case '\n':
+		case '\v':
+		case '\f':
+		case '\r':
+		case '{':
+		case '}':
+		case ',':
+		case '[':
+		case ']':
+		case ':':
+		case '\"':
+			return true;
+		}
+
+		return false;
+	}
+}
+
+
+clutl::JSONPushParser::JSONPushParser(void* object, const clcpp::Type* type, clcpp::IAllocator* string_allocator, PtrFixups* ptr_fixups)
+	: m_Object((char*)object)
+	, m_Type(type)
+	, m_StringAllocator(string_allocator)
+	, m_PtrFixups(ptr_fixups)
+	, m_Complete(false)
+	, m_Position(0)
+	, m_Line(1)
+	, m_LinePosition(0)
+	, m_LexState(PUSH_LEX_NONE)
+	, m_Escape(false)
+	, m_TokenPosition(0)
+{
+}
+
+
+clutl::JSONPushParser::~JSONPushParser()
+{
+	// Release the iterators of any containers left incomplete
+	while (TopParserFrame(m_Stack) != 0)
+		PopParserFrame(m_Stack);
+}
+
+
+clutl::JSONError clutl::JSONPushParser::Feed(const void* data, unsigned int length)
+{
+	const char* pos = (const char*)data;
+	const char* end = pos + length;
+
+	// Data following the root object is ignored, as it is with LoadJSON
+	while (pos < end && m_Error.code == JSONError::NONE && !m_Complete)
+	{
+		switch (m_LexState)
+		{
+		case PUSH_LEX_NONE:
+		{
+			char c = *pos++;
+			m_Position++;
+			switch (c)
+			{
+			// Skip whitespace
+			case '\n':
+				m_Line++;
+				m_LinePosition = m_Position;
+			case ' ':
+			case '\t':
+			case '\v':
+			case '\f':
+			case '\r':
+				break;
+
+			// Structural single character tokens are complete as soon as they're seen
+			case '{':
+			case '}':
+			case ',':
+			case '[':
+			case ']':
+			case ':':
+			{
+				JSONToken t((JSONTokenType)c, 1);
+				ParseToken(t);
+				break;
+			}
+
+			// Start buffering strings, numbers and keywords until their end is found
+			default:
+				m_LexState = c == '\"' ? PUSH_LEX_STRING : PUSH_LEX_ATOM;
+				m_Escape = false;
+				m_TokenPosition = m_Position - 1;
+				m_Token.Reset();
+				m_Token.WriteChar(c);
+				break;
+			}
+			break;
+		}
+
+		case PUSH_LEX_STRING:
+		{
+			// Search for the closing quote, stepping over escape sequences
+			const char* start = pos;
+			bool closed = false;
+			while (pos < end)
+			{
+				char c = *pos++;
+				if (m_Escape)
+					m_Escape = false;
+				else if (c == '\\')
+					m_Escape = true;
+				else if (c == '\"')
+				{
+					closed = true;
+					break;
+				}
+			}
+
+			m_Token.Write(start, pos - start);
+			m_Position += pos - start;
+			if (closed)
+			{
+				m_LexState = PUSH_LEX_NONE;
+				LexToken(false);
+			}
+			break;
+		}
+
+		case PUSH_LEX_ATOM:
+		{
+			// Numbers and keywords end at the next delimiter, which isn't part of the token
+			const char* start = pos;
+			while (pos < end && !IsTokenDelimiter(*pos))
+				pos++;
+
+			m_Token.Write(start, pos - start);
+			m_Position += pos - start;
+			if (pos < end)
+			{
+				m_LexState = PUSH_LEX_NONE;
+				LexToken(true);
+			}
+			break;
+		}
+		}
+	}
+
+	return m_Error;
+}
+
+
+clutl::JSONError clutl::JSONPushParser::Finish()
+{
+	// Lex any partial token so that errors match those of parsing the whole document
+	if (m_LexState != PUSH_LEX_NONE && m_Error.code == JSONError::NONE)
+	{
+		m_LexState = PUSH_LEX_NONE;
+		LexToken(false);
+	}
+
+	// Any partially parsed token or container also leaves the root object incomplete
+	if (!m_Complete)
+		SetError(JSONError::UNEXPECTED_END_OF_DATA, m_Position);
+	return m_Error;
+}
+
+
+void clutl::JSONPushParser::LexToken(bool terminate)
+{
+	// Follow the token with its delimiter so that the lexer can find the end of numbers
+	// exactly as it would if it was reading the entire document
+	if (terminate)
+		m_Token.WriteChar(' ');
+
+	ReadBuffer read_buffer(m_Token);
+	JSONContext ctx(read_buffer);
+	JSONToken t = LexerNextToken(ctx);
+
+	if (ctx.GetError().code != JSONError::NONE)
+	{
+		SetError(ctx.GetError(), m_TokenPosition, m_Line, m_TokenPosition - m_LinePosition);
+		return;
+	}
+
+	// Text beyond the token would have been lexed as the start of another invalid token
+	if (read_buffer.GetBytesRemaining() > (terminate ? 1U : 0U))
+	{
+		SetError(JSONError::UNEXPECTED_CHARACTER, m_TokenPosition + read_buffer.GetBytesRead());
+		return;
+	}
+
+	ParseToken(t);
+}
+
+
+void clutl::JSONPushParser::ParseToken(JSONToken& t)
+{
+	PushFrame* frame = TopParserFrame(m_Stack);
+	if (frame == 0)
+	{
+		// Only the root object is expected
+		if (t.type == JSON_TOKEN_LBRACE)
+			PushParserFrame(m_Stack, PushFrame::OBJECT, m_Object, m_Type);
+		else
+			SetError(JSONError::UNEXPECTED_TOKEN, m_Position);
+		return;
+	}
+
+	JSONTokenType close_type = frame->kind == PushFrame::OBJECT ? JSON_TOKEN_RBRACE : JSON_TOKEN_RBRACKET;
+
+	// Empty objects and arrays can be closed immediately
+	if (frame->state == PushFrame::FIRST)
+	{
+		if (t.type == close_type)
+		{
+			PopParserFrame(m_Stack);
+			m_Complete = m_Stack.GetBytesWritten() == 0;
+			return;
+		}
+
+		frame->state = frame->kind == PushFrame::OBJECT ? PushFrame::KEY : PushFrame::VALUE;
+	}
+
+	switch (frame->state)
+	{
+	case PushFrame::KEY:
+		if (t.type != JSON_TOKEN_STRING)
+		{
+			SetError(JSONError::UNEXPECTED_TOKEN, m_Position);
+			break;
+		}
+
+		frame->state = PushFrame::COLON;
+		if (frame->writer != 0)
+		{
+			// Add the value for each key as soon as it's known, skipping values with keys that can't be converted
+			clcpp::uint64 key_data[2];
+			frame->element = 0;
+			if (frame->key_format != KEY_FORMAT_NONE && LoadKey(t, (char*)key_data, frame->writer->m_KeyType, frame->key_format, m_StringAllocator, true, m_Key))
+				frame->element = (char*)frame->writer->AddEmpty(key_data);
+			break;
+		}
+
+		// Lookup the field, continuing to parse if there's a mismatch to skip the invalid data
+		frame->field = FindPairField(t, frame->type);
+		break;
+
+	case PushFrame::COLON:
+		if (t.type != JSON_TOKEN_COLON)
+		{
+			SetError(JSONError::UNEXPECTED_TOKEN, m_Position);
+			break;
+		}
+		frame->state = PushFrame::VALUE;
+		break;
+
+	case PushFrame::VALUE:
+		// Values can push new frames so this one can't be referenced after they're parsed
+		frame->state = PushFrame::COMMA;
+		if (frame->writer != 0)
+		{
+			// Array values are added as they start, keyed values when their key was parsed
+			char* element = frame->kind == PushFrame::ARRAY ? (char*)frame->writer->AddEmpty() : frame->element;
+			ParseValue(t, element, element ? frame->element_type : 0, frame->element_op, 0);
+		}
+
+		else if (frame->kind == PushFrame::OBJECT)
+		{
+			const clcpp::Field* field = frame->field;
+			if (field)
+				ParseValue(t, frame->object + field->offset, field->type, field->qualifier.op, field);
+			else
+				ParseValue(t, 0, 0, clcpp::Qualifier::VALUE, 0);
+		}
+
+		else if (frame->element != 0)
+		{
+			clcpp::internal::Assert(frame->element < frame->elements_end);
+			char* element = frame->element;
+			frame->element += frame->element_size;
+			ParseValue(t, element, frame->element_type, frame->element_op, 0);
+		}
+
+		else
+		{
+			ParseValue(t, 0, 0, clcpp::Qualifier::VALUE, 0);
+		}
+		break;
+
+	case PushFrame::COMMA:
+		if (t.type == JSON_TOKEN_COMMA)
+		{
+			frame->state = frame->kind == PushFrame::OBJECT ? PushFrame::KEY : PushFrame::VALUE;
+		}
+
+		else if (t.type == close_type)
+		{
+			if (frame->kind == PushFrame::OBJECT && frame->writer == 0)
+				CallPostLoad(frame->object, frame->type);
+
+			PopParserFrame(m_Stack);
+			m_Complete = m_Stack.GetBytesWritten() == 0;
+		}
+
+		else
+		{
+			SetError(JSONError::UNEXPECTED_TOKEN, m_Position);
+		}
+		break;
+
+	default:
+		break;
+	}
+}
+
+
+void clutl::JSONPushParser::ParseValue(JSONToken& t, char* object, const clcpp::Type* type, clcpp::Qualifier::Operator op, const clcpp::Field* field)
+{
+	// Custom load functions consume the current token and nothing more
+	if (CallCustomLoad(t, object, type))
+		return;
+
+	switch (t.type)
+	{
+	case JSON_TOKEN_STRING: ParserString(t, object, type, m_StringAllocator, true); break;
+	case JSON_TOKEN_INTEGER: ParserInteger(t, object, type, op, m_PtrFixups); break;
+	case JSON_TOKEN_DECIMAL: ParserDecimal(t, object, type); break;
+	case JSON_TOKEN_TRUE: ParserLiteralValue(t, 1, object, type, op, m_PtrFixups); break;
+	case JSON_TOKEN_FALSE: ParserLiteralValue(t, 0, object, type, op, m_PtrFixups); break;
+	case JSON_TOKEN_NULL: ParserLiteralValue(t, 0, object, type, op, m_PtrFixups); break;
+
+	case JSON_TOKEN_LBRACE:
+		// Keyed containers are loaded from objects, mapping member names to keys
+		if (type && type->ci && (type->ci->flags & clcpp::ContainerInfo::HAS_KEY))
+			PushContainerFrame(m_Stack, PushFrame::OBJECT, object, type);
+		else
+			PushParserFrame(m_Stack, PushFrame::OBJECT, type ? object : 0, type);
+		break;
+
+	case JSON_TOKEN_LBRACKET:
+		if (field && field->ci)
+		{
+			// C-Array fields are filled in place as each element completes
+			PushFrame& frame = PushParserFrame(m_Stack, PushFrame::ARRAY, object, type);
+			frame.element_type = field->type;
+			frame.element_op = field->qualifier.op == clcpp::Qualifier::POINTER ? clcpp::Qualifier::POINTER : clcpp::Qualifier::VALUE;
+			frame.element_size = frame.element_op == clcpp::Qualifier::POINTER ? sizeof(void*) : field->type->size;
+			frame.element = object;
+			frame.elements_end = object + frame.element_size * field->ci->count;
+		}
+
+		else if (type && type->ci && !(type->ci->flags & clcpp::ContainerInfo::HAS_KEY))
+		{
+			// Dynamic containers grow as each element starts
+			PushContainerFrame(m_Stack, PushFrame::ARRAY, object, type);
+		}
+
+		else
+		{
+			// Skip the contents of arrays that can't be loaded
+			PushParserFrame(m_Stack, PushFrame::ARRAY, 0, 0);
+		}
+		break;
+
+	default:
+		SetError(JSONError::UNEXPECTED_TOKEN, m_Position);
+		break;
+	}
+}
+
+
+void clutl::JSONPushParser::SetError(JSONError::Code code, unsigned int position)
+{
+	// Record the first error only
+	if (m_Error.code == JSONError::NONE)
+	{
+		m_Error.code = code;
+		m_Error.position = position;
+		m_Error.line = m_Line;
+		m_Error.column = position - m_LinePosition;
+	}
+}
+
+
+void clutl::JSONPushParser::SetError(const JSONError& error, unsigned int position, unsigned int line, unsigned int column)
+{
+	// Offset errors reported while lexing buffered token text by where that text started
+	if (m_Error.code == JSONError::NONE)
+	{
+		m_Error.code = error.code;
+		m_Error.position = position + error.position;
+		if (error.line > 1)
+		{
+			m_Error.line = line + error.line - 1;
+			m_Error.column = error.column;
+		}
+		else
+		{
+			m_Error.line = line;
+			m_Error.column = column + error.column;
+		}
+	}
+}
+
+
 namespace
 {
 	// ----------------------------------------------------------------------------------------------------
@@ -447,7 +1287,15 @@ namespace
 	// ----------------------------------------------------------------------------------------------------
 
 
-	void SaveObject(clutl::WriteBuffer& out, const char* object, const clcpp::Field* field, const clcpp::Type* type, clutl::IPtrSave* ptr_save, unsigned int flags);
+	// Worker pool for saving containers with more than range_size elements
+	struct ParallelSave
+	{
+		clutl::IParallelFor* parallel_for;
+		unsigned int range_size;
+	};
+
+
+	void SaveObject(clutl::WriteBuffer& out, const char* object, const clcpp::Field* field, const clcpp::Type* type, clutl::IPtrSave* ptr_save, const ParallelSave* parallel, unsigned int flags);
 
 
 	void SaveString(clutl::WriteBuffer& out, const char* start, const char* end)
@@ -466,84 +1314,140 @@ namespace
 	}
 
 
-	void SaveInteger(clutl::WriteBuffer& out, clcpp::int64 integer)
-	{
-		// Enough to store a 64-bit int
-		static const int MAX_SZ = 20;
-		char text[MAX_SZ];
+	void SaveEscapedString(clutl::WriteBuffer& out, const char* start, const char* end)
+	{
+		out.WriteChar('\"');
+
+		// Write runs of characters that don't need escaping in one go
+		const char* run = start;
+		for (const char* pos = start; pos != end; pos++)
+		{
+			char escape = 0;
+			switch (*pos)
+			{
+			case '\"': escape = '\"'; break;
+			case '\\': escape = '\\'; break;
+			case '\b': escape = 'b'; break;
+			case '\f': escape = 'f'; break;
+			case '\n': escape = 'n'; break;
+			case '\r': escape = 'r'; break;
+			case '\t': escape = 't'; break;
+			default:
+				if ((unsigned char)*pos >= 0x20)
+					continue;
+			}
+
+			out.Write(run, pos - run);
+			run = pos + 1;
+			out.WriteChar('\\');
+			if (escape != 0)
+			{
+				out.WriteChar(escape);
+			}
+			else
+			{
+				// Remaining control characters
+				out.WriteStr("u00");
+				out.WriteChar("0123456789ABCDEF"[*pos >> 4]);
+				out.WriteChar("0123456789ABCDEF"[*pos & 15]);
+			}
+		}
+
+		out.Write(run, end - run);
+		out.WriteChar('\"');
+	}
+
+
+	// Two-character decimal representations of 0 to 99
+	const char g_DecimalDigitPairs[] =
+		"0001020304050607080910111213141516171819"
+		"2021222324252627282930313233343536373839"
+		"4041424344454647484950515253545556575859"
+		"6061626364656667686970717273747576777879"
+		"8081828384858687888990919293949596979899";
 
-		// Null terminate and start at the end
-		text[MAX_SZ - 1] = 0;
-		char* end = text + MAX_SZ - 1;
-		char* tptr = end;
 
-		// Get the absolute and record if the value is negative
-		bool negative = false;
-		if (integer < 0)
+	unsigned int CountDecimalDigits(clcpp::uint64 integer)
+	{
+		// Test four digits per step before dividing
+		unsigned int nb_digits = 1;
+		while (true)
 		{
-			negative = true;
-			integer = -integer;
+			if (integer < 10)
+				return nb_digits;
+			if (integer < 100)
+				return nb_digits + 1;
+			if (integer < 1000)
+				return nb_digits + 2;
+			if (integer < 10000)
+				return nb_digits + 3;
+			integer /= 10000;
+			nb_digits += 4;
 		}
+	}
 
-		// Loop through the value with radix 10
-		do 
-		{
-			clcpp::int64 next_integer = integer / 10;
-			*--tptr = char('0' + (integer - next_integer * 10));
-			integer = next_integer;
-		} while (integer);
 
-		// Add negative prefix
-		if (negative)
-			*--tptr = '-';
+	void FormatDecimalDigits(char* end, clcpp::uint64 integer)
+	{
+		// Write backwards from the end, two digits per step
+		while (integer >= 100)
+		{
+			const char* pair = g_DecimalDigitPairs + (integer % 100) * 2;
+			integer /= 100;
+			*--end = pair[1];
+			*--end = pair[0];
+		}
 
-		out.Write(tptr, end - tptr);
+		if (integer >= 10)
+		{
+			const char* pair = g_DecimalDigitPairs + integer * 2;
+			*--end = pair[1];
+			*--end = pair[0];
+		}
+		else
+		{
+			*--end = char('0' + integer);
+		}
 	}
 
 
 	void SaveUnsignedInteger(clutl::WriteBuffer& out, clcpp::uint64 integer)
 	{
-		// Enough to store a 64-bit int + null
-		static const int MAX_SZ = 21;
-		char text[MAX_SZ];
+		// Calculate the length up-front so that digits can be written in place
+		unsigned int nb_digits = CountDecimalDigits(integer);
+		char* text = (char*)out.Alloc(nb_digits);
+		FormatDecimalDigits(text + nb_digits, integer);
+	}
 
-		// Null terminate and start at the end
-		text[MAX_SZ - 1] = 0;
-		char* end = text + MAX_SZ - 1;
-		char* tptr = end;
 
-		// Loop through the value with radix 10
-		do 
+	void SaveInteger(clutl::WriteBuffer& out, clcpp::int64 integer)
+	{
+		if (integer >= 0)
 		{
-			clcpp::uint64 next_integer = integer / 10;
-			*--tptr = char('0' + (integer - next_integer * 10));
-			integer = next_integer;
-		} while (integer);
+			SaveUnsignedInteger(out, integer);
+			return;
+		}
 
-		out.Write(tptr, end - tptr);
+		// Negate as unsigned so that the most negative value doesn't overflow
+		clcpp::uint64 magnitude = 0ULL - (clcpp::uint64)integer;
+		unsigned int nb_digits = CountDecimalDigits(magnitude);
+		char* text = (char*)out.Alloc(nb_digits + 1);
+		text[0] = '-';
+		FormatDecimalDigits(text + nb_digits + 1, magnitude);
 	}
 
 
 	void SaveHexInteger(clutl::WriteBuffer& out, clcpp::uint64 integer)
 	{
-		// Enough to store a 64-bit int + null
-		static const int MAX_SZ = 21;
-		char text[MAX_SZ];
-
-		// Null terminate and start at the end
-		text[MAX_SZ - 1] = 0;
-		char* end = text + MAX_SZ - 1;
-		char* tptr = end;
-
-		// Loop through the value with radix 16
-		do 
-		{
-			clcpp::uint64 next_integer = integer / 16;
-			*--tptr = "0123456789ABCDEF"[integer - next_integer * 16];
-			integer = next_integer;
-		} while (integer);
-
-		out.Write(tptr, end - tptr);
+		// Count the significant nibbles, with a minimum of one digit for zero
+		unsigned int nb_digits = 1;
+		while (nb_digits < 16 && (integer >> (nb_digits * 4)) != 0)
+			nb_digits++;
+
+		// Write in place, backwards from the end
+		char* text = (char*)out.Alloc(nb_digits);
+		for (char* end = text + nb_digits; end != text; integer >>= 4)
+			*--end = "0123456789ABCDEF"[integer & 15];
 	}
 
 
@@ -590,9 +1494,7 @@ namespace
 
 	void SaveType(clutl::WriteBuffer& out, const char* object, const clcpp::Type* type, unsigned int flags)
 	{
-		unsigned int index = GetTypeDispatchIndex(type->name.hash);
-		clcpp::internal::Assert(index < g_TypeDispatchMod && "Index is out of range");
-		SaveNumberFunc func = g_TypeDispatchLUT[index].save_number;
+		SaveNumberFunc func = GetTypeDispatch(type).save_number;
 		clcpp::internal::Assert(func && "No save function for type");
 		func(out, object, flags);
 	}
@@ -635,45 +1537,148 @@ namespace
 	}
 
 
-	void SaveContainer(clutl::WriteBuffer& out, clcpp::ReadIterator& reader, const clcpp::Field* field, clutl::IPtrSave* ptr_save, unsigned int flags)
+	void SaveContainerElement(clutl::WriteBuffer& out, const char* value, const clcpp::Field* field, const clcpp::Type* value_type, bool value_is_ptr, clutl::IPtrSave* ptr_save, const ParallelSave* parallel, unsigned int flags, bool& written)
 	{
-		// TODO: If the iterator has a key, save a dictionary instead.
-		// TODO: The reader knows its type and if its a pointer for all entries. Can early out on unwanted pointer saves, etc.
+		if (value_is_ptr)
+		{
+			// Ask the user if they want to save this pointer, before any separator is written
+			void* ptr = *(void**)value;
+			if (ptr_save == 0 || !ptr_save->CanSavePtr(ptr, field, value_type))
+				return;
+		}
 
-		out.WriteChar('[');
+		if (written)
+			out.WriteChar(',');
+
+		if (value_is_ptr)
+			SavePtr(out, value, ptr_save, flags);
+		else
+			SaveObject(out, value, field, value_type, ptr_save, parallel, flags);
+
+		written = true;
+	}
+
+
+	// A container being saved in parallel, with one output buffer for each range of elements
+	struct ContainerRanges
+	{
+		// Contiguous values are addressed through their span, all others through a gathered list
+		const char** values;
+		clcpp::ContainerSpan span;
+		unsigned int nb_values;
+		unsigned int range_size;
+		const clcpp::Field* field;
+		const clcpp::Type* value_type;
+		bool value_is_ptr;
+		clutl::IPtrSave* ptr_save;
+		unsigned int flags;
+		clutl::WriteBuffer* outputs;
+	};
+
+
+	void SaveContainerRange(void* data, unsigned int index)
+	{
+		const ContainerRanges& ranges = *(const ContainerRanges*)data;
+		unsigned int start = index * ranges.range_size;
+		unsigned int end = start + ranges.range_size;
+		if (end > ranges.nb_values)
+			end = ranges.nb_values;
 
-		// Save comma-separated objects
+		// Nested containers are saved serially on this worker
 		bool written = false;
-		for (unsigned int i = 0; i < reader.m_Count; i++)
+		for (unsigned int i = start; i < end; i++)
 		{
-			clcpp::ContainerKeyValue kv = reader.GetKeyValue();
+			const char* value = ranges.span.data ? ranges.span.data + i * ranges.span.stride : ranges.values[i];
+			SaveContainerElement(ranges.outputs[index], value, ranges.field, ranges.value_type, ranges.value_is_ptr, ranges.ptr_save, 0, ranges.flags, written);
+		}
+	}
+
+
+	void SaveContainerParallel(clutl::WriteBuffer& out, clcpp::ReadIterator& reader, const clcpp::Field* field, clutl::IPtrSave* ptr_save, const ParallelSave* parallel, unsigned int flags)
+	{
+		// Read iterators only support sequential access so gather all element addresses up-front,
+		// unless they're contiguous and can be addressed directly
+		clutl::WriteBuffer values;
+		if (reader.m_Span.data == 0)
+		{
+			values.Alloc(reader.m_Count * sizeof(const char*));
+			const char** value = (const char**)values.GetData();
+			for (unsigned int i = 0; i < reader.m_Count; i++)
+			{
+				value[i] = (const char*)reader.GetKeyValue().value;
+				reader.MoveNext();
+			}
+		}
+
+		ContainerRanges ranges;
+		ranges.values = (const char**)values.GetData();
+		ranges.span = reader.m_Span;
+		ranges.nb_values = reader.m_Count;
+		ranges.range_size = parallel->range_size;
+		ranges.field = field;
+		ranges.value_type = reader.m_ValueType;
+		ranges.value_is_ptr = reader.m_ValueIsPtr;
+		ranges.ptr_save = ptr_save;
+		ranges.flags = flags;
+
+		unsigned int nb_ranges = (ranges.nb_values + ranges.range_size - 1) / ranges.range_size;
+		ranges.outputs = new clutl::WriteBuffer[nb_ranges];
+		parallel->parallel_for->Run(SaveContainerRange, &ranges, nb_ranges);
+
+		// Concatenate in order, separating ranges where not all pointers were skipped
+		bool written = false;
+		for (unsigned int i = 0; i < nb_ranges; i++)
+		{
+			const clutl::WriteBuffer& range_out = ranges.outputs[i];
+			if (range_out.GetBytesWritten() == 0)
+				continue;
 
 			if (written)
 				out.WriteChar(',');
+			out.Write(range_out.GetData(), range_out.GetBytesWritten());
+			written = true;
+		}
 
-			if (reader.m_ValueIsPtr)
-			{
-				// Ask the user if they want to save this pointer
-				void* ptr = *(void**)kv.value;
-				if (ptr_save == 0 || !ptr_save->CanSavePtr(ptr, field, reader.m_ValueType))
-					continue;
+		delete [] ranges.outputs;
+	}
 
-				SavePtr(out, kv.value, ptr_save, flags);
-			}
-			else
+
+	void SaveContainer(clutl::WriteBuffer& out, clcpp::ReadIterator& reader, const clcpp::Field* field, clutl::IPtrSave* ptr_save, const ParallelSave* parallel, unsigned int flags)
+	{
+		// TODO: The reader knows its type and if its a pointer for all entries. Can early out on unwanted pointer saves, etc.
+
+		out.WriteChar('[');
+
+		if (parallel != 0 && reader.m_Count > parallel->range_size)
+		{
+			SaveContainerParallel(out, reader, field, ptr_save, parallel, flags);
+		}
+
+		else if (const char* value = reader.m_Span.data)
+		{
+			// Step through contiguous objects without calling into the iterator
+			bool written = false;
+			for (unsigned int i = 0; i < reader.m_Count; i++, value += reader.m_Span.stride)
+				SaveContainerElement(out, value, field, reader.m_ValueType, reader.m_ValueIsPtr, ptr_save, parallel, flags, written);
+		}
+
+		else
+		{
+			// Save comma-separated objects
+			bool written = false;
+			for (unsigned int i = 0; i < reader.m_Count; i++)
 			{
-				SaveObject(out, (char*)kv.value, field, reader.m_ValueType, ptr_save, flags);
+				clcpp::ContainerKeyValue kv = reader.GetKeyValue();
+				SaveContainerElement(out, (const char*)kv.value, field, reader.m_ValueType, reader.m_ValueIsPtr, ptr_save, parallel, flags, written);
+				reader.MoveNext();
 			}
-
-			reader.MoveNext();
-			written = true;
 		}
 
 		out.WriteChar(']');
 	}
 
 
-	void SaveFieldArray(clutl::WriteBuffer& out, const char* object, const clcpp::Field* field, clutl::IPtrSave* ptr_save, unsigned int flags)
+	void SaveFieldArray(clutl::WriteBuffer& out, const char* object, const clcpp::Field* field, clutl::IPtrSave* ptr_save, const ParallelSave* parallel, unsigned int flags)
 	{
 		// Construct a read iterator and leave early if there are no elements
 		clcpp::ReadIterator reader(field, object);
@@ -683,7 +1688,7 @@ namespace
 			return;
 		}
 
-		SaveContainer(out, reader, field, ptr_save, flags);
+		SaveContainer(out, reader, field, ptr_save, parallel, flags);
 	}
 
 
@@ -741,18 +1746,18 @@ namespace
 	}
 
 
-	void SaveFieldObject(clutl::WriteBuffer& out, const char* object, const clcpp::Field* field, clutl::IPtrSave* ptr_save, unsigned int& flags)
+	void SaveFieldObject(clutl::WriteBuffer& out, const char* object, const clcpp::Field* field, clutl::IPtrSave* ptr_save, const ParallelSave* parallel, unsigned int& flags)
 	{
 		if (field->ci != 0)
-			SaveFieldArray(out, object, field, ptr_save, flags);
+			SaveFieldArray(out, object, field, ptr_save, parallel, flags);
 		else if (field->qualifier.op == clcpp::Qualifier::POINTER)
 			SavePtr(out, object, ptr_save, flags);
 		else
-			SaveObject(out, object, field, field->type, ptr_save, flags);
+			SaveObject(out, object, field, field->type, ptr_save, parallel, flags);
 	}
 
 
-	void SaveClassField(clutl::WriteBuffer& out, const char* object, const clcpp::Field* field, clutl::IPtrSave* ptr_save, unsigned int& flags, bool& field_written)
+	void SaveClassField(clutl::WriteBuffer& out, const char* object, const clcpp::Field* field, clutl::IPtrSave* ptr_save, const ParallelSave* parallel, unsigned int& flags, bool& field_written)
 	{
 		if (field->qualifier.op == clcpp::Qualifier::POINTER)
 		{
@@ -769,15 +1774,24 @@ namespace
 			NewLine(out, flags);
 		}
 
-		// Write the field name and object
-		SaveString(out, field->name.text);
-		out.WriteChar(':');
-		SaveFieldObject(out, object + field->offset, field, ptr_save, flags);
+		// Write the field name, preferring the key pre-encoded by the exporter which needs only one copy
+		if (field->json_key != 0)
+		{
+			out.Write(field->json_key, field->json_key_length);
+		}
+		else
+		{
+			SaveString(out, field->name.text);
+			out.WriteChar(':');
+		}
+
+		// Write the object
+		SaveFieldObject(out, object + field->offset, field, ptr_save, parallel, flags);
 		field_written = true;
 	}
 
 
-	void SaveClassFields(clutl::WriteBuffer& out, const char* object, const clcpp::Class* class_type, clutl::IPtrSave* ptr_save, unsigned int& flags, bool& field_written)
+	void SaveClassFields(clutl::WriteBuffer& out, const char* object, const clcpp::Class* class_type, clutl::IPtrSave* ptr_save, const ParallelSave* parallel, unsigned int& flags, bool& field_written)
 	{
 		const clcpp::CArray<const clcpp::Field*>& fields = class_type->fields;
 		unsigned int nb_fields = fields.size;
@@ -814,7 +1828,7 @@ namespace
 				if (lowest_field_index != -1)
 				{
 					const clcpp::Field* field = fields[lowest_field_index];
-					SaveClassField(out, object, field, ptr_save, flags, field_written);
+					SaveClassField(out, object, field, ptr_save, parallel, flags, field_written);
 					last_field_offset = lowest_field_offset;
 				}
 			}
@@ -830,35 +1844,41 @@ namespace
 				if (field->flag_attributes & clcpp::FlagAttribute::TRANSIENT)
 					continue;
 
-				SaveClassField(out, object, field, ptr_save, flags, field_written);
+				SaveClassField(out, object, field, ptr_save, parallel, flags, field_written);
 			}
 		}
 	}
 
 
-	void SaveClass(clutl::WriteBuffer& out, const char* object, const clcpp::Type* type, clutl::IPtrSave* ptr_save, unsigned int& flags, bool& field_written)
+	void SaveClass(clutl::WriteBuffer& out, const char* object, const clcpp::Type* type, clutl::IPtrSave* ptr_save, const ParallelSave* parallel, unsigned int& flags, bool& field_written)
 	{
 		// Save body of the class
 		if (type->kind == clcpp::Primitive::KIND_CLASS)
-			SaveClassFields(out, object, type->AsClass(), ptr_save, flags, field_written);
+			SaveClassFields(out, object, type->AsClass(), ptr_save, parallel, flags, field_written);
 
 		// Recurse into base types
 		for (unsigned int i = 0; i < type->base_types.size; i++)
 		{
 			const clcpp::Type* base_type = type->base_types[i];
-			SaveClass(out, object, base_type, ptr_save, flags, field_written);
+			SaveClass(out, object, base_type, ptr_save, parallel, flags, field_written);
 		}
 	}
 
 
-	void SaveClass(clutl::WriteBuffer& out, const char* object, const clcpp::Class* class_type, clutl::IPtrSave* ptr_save, unsigned int flags)
+	void SaveClass(clutl::WriteBuffer& out, const char* object, const clcpp::Class* class_type, clutl::IPtrSave* ptr_save, const ParallelSave* parallel, unsigned int flags)
 	{
+		if (class_type->flag_attributes & clutl::FLAG_ATTR_IS_STRING_VIEW)
+		{
+			const clutl::StringView& view = *(const clutl::StringView*)object;
+			SaveEscapedString(out, view.data, view.data + view.length);
+			return;
+		}
+
 		// Is there a custom loading function for this class?
 		if (class_type->flag_attributes & clcpp::FlagAttribute::CUSTOM_SAVE)
 		{
 			// Look it up
-			static unsigned int hash = clcpp::internal::HashNameString("save_json");
-			if (const clcpp::Attribute* attr = clcpp::FindPrimitive(class_type->attributes, hash))
+			if (const clcpp::Attribute* attr = clcpp::FindPrimitive(class_type->attributes, g_SaveJSONHash))
 			{
 				const clcpp::PrimitiveAttribute* name_attr = attr->AsPrimitiveAttribute();
 
@@ -889,8 +1909,7 @@ namespace
 		// Call any attached pre-save function
 		if (class_type->flag_attributes & clcpp::FlagAttribute::PRE_SAVE)
 		{
-			static unsigned int hash = clcpp::internal::HashNameString("pre_save");
-			if (const clcpp::Attribute* attr = clcpp::FindPrimitive(class_type->attributes, hash))
+			if (const clcpp::Attribute* attr = clcpp::FindPrimitive(class_type->attributes, g_PreSaveHash))
 			{
 				const clcpp::PrimitiveAttribute* name_attr = attr->AsPrimitiveAttribute();
 				if (name_attr->primitive != 0)
@@ -900,26 +1919,126 @@ namespace
 
 		bool field_written = false;
 		OpenScope(out, flags);
-		SaveClass(out, object, class_type, ptr_save, flags, field_written);
+		SaveClass(out, object, class_type, ptr_save, parallel, flags, field_written);
 		CloseScope(out, flags);
 	}
 
 
-	void SaveTemplateType(clutl::WriteBuffer& out, const char* object, const clcpp::Field* field, const clcpp::TemplateType* template_type, clutl::IPtrSave* ptr_save, unsigned int flags)
+	void SaveCharContainer(clutl::WriteBuffer& out, clcpp::ReadIterator& reader)
+	{
+		// Packed strings can be escaped in place
+		if (reader.m_Span.data != 0 && reader.m_Span.stride == 1)
+		{
+			SaveEscapedString(out, reader.m_Span.data, reader.m_Span.data + reader.m_Count);
+			return;
+		}
+
+		// Otherwise gather the characters so that they can be escaped in runs
+		clutl::WriteBuffer chars(reader.m_Count);
+		for (unsigned int i = 0; i < reader.m_Count; i++)
+		{
+			chars.WriteChar(*(const char*)reader.GetKeyValue().value);
+			reader.MoveNext();
+		}
+
+		SaveEscapedString(out, chars.GetData(), chars.GetData() + chars.GetBytesWritten());
+	}
+
+
+	void SaveKey(clutl::WriteBuffer& out, const char* key, const clcpp::Type* key_type, KeyFormat key_format, unsigned int flags)
+	{
+		switch (key_format)
+		{
+		case KEY_FORMAT_INTEGER:
+			out.WriteChar('\"');
+			SaveType(out, key, key_type, flags);
+			out.WriteChar('\"');
+			break;
+
+		case KEY_FORMAT_ENUM:
+			SaveEnum(out, key, key_type->AsEnum());
+			break;
+
+		case KEY_FORMAT_STRING:
+			if (IsStringView(key_type))
+			{
+				const clutl::StringView& view = *(const clutl::StringView*)key;
+				SaveEscapedString(out, view.data, view.data + view.length);
+			}
+			else
+			{
+				clcpp::ReadIterator reader(key_type->AsTemplateType(), key);
+				SaveCharContainer(out, reader);
+			}
+			break;
+
+		default:
+			clcpp::internal::Assert(false && "Unsupported key format");
+		}
+	}
+
+
+	void SaveDictionary(clutl::WriteBuffer& out, clcpp::ReadIterator& reader, const clcpp::Field* field, KeyFormat key_format, clutl::IPtrSave* ptr_save, const ParallelSave* parallel, unsigned int flags)
+	{
+		// Iterating keyed containers is cheap compared to looking up their values so they're saved serially
+		out.WriteChar('{');
+
+		bool written = false;
+		for (unsigned int i = 0; i < reader.m_Count; i++, reader.MoveNext())
+		{
+			clcpp::ContainerKeyValue kv = reader.GetKeyValue();
+			if (reader.m_ValueIsPtr)
+			{
+				// Ask the user if they want to save this pointer, before the key is written
+				void* ptr = *(void**)kv.value;
+				if (ptr_save == 0 || !ptr_save->CanSavePtr(ptr, field, reader.m_ValueType))
+					continue;
+			}
+
+			if (written)
+				out.WriteChar(',');
+
+			SaveKey(out, (const char*)kv.key, reader.m_KeyType, key_format, flags);
+			out.WriteChar(':');
+
+			if (reader.m_ValueIsPtr)
+				SavePtr(out, kv.value, ptr_save, flags);
+			else
+				SaveObject(out, (const char*)kv.value, field, reader.m_ValueType, ptr_save, parallel, flags);
+
+			written = true;
+		}
+
+		out.WriteChar('}');
+	}
+
+
+	void SaveTemplateType(clutl::WriteBuffer& out, const char* object, const clcpp::Field* field, const clcpp::TemplateType* template_type, clutl::IPtrSave* ptr_save, const ParallelSave* parallel, unsigned int flags)
 	{
 		// Construct a read iterator and leave early if there are no elements
 		clcpp::ReadIterator reader(template_type, object);
+		if (IsCharContainer(template_type))
+		{
+			SaveCharContainer(out, reader);
+			return;
+		}
+		KeyFormat key_format = GetKeyFormat(reader.m_KeyType, reader.m_KeyIsPtr);
+		if (key_format != KEY_FORMAT_NONE)
+		{
+			SaveDictionary(out, reader, field, key_format, ptr_save, parallel, flags);
+			return;
+		}
 		if (reader.m_Count == 0)
 		{
 			out.WriteStr("[]");
 			return;
 		}
 
-		SaveContainer(out, reader, field, ptr_save, flags);
+		SaveContainer(out, reader, field, ptr_save, parallel, flags);
 	}
 
 
-	void SaveObject(clutl::WriteBuffer& out, const char* object, const clcpp::Field* field, const clcpp::Type* type, clutl::IPtrSave* ptr_save, unsigned int flags)
+	void SaveObject(clutl::WriteBuffer& out, const char* object, const clcpp::Field* field, const clcpp::Type* type, clutl::IPtrSave* ptr_save, const ParallelSave* parallel, unsigned int flags)
 	{
 		// Dispatch to a save function based on kind
 		switch (type->kind)
@@ -933,11 +2052,11 @@ namespace
 			break;
 
 		case clcpp::Primitive::KIND_CLASS:
-			SaveClass(out, object, type->AsClass(), ptr_save, flags);
+			SaveClass(out, object, type->AsClass(), ptr_save, parallel, flags);
 			break;
 
 		case clcpp::Primitive::KIND_TEMPLATE_TYPE:
-			SaveTemplateType(out, object, field, type->AsTemplateType(), ptr_save, flags);
+			SaveTemplateType(out, object, field, type->AsTemplateType(), ptr_save, parallel, flags);
 			break;
 
 		default:
@@ -949,42 +2068,292 @@ namespace
 
 void clutl::SaveJSON(WriteBuffer& out, const void* object, const clcpp::Type* type, IPtrSave* ptr_save, unsigned int flags)
 {
-	SetupTypeDispatchLUT();
-	SaveObject(out, (char*)object, 0, type, ptr_save, flags);
+	SaveObject(out, (char*)object, 0, type, ptr_save, 0, flags);
+}
+
+
+void clutl::SaveJSON(WriteBuffer& out, const void* object, const clcpp::Type* type, IPtrSave* ptr_save, unsigned int flags, IParallelFor* parallel_for, unsigned int range_size)
+{
+	clcpp::internal::Assert(parallel_for != 0);
+	clcpp::internal::Assert(range_size != 0);
+
+	ParallelSave parallel;
+	parallel.parallel_for = parallel_for;
+	parallel.range_size = range_size;
+	SaveObject(out, (char*)object, 0, type, ptr_save, &parallel, flags);
 }
 
 
 void clutl::SaveJSON(WriteBuffer& out, const void* object, const clcpp::Field* field, IPtrSave* ptr_save, unsigned int flags)
 {
-	SetupTypeDispatchLUT();
-	SaveFieldObject(out, (char*)object, field, ptr_save, flags);
+	SaveFieldObject(out, (char*)object, field, ptr_save, 0, flags);
+}
+
+
+namespace
+{
+	// ----------------------------------------------------------------------------------------------------
+	// JSON Lines record iteration
+	// ----------------------------------------------------------------------------------------------------
+
+
+	// A range of whole lines in the input, loaded by one worker
+	struct JSONLinesRange
+	{
+		const char* start;
+		const char* end;
+
+		// Index and line number of the first record in the range
+		unsigned int first_record;
+		unsigned int first_line;
+
+		unsigned int nb_records;
+		unsigned int nb_lines;
+		unsigned int nb_loaded;
+		clutl::JSONError error;
+	};
+
+
+	struct JSONLinesLoad
+	{
+		const char* data;
+		const clcpp::Type* type;
+		clutl::IJSONLinesLoad* load;
+		clcpp::IAllocator* string_allocator;
+		JSONLinesRange* ranges;
+	};
+
+
+	const char* FindLineEnd(const char* pos, const char* end)
+	{
+		while (pos != end && *pos != '\n')
+			pos++;
+		return pos;
+	}
+
+
+	bool IsBlankLine(const char* pos, const char* end)
+	{
+		// Uses the same whitespace set as the lexer
+		for (; pos != end; pos++)
+		{
+			switch (*pos)
+			{
+			case ' ':
+			case '\t':
+			case '\v':
+			case '\f':
+			case '\r':
+				break;
+			default:
+				return false;
+			}
+		}
+		return true;
+	}
+
+
+	void CountJSONLines(void* data, unsigned int index)
+	{
+		JSONLinesRange& range = ((JSONLinesLoad*)data)->ranges[index];
+		for (const char* pos = range.start; pos < range.end; )
+		{
+			const char* line_end = FindLineEnd(pos, range.end);
+			if (!IsBlankLine(pos, line_end))
+				range.nb_records++;
+			if (line_end != range.end)
+				range.nb_lines++;
+			pos = line_end + 1;
+		}
+	}
+
+
+	void LoadJSONLinesRange(void* data, unsigned int index)
+	{
+		const JSONLinesLoad& lines = *(const JSONLinesLoad*)data;
+		JSONLinesRange& range = lines.ranges[index];
+
+		unsigned int line = range.first_line;
+		for (const char* pos = range.start; pos < range.end; line++)
+		{
+			const char* line_end = FindLineEnd(pos, range.end);
+			if (!IsBlankLine(pos, line_end))
+			{
+				// Each record is parsed in isolation, so an error can't run on into the next line
+				unsigned int record = range.first_record + range.nb_loaded;
+				char* object = (char*)lines.load->GetObject(record);
+				clutl::ReadBuffer read_buffer(pos, line_end - pos);
+				clutl::JSONContext ctx(read_buffer);
+				ctx.SetStringAllocator(lines.string_allocator);
+				clutl::JSONToken t = LexerNextToken(ctx);
+				ParserObject(ctx, t, object, object ? lines.type : 0);
+
+				range.error = ctx.GetError();
+				if (range.error.code != clutl::JSONError::NONE)
+				{
+					// Make the error relative to the entire input
+					range.error.position += pos - lines.data;
+					range.error.line = line;
+					return;
+				}
+
+				if (object != 0)
+					lines.load->RecordLoaded(record, object);
+				range.nb_loaded++;
+			}
+
+			pos = line_end + 1;
+		}
+	}
+
+
+	// Loads records into consecutive elements of an array
+	class JSONLinesArrayLoad : public clutl::IJSONLinesLoad
+	{
+	public:
+		JSONLinesArrayLoad(void* objects, unsigned int max_objects, unsigned int object_size)
+			: m_Objects((char*)objects)
+			, m_MaxObjects(max_objects)
+			, m_ObjectSize(object_size)
+		{
+		}
+
+		void* GetObject(unsigned int index)
+		{
+			if (index >= m_MaxObjects)
+				return 0;
+			return m_Objects + index * m_ObjectSize;
+		}
+
+	private:
+		char* m_Objects;
+		unsigned int m_MaxObjects;
+		unsigned int m_ObjectSize;
+	};
+
+
+	clutl::JSONError LoadJSONLinesRanges(clutl::ReadBuffer& in, const clcpp::Type* type, clutl::IJSONLinesLoad* load, clutl::IParallelFor* parallel_for, unsigned int range_size, clcpp::IAllocator* string_allocator, unsigned int& nb_loaded)
+	{
+		JSONLinesLoad lines;
+		lines.data = in.ReadAt(in.GetBytesRead());
+		lines.type = type;
+		lines.load = load;
+		lines.string_allocator = string_allocator;
+		const char* data_end = lines.data + in.GetBytesRemaining();
+		in.SeekRel(in.GetBytesRemaining());
+
+		// Split into ranges of at least range_size bytes, extended to the end of their last line
+		unsigned int nb_ranges = 1;
+		if (parallel_for != 0)
+		{
+			clcpp::internal::Assert(range_size != 0);
+			nb_ranges = (data_end - lines.data) / range_size + 1;
+		}
+		clutl::WriteBuffer range_buffer(nb_ranges * sizeof(JSONLinesRange));
+		lines.ranges = (JSONLinesRange*)range_buffer.Alloc(nb_ranges * sizeof(JSONLinesRange));
+		const char* pos = lines.data;
+		for (unsigned int i = 0; i < nb_ranges; i++)
+		{
+			JSONLinesRange& range = lines.ranges[i];
+			range.start = pos;
+			if (i == nb_ranges - 1 || (unsigned int)(data_end - pos) <= range_size)
+				pos = data_end;
+			else
+				pos = FindLineEnd(pos + range_size, data_end);
+			if (pos != data_end)
+				pos++;
+			range.end = pos;
+			range.first_record = 0;
+			range.first_line = 1;
+			range.nb_records = 0;
+			range.nb_lines = 0;
+			range.nb_loaded = 0;
+			range.error = clutl::JSONError();
+		}
+
+		if (parallel_for != 0)
+		{
+			// Count the records in each range so that record indices are known before loading
+			parallel_for->Run(CountJSONLines, &lines, nb_ranges);
+			for (unsigned int i = 1; i < nb_ranges; i++)
+			{
+				const JSONLinesRange& prev = lines.ranges[i - 1];
+				lines.ranges[i].first_record = prev.first_record + prev.nb_records;
+				lines.ranges[i].first_line = prev.first_line + prev.nb_lines;
+			}
+
+			parallel_for->Run(LoadJSONLinesRange, &lines, nb_ranges);
+		}
+		else
+		{
+			LoadJSONLinesRange(&lines, 0);
+		}
+
+		// Report the first error in the input
+		for (unsigned int i = 0; i < nb_ranges; i++)
+		{
+			const JSONLinesRange& range = lines.ranges[i];
+			nb_loaded = range.first_record + range.nb_loaded;
+			if (range.error.code != clutl::JSONError::NONE)
+				return range.error;
+		}
+
+		return clutl::JSONError();
+	}
+}
+
+
+clutl::JSONError clutl::LoadJSONLines(ReadBuffer& in, const clcpp::Type* type, IJSONLinesLoad* load, IParallelFor* parallel_for, unsigned int range_size, clcpp::IAllocator* string_allocator)
+{
+	unsigned int nb_loaded;
+	return LoadJSONLinesRanges(in, type, load, parallel_for, range_size, string_allocator, nb_loaded);
+}
+
+
+clutl::JSONError clutl::LoadJSONLines(ReadBuffer& in, void* objects, unsigned int max_objects, const clcpp::Type* type, unsigned int& nb_objects, IParallelFor* parallel_for, unsigned int range_size, clcpp::IAllocator* string_allocator)
+{
+	JSONLinesArrayLoad load(objects, max_objects, type->size);
+	JSONError error = LoadJSONLinesRanges(in, type, &load, parallel_for, range_size, string_allocator, nb_objects);
+	if (nb_objects > max_objects)
+		nb_objects = max_objects;
+	return error;
 }
 
 
-static void SetupTypeDispatchLUT()
+void clutl::SaveJSONLines(WriteBuffer& out, const void* objects, unsigned int nb_objects, const clcpp::Type* type, IPtrSave* ptr_save, unsigned int flags)
 {
-	if (!g_TypeDispatchLUTReady)
-	{
-		// Add all integers
-		AddTypeDispatch("bool", SaveIntegerWithCast<bool>, LoadIntegerBool, LoadDecimalBool);
-		AddTypeDispatch("char", SaveIntegerWithCast<char>, LoadIntegerWithCast<char>, LoadDecimalWithCast<char>);
-		AddTypeDispatch("wchar_t", SaveUnsignedIntegerWithCast<wchar_t>, LoadIntegerWithCast<wchar_t>, LoadDecimalWithCast<wchar_t>);
-		AddTypeDispatch("unsigned char", SaveUnsignedIntegerWithCast<unsigned char>, LoadIntegerWithCast<unsigned char>, LoadDecimalWithCast<unsigned char>);
-		AddTypeDispatch("short", SaveIntegerWithCast<short>, LoadIntegerWithCast<short>, LoadDecimalWithCast<short>);
-		AddTypeDispatch("unsigned short", SaveUnsignedIntegerWithCast<unsigned short>, LoadIntegerWithCast<unsigned short>, LoadDecimalWithCast<unsigned short>);
-		AddTypeDispatch("int", SaveIntegerWithCast<int>, LoadIntegerWithCast<int>, LoadDecimalWithCast<int>);
-		AddTypeDispatch("unsigned int", SaveUnsignedIntegerWithCast<unsigned int>, LoadIntegerWithCast<unsigned int>, LoadDecimalWithCast<unsigned int>);
-		AddTypeDispatch("long", SaveIntegerWithCast<long>, LoadIntegerWithCast<long>, LoadDecimalWithCast<long>);
-		AddTypeDispatch("unsigned long", SaveUnsignedIntegerWithCast<unsigned long>, LoadIntegerWithCast<unsigned long>, LoadDecimalWithCast<unsigned long>);
-		AddTypeDispatch("long long", SaveIntegerWithCast<long long>, LoadIntegerWithCast<long long>, LoadDecimalWithCast<long long>);
-		AddTypeDispatch("unsigned long long", SaveUnsignedIntegerWithCast<unsigned long long>, LoadIntegerWithCast<unsigned long long>, LoadDecimalWithCast<unsigned long long>);
-
-		// Add all decimals
-		AddTypeDispatch("float", SaveFloat, LoadIntegerWithCast<float>, LoadDecimalWithCast<float>);
-		AddTypeDispatch("double", SaveDouble, LoadIntegerWithCast<double>, LoadDecimalWithCast<double>);
-
-		g_TypeDispatchLUTReady = true;
+	flags &= ~JSONFlags::FORMAT_OUTPUT;
+	for (unsigned int i = 0; i < nb_objects; i++)
+	{
+		SaveObject(out, (const char*)objects + i * type->size, 0, type, ptr_save, 0, flags);
+		out.WriteChar('\n');
 	}
 }
 
 
+namespace
+{
+	const TypeDispatch g_TypeDispatchLUT[clcpp::BuiltinKind::COUNT] =
+	{
+		// Not a built-in type
+		{ 0, 0, 0 },
+
+		// Integers
+		{ SaveIntegerWithCast<bool>, LoadIntegerBool, LoadDecimalBool },
+		{ SaveIntegerWithCast<char>, LoadIntegerWithCast<char>, LoadDecimalWithCast<char> },
+		{ SaveUnsignedIntegerWithCast<wchar_t>, LoadIntegerWithCast<wchar_t>, LoadDecimalWithCast<wchar_t> },
+		{ SaveUnsignedIntegerWithCast<unsigned char>, LoadIntegerWithCast<unsigned char>, LoadDecimalWithCast<unsigned char> },
+		{ SaveIntegerWithCast<short>, LoadIntegerWithCast<short>, LoadDecimalWithCast<short> },
+		{ SaveUnsignedIntegerWithCast<unsigned short>, LoadIntegerWithCast<unsigned short>, LoadDecimalWithCast<unsigned short> },
+		{ SaveIntegerWithCast<int>, LoadIntegerWithCast<int>, LoadDecimalWithCast<int> },
+		{ SaveUnsignedIntegerWithCast<unsigned int>, LoadIntegerWithCast<unsigned int>, LoadDecimalWithCast<unsigned int> },
+		{ SaveIntegerWithCast<long>, LoadIntegerWithCast<long>, LoadDecimalWithCast<long> },
+		{ SaveUnsignedIntegerWithCast<unsigned long>, LoadIntegerWithCast<unsigned long>, LoadDecimalWithCast<unsigned long> },
+		{ SaveIntegerWithCast<long long>, LoadIntegerWithCast<long long>, LoadDecimalWithCast<long long> },
+		{ SaveUnsignedIntegerWithCast<unsigned long long>, LoadIntegerWithCast<unsigned long long>, LoadDecimalWithCast<unsigned long long> },
+
+		// Decimals
+		{ SaveFloat, LoadIntegerWithCast<float>, LoadDecimalWithCast<float> },
+		{ SaveDouble, LoadIntegerWithCast<double>, LoadDecimalWithCast<double> },
+	};
+}
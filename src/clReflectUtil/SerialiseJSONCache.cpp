@@ -0,0 +1,260 @@
+
+//
+// ===============================================================================
+// clReflect
+// -------------------------------------------------------------------------------
+// Copyright (c) 2011-2012 Don Williamson & clReflect Authors (see AUTHORS file)
+// Released under MIT License (see LICENSE file)
+// ===============================================================================
+//
+
+#include <clutl/Serialise.h>
+
+
+// Standard C library buffered file functions
+// http://pubs.opengroup.org/onlinepubs/009695399/functions/fopen.html
+extern "C" void* CLCPP_CDECL fopen(const char* filename, const char* mode);
+extern "C" clcpp::size_type CLCPP_CDECL fwrite(const void* ptr, clcpp::size_type size, clcpp::size_type count, void* stream);
+extern "C" int CLCPP_CDECL fclose(void* stream);
+extern "C" int CLCPP_CDECL remove(const char* filename);
+extern "C" int CLCPP_CDECL rename(const char* old_filename, const char* new_filename);
+
+
+namespace
+{
+	// Bump whenever the cache file layout or the versioned binary format changes
+	const unsigned int CACHE_SIGNATURE = 0x4E534A43;
+	const unsigned int CACHE_VERSION = 6;
+
+
+	struct CacheHeader
+	{
+		unsigned int signature;
+		unsigned int version;
+		unsigned int schema_fingerprint;
+		unsigned int json_size;
+		unsigned int json_hash[2];
+		unsigned int data_size;
+	};
+
+
+	void WriteFile(const char* filename, const clutl::WriteBuffer& in)
+	{
+		// Write to a temporary file first so that readers never see a partially written cache
+		clutl::WriteBuffer temp_filename;
+		temp_filename.WriteStr(filename);
+		temp_filename.WriteStr(".tmp");
+		temp_filename.WriteChar(0);
+
+		void* fp = fopen(temp_filename.GetData(), "wb");
+		if (fp == 0)
+			return;
+		bool written = fwrite(in.GetData(), 1, in.GetBytesWritten(), fp) == in.GetBytesWritten();
+		written &= fclose(fp) == 0;
+
+		if (written)
+		{
+		#if defined(CLCPP_PLATFORM_WINDOWS)
+			// Windows won't rename over an existing file
+			remove(filename);
+		#endif
+			if (rename(temp_filename.GetData(), filename) == 0)
+				return;
+		}
+
+		remove(temp_filename.GetData());
+	}
+
+
+	unsigned int CombineHash(unsigned int hash, unsigned int value)
+	{
+		return clcpp::internal::HashData(&value, sizeof(value), hash);
+	}
+
+
+	bool CalcSchemaFingerprint(const clcpp::Type* type, clutl::WriteBuffer& classes, unsigned int& hash)
+	{
+		hash = CombineHash(hash, type->kind);
+		hash = CombineHash(hash, type->name.hash);
+		hash = CombineHash(hash, type->size);
+
+		switch (type->kind)
+		{
+		case clcpp::Primitive::KIND_TYPE:
+			return true;
+
+		case clcpp::Primitive::KIND_ENUM:
+			{
+				// Enums are saved by constant name so their values are part of the schema
+				const clcpp::Enum* enum_type = type->AsEnum();
+				for (unsigned int i = 0; i < enum_type->constants.size; i++)
+				{
+					hash = CombineHash(hash, enum_type->constants[i]->name.hash);
+					hash = CombineHash(hash, enum_type->constants[i]->value);
+				}
+				return true;
+			}
+
+		case clcpp::Primitive::KIND_CLASS:
+			{
+				// Versioned binary ignores base classes and custom load/save functions so its
+				// results wouldn't match those of the JSON load
+				const clcpp::Class* class_type = type->AsClass();
+				if (class_type->base_types.size != 0)
+					return false;
+
+				// Classes already hashed, including those that contain themselves through containers,
+				// are referenced by the order in which they were first reached
+				const clcpp::Type** hashed = (const clcpp::Type**)classes.GetData();
+				unsigned int nb_hashed = classes.GetBytesWritten() / sizeof(type);
+				for (unsigned int i = 0; i < nb_hashed; i++)
+				{
+					if (hashed[i] == type)
+					{
+						hash = CombineHash(hash, i);
+						return true;
+					}
+				}
+				classes.Write(&type, sizeof(type));
+				if (class_type->flag_attributes & (clcpp::FlagAttribute::CUSTOM_LOAD | clcpp::FlagAttribute::CUSTOM_SAVE | clcpp::FlagAttribute::POST_LOAD))
+					return false;
+
+				for (unsigned int i = 0; i < class_type->fields.size; i++)
+				{
+					// Neither does it support pointers
+					const clcpp::Field* field = class_type->fields[i];
+					if (field->flag_attributes & clcpp::FlagAttribute::TRANSIENT)
+						continue;
+					if (field->qualifier.op != clcpp::Qualifier::VALUE)
+						return false;
+
+					hash = CombineHash(hash, field->name.hash);
+					hash = CombineHash(hash, field->offset);
+					if (field->ci != 0)
+						hash = CombineHash(hash, field->ci->count);
+					if (!CalcSchemaFingerprint(field->type, classes, hash))
+						return false;
+				}
+				return true;
+			}
+
+		case clcpp::Primitive::KIND_TEMPLATE_TYPE:
+			{
+				// Containers are loaded through their iterators and can only hold values
+				if (type->ci == 0)
+					return false;
+				const clcpp::TemplateType* template_type = type->AsTemplateType();
+				unsigned int nb_parameters = (type->ci->flags & clcpp::ContainerInfo::HAS_KEY) ? 2 : 1;
+				for (unsigned int i = 0; i < nb_parameters; i++)
+				{
+					const clcpp::Type* parameter_type = template_type->parameter_types[i];
+					if (parameter_type == 0 || template_type->parameter_ptrs[i])
+						return false;
+					if (!CalcSchemaFingerprint(parameter_type, classes, hash))
+						return false;
+				}
+				return true;
+			}
+
+		default:
+			return false;
+		}
+	}
+
+
+	void WriteHex(clutl::WriteBuffer& out, unsigned int value)
+	{
+		const char* digits = "0123456789abcdef";
+		for (int shift = 28; shift >= 0; shift -= 4)
+			out.WriteChar(digits[(value >> shift) & 0xF]);
+	}
+}
+
+
+clutl::JSONError clutl::LoadJSONCached(ReadBuffer& in, const char* cache_filename, void* object, const clcpp::Type* type, bool* loaded_from_cache)
+{
+	if (loaded_from_cache != 0)
+		*loaded_from_cache = false;
+
+	// Describe the cache file that matches this JSON and type
+	CacheHeader header;
+	header.signature = CACHE_SIGNATURE;
+	header.version = CACHE_VERSION;
+	header.schema_fingerprint = 0;
+	WriteBuffer hashed_classes;
+	bool can_cache = CalcSchemaFingerprint(type, hashed_classes, header.schema_fingerprint);
+	header.json_size = in.GetBytesRemaining();
+	const char* json = in.ReadAt(in.GetBytesRead());
+	header.json_hash[0] = clcpp::internal::HashData(json, header.json_size, 0);
+	header.json_hash[1] = clcpp::internal::HashData(json, header.json_size, 0x9E3779B9);
+	header.data_size = 0;
+
+	if (!can_cache)
+		return LoadJSON(in, object, type);
+
+	// Load straight from the cached binary if the JSON and the type are unchanged
+	MappedFile cache_file;
+	if (cache_file.Open(cache_filename) && cache_file.GetSize() >= sizeof(CacheHeader))
+	{
+		const CacheHeader& cache_header = *(const CacheHeader*)cache_file.GetData();
+		if (cache_header.signature == header.signature &&
+			cache_header.version == header.version &&
+			cache_header.schema_fingerprint == header.schema_fingerprint &&
+			cache_header.json_size == header.json_size &&
+			cache_header.json_hash[0] == header.json_hash[0] &&
+			cache_header.json_hash[1] == header.json_hash[1] &&
+			cache_header.data_size == cache_file.GetSize() - sizeof(CacheHeader))
+		{
+			// Caches that fail to load are rebuilt from the JSON
+			ReadBuffer data(cache_file.GetData() + sizeof(CacheHeader), cache_header.data_size);
+			if (LoadVersionedBinary(data, object, type) && data.GetBytesRemaining() == 0)
+			{
+				in.SeekRel(header.json_size);
+				if (loaded_from_cache != 0)
+					*loaded_from_cache = true;
+				return JSONError();
+			}
+		}
+	}
+
+	JSONError error = LoadJSON(in, object, type);
+	if (error.code != JSONError::NONE)
+		return error;
+
+	// Rebuild the cache from the loaded object, unmapping the old one so that it can be replaced
+	cache_file.Close();
+	WriteBuffer cache;
+	cache.Alloc(sizeof(CacheHeader));
+	SaveVersionedBinary(cache, object, type);
+	header.data_size = cache.GetBytesWritten() - sizeof(CacheHeader);
+	*(CacheHeader*)cache.GetData() = header;
+	WriteFile(cache_filename, cache);
+
+	return error;
+}
+
+
+clutl::JSONError clutl::LoadJSONCached(const char* json_filename, const char* cache_dir, void* object, const clcpp::Type* type, bool* loaded_from_cache)
+{
+	if (loaded_from_cache != 0)
+		*loaded_from_cache = false;
+
+	MappedFile json;
+	if (!json.Open(json_filename))
+	{
+		JSONError error;
+		error.code = JSONError::FILE_READ_FAILED;
+		return error;
+	}
+
+	// Each JSON file gets a cache file for each type it's loaded as
+	WriteBuffer cache_filename;
+	cache_filename.WriteStr(cache_dir);
+	cache_filename.WriteChar('/');
+	WriteHex(cache_filename, clcpp::internal::HashNameString(json_filename, type->name.hash));
+	cache_filename.WriteStr(".jsonbin");
+	cache_filename.WriteChar(0);
+
+	ReadBuffer in(json);
+	return LoadJSONCached(in, cache_filename.GetData(), object, type, loaded_from_cache);
+}
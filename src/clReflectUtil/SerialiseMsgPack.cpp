@@ -0,0 +1,1098 @@
+
+//
+// ===============================================================================
+// clReflect
+// -------------------------------------------------------------------------------
+// Copyright (c) 2011-2012 Don Williamson & clReflect Authors (see AUTHORS file)
+// Released under MIT License (see LICENSE file)
+// ===============================================================================
+//
+
+// MessagePack format specification: https://github.com/msgpack/msgpack/blob/master/spec.md
+
+#include "SerialiseInternal.h"
+
+#include <clutl/Serialise.h>
+#include <clutl/JSONLexer.h>
+#include <clcpp/Containers.h>
+#include <clcpp/FunctionCall.h>
+
+
+// Custom load/save functions are shared with JSON, exchanging values through JSON tokens
+using namespace clutl::internal;
+
+
+namespace
+{
+	// ----------------------------------------------------------------------------------------------------
+	// Type queries shared by the loader and saver
+	// ----------------------------------------------------------------------------------------------------
+
+
+	const clcpp::Function* FindAttributeFunction(const clcpp::Class* class_type, unsigned int hash)
+	{
+		const clcpp::Attribute* attr = clcpp::FindPrimitive(class_type->attributes, hash);
+		if (attr == 0)
+			return 0;
+		return (const clcpp::Function*)attr->AsPrimitiveAttribute()->primitive;
+	}
+
+
+	// ----------------------------------------------------------------------------------------------------
+	// MessagePack parser & reflection-based object construction
+	// ----------------------------------------------------------------------------------------------------
+
+
+	// Arrays and maps nested any deeper than this fail to load, so that malformed data can't overflow the stack
+	const unsigned int MAX_NESTING_DEPTH = 256;
+
+
+	struct Reader
+	{
+		const unsigned char* start;
+		const unsigned char* pos;
+		const unsigned char* end;
+		clutl::MsgPackError error;
+		clutl::PtrFixups* ptr_fixups;
+		unsigned int depth;
+	};
+
+
+	// A decoded value header; strings, binary and extension data are consumed with it
+	struct Value
+	{
+		enum Kind { NIL, BOOL, UINT, INT, FLOAT, STR, BIN, EXT, ARRAY, MAP };
+
+		Kind kind;
+		clcpp::uint64 uinteger;
+		clcpp::int64 integer;
+		double decimal;
+		const char* data;
+		unsigned int length;
+	};
+
+
+	bool SetError(Reader& r, clutl::MsgPackError::Code code)
+	{
+		// Record the first error only and stop any further reads
+		if (r.error.code == clutl::MsgPackError::NONE)
+		{
+			r.error.code = code;
+			r.error.position = (unsigned int)(r.pos - r.start);
+		}
+		r.pos = r.end;
+		return false;
+	}
+
+
+	bool ReadBigEndian(Reader& r, unsigned int nb_bytes, clcpp::uint64& value)
+	{
+		if ((unsigned int)(r.end - r.pos) < nb_bytes)
+			return SetError(r, clutl::MsgPackError::UNEXPECTED_END_OF_DATA);
+
+		value = 0;
+		for (unsigned int i = 0; i < nb_bytes; i++)
+			value = (value << 8) | *r.pos++;
+		return true;
+	}
+
+
+	bool ReadData(Reader& r, Value& v, unsigned int length_bytes, bool has_ext_type)
+	{
+		clcpp::uint64 length = v.length;
+		if (length_bytes != 0 && !ReadBigEndian(r, length_bytes, length))
+			return false;
+
+		// Extension type codes aren't interpreted
+		if (has_ext_type)
+			length++;
+
+		if ((clcpp::uint64)(r.end - r.pos) < length)
+			return SetError(r, clutl::MsgPackError::UNEXPECTED_END_OF_DATA);
+
+		v.data = (const char*)r.pos + (has_ext_type ? 1 : 0);
+		v.length = (unsigned int)length - (has_ext_type ? 1 : 0);
+		r.pos += length;
+		return true;
+	}
+
+
+	bool ReadCount(Reader& r, Value& v, unsigned int count_bytes, unsigned int nb_values_per_entry)
+	{
+		clcpp::uint64 count = v.length;
+		if (count_bytes != 0 && !ReadBigEndian(r, count_bytes, count))
+			return false;
+
+		// Each value needs at least one byte, catching bad counts before containers are sized by them
+		if (count * nb_values_per_entry > (clcpp::uint64)(r.end - r.pos))
+			return SetError(r, clutl::MsgPackError::UNEXPECTED_END_OF_DATA);
+
+		v.length = (unsigned int)count;
+		return true;
+	}
+
+
+	bool ReadValue(Reader& r, Value& v)
+	{
+		if (r.pos >= r.end)
+			return SetError(r, clutl::MsgPackError::UNEXPECTED_END_OF_DATA);
+
+		v.length = 0;
+		v.data = 0;
+		unsigned char c = *r.pos++;
+
+		// Fixed size formats first
+		if (c <= 0x7F)
+		{
+			v.kind = Value::UINT;
+			v.uinteger = c;
+			return true;
+		}
+		if (c >= 0xE0)
+		{
+			v.kind = Value::INT;
+			v.integer = (signed char)c;
+			return true;
+		}
+		if (c <= 0x8F)
+		{
+			v.kind = Value::MAP;
+			v.length = c & 0x0F;
+			return ReadCount(r, v, 0, 2);
+		}
+		if (c <= 0x9F)
+		{
+			v.kind = Value::ARRAY;
+			v.length = c & 0x0F;
+			return ReadCount(r, v, 0, 1);
+		}
+		if (c <= 0xBF)
+		{
+			v.kind = Value::STR;
+			v.length = c & 0x1F;
+			return ReadData(r, v, 0, false);
+		}
+
+		switch (c)
+		{
+		case 0xC0: v.kind = Value::NIL; return true;
+		case 0xC2: v.kind = Value::BOOL; v.uinteger = 0; return true;
+		case 0xC3: v.kind = Value::BOOL; v.uinteger = 1; return true;
+
+		case 0xC4: v.kind = Value::BIN; return ReadData(r, v, 1, false);
+		case 0xC5: v.kind = Value::BIN; return ReadData(r, v, 2, false);
+		case 0xC6: v.kind = Value::BIN; return ReadData(r, v, 4, false);
+		case 0xC7: v.kind = Value::EXT; return ReadData(r, v, 1, true);
+		case 0xC8: v.kind = Value::EXT; return ReadData(r, v, 2, true);
+		case 0xC9: v.kind = Value::EXT; return ReadData(r, v, 4, true);
+
+		case 0xCA:
+			{
+				clcpp::uint64 bits;
+				if (!ReadBigEndian(r, 4, bits))
+					return false;
+				union { unsigned int u; float f; } value;
+				value.u = (unsigned int)bits;
+				v.kind = Value::FLOAT;
+				v.decimal = value.f;
+				return true;
+			}
+		case 0xCB:
+			{
+				union { clcpp::uint64 u; double d; } value;
+				if (!ReadBigEndian(r, 8, value.u))
+					return false;
+				v.kind = Value::FLOAT;
+				v.decimal = value.d;
+				return true;
+			}
+
+		case 0xCC: v.kind = Value::UINT; return ReadBigEndian(r, 1, v.uinteger);
+		case 0xCD: v.kind = Value::UINT; return ReadBigEndian(r, 2, v.uinteger);
+		case 0xCE: v.kind = Value::UINT; return ReadBigEndian(r, 4, v.uinteger);
+		case 0xCF: v.kind = Value::UINT; return ReadBigEndian(r, 8, v.uinteger);
+
+		case 0xD0: case 0xD1: case 0xD2: case 0xD3:
+			{
+				// Sign-extend from the encoded size
+				unsigned int nb_bytes = 1 << (c - 0xD0);
+				clcpp::uint64 bits;
+				if (!ReadBigEndian(r, nb_bytes, bits))
+					return false;
+				unsigned int shift = 64 - nb_bytes * 8;
+				v.kind = Value::INT;
+				v.integer = (clcpp::int64)(bits << shift) >> shift;
+				return true;
+			}
+
+		case 0xD4: case 0xD5: case 0xD6: case 0xD7: case 0xD8:
+			v.kind = Value::EXT;
+			v.length = 1 << (c - 0xD4);
+			return ReadData(r, v, 0, true);
+
+		case 0xD9: v.kind = Value::STR; return ReadData(r, v, 1, false);
+		case 0xDA: v.kind = Value::STR; return ReadData(r, v, 2, false);
+		case 0xDB: v.kind = Value::STR; return ReadData(r, v, 4, false);
+		case 0xDC: v.kind = Value::ARRAY; return ReadCount(r, v, 2, 1);
+		case 0xDD: v.kind = Value::ARRAY; return ReadCount(r, v, 4, 1);
+		case 0xDE: v.kind = Value::MAP; return ReadCount(r, v, 2, 2);
+		case 0xDF: v.kind = Value::MAP; return ReadCount(r, v, 4, 2);
+		}
+
+		// 0xC1 is never used
+		r.pos--;
+		return SetError(r, clutl::MsgPackError::INVALID_FORMAT);
+	}
+
+
+	bool EnterValue(Reader& r, const Value& v)
+	{
+		if (v.kind != Value::ARRAY && v.kind != Value::MAP)
+			return true;
+		if (r.depth == MAX_NESTING_DEPTH)
+			return SetError(r, clutl::MsgPackError::NESTING_TOO_DEEP);
+		r.depth++;
+		return true;
+	}
+
+
+	void LeaveValue(Reader& r, const Value& v)
+	{
+		if (v.kind == Value::ARRAY || v.kind == Value::MAP)
+			r.depth--;
+	}
+
+
+	void SkipValue(Reader& r);
+
+
+	void SkipContents(Reader& r, const Value& v)
+	{
+		unsigned int nb_values = v.kind == Value::ARRAY ? v.length : v.kind == Value::MAP ? v.length * 2 : 0;
+		for (unsigned int i = 0; i < nb_values && r.error.code == clutl::MsgPackError::NONE; i++)
+			SkipValue(r);
+	}
+
+
+	void SkipValue(Reader& r)
+	{
+		Value v;
+		if (ReadValue(r, v) && EnterValue(r, v))
+		{
+			SkipContents(r, v);
+			LeaveValue(r, v);
+		}
+	}
+
+
+	template <typename TYPE>
+	void LoadIntegerWithCast(char* dest, clcpp::int64 integer)
+	{
+		*(TYPE*)dest = (TYPE)integer;
+	}
+
+
+	template <typename TYPE>
+	void LoadDecimalWithCast(char* dest, double decimal)
+	{
+		*(TYPE*)dest = (TYPE)decimal;
+	}
+
+
+	void LoadInteger(char* object, const clcpp::Type* type, clcpp::int64 integer)
+	{
+		switch (type->builtin_kind)
+		{
+		case clcpp::BuiltinKind::BOOL: *(bool*)object = integer != 0; break;
+		case clcpp::BuiltinKind::CHAR: LoadIntegerWithCast<char>(object, integer); break;
+		case clcpp::BuiltinKind::WCHAR_T: LoadIntegerWithCast<wchar_t>(object, integer); break;
+		case clcpp::BuiltinKind::UNSIGNED_CHAR: LoadIntegerWithCast<unsigned char>(object, integer); break;
+		case clcpp::BuiltinKind::SHORT: LoadIntegerWithCast<short>(object, integer); break;
+		case clcpp::BuiltinKind::UNSIGNED_SHORT: LoadIntegerWithCast<unsigned short>(object, integer); break;
+		case clcpp::BuiltinKind::INT: LoadIntegerWithCast<int>(object, integer); break;
+		case clcpp::BuiltinKind::UNSIGNED_INT: LoadIntegerWithCast<unsigned int>(object, integer); break;
+		case clcpp::BuiltinKind::LONG: LoadIntegerWithCast<long>(object, integer); break;
+		case clcpp::BuiltinKind::UNSIGNED_LONG: LoadIntegerWithCast<unsigned long>(object, integer); break;
+		case clcpp::BuiltinKind::LONG_LONG: LoadIntegerWithCast<clcpp::int64>(object, integer); break;
+		case clcpp::BuiltinKind::UNSIGNED_LONG_LONG: LoadIntegerWithCast<clcpp::uint64>(object, integer); break;
+		case clcpp::BuiltinKind::FLOAT: LoadDecimalWithCast<float>(object, (double)integer); break;
+		case clcpp::BuiltinKind::DOUBLE: LoadDecimalWithCast<double>(object, (double)integer); break;
+		default: break;
+		}
+	}
+
+
+	void LoadDecimal(char* object, const clcpp::Type* type, double decimal)
+	{
+		switch (type->builtin_kind)
+		{
+		case clcpp::BuiltinKind::FLOAT: LoadDecimalWithCast<float>(object, decimal); break;
+		case clcpp::BuiltinKind::DOUBLE: LoadDecimalWithCast<double>(object, decimal); break;
+		case clcpp::BuiltinKind::NONE: break;
+		default: LoadInteger(object, type, (clcpp::int64)decimal); break;
+		}
+	}
+
+
+	clcpp::int64 GetInteger(const Value& v)
+	{
+		return v.kind == Value::INT ? v.integer : (clcpp::int64)v.uinteger;
+	}
+
+
+	void LoadPtr(Reader& r, char* object, unsigned int hash, const clcpp::Type* type)
+	{
+		// Pointers are loaded as the hash they were saved with, either to be patched later or
+		// left for the caller to patch
+		if (r.ptr_fixups != 0)
+			r.ptr_fixups->AddPtr((void**)object, hash, type);
+		else
+			*(void**)object = (void*)(clcpp::pointer_type)hash;
+	}
+
+
+	const clcpp::EnumConstant* FindEnumConstant(const Value& v, const clcpp::Type* type)
+	{
+		unsigned int constant_hash = clcpp::internal::HashData(v.data, v.length);
+		return clcpp::FindPrimitive(type->AsEnum()->constants, constant_hash);
+	}
+
+
+	void LoadValue(Reader& r, char* object, const clcpp::Type* type, clcpp::Qualifier::Operator op, const clcpp::Field* field);
+
+
+	void LoadCharContainer(const Value& v, char* object, const clcpp::TemplateType* type)
+	{
+		clcpp::WriteIterator writer;
+		writer.Initialise(type, object, v.length);
+		if (!writer.IsInitialised())
+			return;
+
+		if (char* dest = writer.m_Span.data)
+		{
+			for (unsigned int i = 0; i < v.length; i++, dest += writer.m_Span.stride)
+				*dest = v.data[i];
+		}
+		else
+		{
+			for (unsigned int i = 0; i < v.length; i++)
+				*(char*)writer.AddEmpty() = v.data[i];
+		}
+	}
+
+
+	void LoadString(const Value& v, char* object, const clcpp::Type* type)
+	{
+		if (type->kind == clcpp::Primitive::KIND_ENUM)
+		{
+			if (const clcpp::EnumConstant* constant = FindEnumConstant(v, type))
+				*(int*)object = constant->value;
+		}
+
+		else if (IsStringView(type))
+		{
+			// Strings need no decoding so views can always point into the input
+			clutl::StringView& view = *(clutl::StringView*)object;
+			view.data = v.data;
+			view.length = v.length;
+		}
+
+		else if (IsCharContainer(type))
+		{
+			LoadCharContainer(v, object, type->AsTemplateType());
+		}
+	}
+
+
+	void LoadArray(Reader& r, const Value& v, char* object, const clcpp::Type* type, const clcpp::Field* field)
+	{
+		// Fields are fixed array iterators and template types are dynamic container iterators
+		clcpp::WriteIterator writer;
+		if (field && field->ci)
+			writer.Initialise(field, object);
+		else if (type->ci && !(type->ci->flags & clcpp::ContainerInfo::HAS_KEY))
+			writer.Initialise(type->AsTemplateType(), object, v.length);
+
+		if (!writer.IsInitialised())
+		{
+			SkipContents(r, v);
+			return;
+		}
+
+		// Prefer writing straight into contiguous memory, skipping values beyond the container's capacity
+		clcpp::Qualifier::Operator op = writer.m_ValueIsPtr ? clcpp::Qualifier::POINTER : clcpp::Qualifier::VALUE;
+		char* values = 0;
+		unsigned int stride = 0;
+		if (writer.m_Span.data != 0)
+		{
+			values = writer.m_Span.data;
+			stride = writer.m_Span.stride;
+		}
+		else if ((values = (char*)writer.AddEmptyRange(writer.m_Count)) != 0)
+		{
+			stride = op == clcpp::Qualifier::POINTER ? sizeof(void*) : writer.m_ValueType->size;
+		}
+
+		for (unsigned int i = 0; i < v.length && r.error.code == clutl::MsgPackError::NONE; i++)
+		{
+			if (values == 0)
+				LoadValue(r, (char*)writer.AddEmpty(), writer.m_ValueType, op, 0);
+			else if (i < (unsigned int)writer.m_Count)
+				LoadValue(r, values + i * stride, writer.m_ValueType, op, 0);
+			else
+				SkipValue(r);
+		}
+	}
+
+
+	bool LoadKey(const Value& key, char* key_data, const clcpp::Type* key_type, KeyFormat key_format)
+	{
+		switch (key_format)
+		{
+		case KEY_FORMAT_INTEGER:
+			if (key.kind != Value::UINT && key.kind != Value::INT)
+				return false;
+			LoadInteger(key_data, key_type, GetInteger(key));
+			return true;
+
+		case KEY_FORMAT_ENUM:
+			if (key.kind == Value::STR)
+			{
+				if (const clcpp::EnumConstant* constant = FindEnumConstant(key, key_type))
+				{
+					*(int*)key_data = constant->value;
+					return true;
+				}
+			}
+			return false;
+
+		case KEY_FORMAT_STRING:
+			{
+				// Both StringView keys and the views given to string containers point into the input
+				if (key.kind != Value::STR)
+					return false;
+				clutl::StringView& view = *(clutl::StringView*)key_data;
+				view.data = key.data;
+				view.length = key.length;
+				return true;
+			}
+
+		default:
+			return false;
+		}
+	}
+
+
+	void LoadDictionary(Reader& r, const Value& v, char* object, const clcpp::TemplateType* type)
+	{
+		clcpp::WriteIterator writer;
+		writer.Initialise(type, object, v.length);
+		if (!writer.IsInitialised())
+		{
+			SkipContents(r, v);
+			return;
+		}
+
+		KeyFormat key_format = GetKeyFormat(writer.m_KeyType, writer.m_KeyIsPtr);
+		clcpp::Qualifier::Operator op = writer.m_ValueIsPtr ? clcpp::Qualifier::POINTER : clcpp::Qualifier::VALUE;
+
+		// Aligned storage big enough for any supported key
+		clcpp::uint64 key_data[2];
+
+		for (unsigned int i = 0; i < v.length && r.error.code == clutl::MsgPackError::NONE; i++)
+		{
+			Value key;
+			if (!ReadValue(r, key))
+				return;
+
+			// Skip values with keys that can't be converted
+			if (LoadKey(key, (char*)key_data, writer.m_KeyType, key_format))
+			{
+				LoadValue(r, (char*)writer.AddEmpty(key_data), writer.m_ValueType, op, 0);
+			}
+			else
+			{
+				SkipContents(r, key);
+				SkipValue(r);
+			}
+		}
+	}
+
+
+	void CallPostLoad(char* object, const clcpp::Class* class_type)
+	{
+		if (class_type->flag_attributes & clcpp::FlagAttribute::POST_LOAD)
+		{
+			if (const clcpp::Function* function = FindAttributeFunction(class_type, g_PostLoadHash))
+				clcpp::CallFunction(function, object);
+		}
+	}
+
+
+	void LoadClass(Reader& r, const Value& v, char* object, const clcpp::Class* class_type)
+	{
+		for (unsigned int i = 0; i < v.length && r.error.code == clutl::MsgPackError::NONE; i++)
+		{
+			// Fields are keyed by either name or name hash
+			Value key;
+			if (!ReadValue(r, key))
+				return;
+			const clcpp::Field* field = 0;
+			if (key.kind == Value::STR)
+				field = FindFieldsRecursive(class_type, clcpp::internal::HashData(key.data, key.length));
+			else if (key.kind == Value::UINT)
+				field = FindFieldsRecursive(class_type, (unsigned int)key.uinteger);
+			else
+				SkipContents(r, key);
+
+			// Don't load values for transient fields
+			if (field && !(field->flag_attributes & clcpp::FlagAttribute::TRANSIENT))
+				LoadValue(r, object + field->offset, field->type, field->qualifier.op, field);
+			else
+				SkipValue(r);
+		}
+
+		CallPostLoad(object, class_type);
+	}
+
+
+	bool CallCustomLoad(Reader& r, const Value& v, char* object, const clcpp::Type* type)
+	{
+		if (type->kind != clcpp::Primitive::KIND_CLASS)
+			return false;
+		const clcpp::Class* class_type = type->AsClass();
+		if (!(class_type->flag_attributes & clcpp::FlagAttribute::CUSTOM_LOAD))
+			return false;
+		const clcpp::Function* function = FindAttributeFunction(class_type, g_LoadJSONHash);
+		if (function == 0)
+			return false;
+
+		// Only scalars can be passed through a token
+		clutl::JSONToken t;
+		switch (v.kind)
+		{
+		case Value::NIL: t.type = clutl::JSON_TOKEN_NULL; break;
+		case Value::BOOL: t.type = v.uinteger ? clutl::JSON_TOKEN_TRUE : clutl::JSON_TOKEN_FALSE; break;
+		case Value::UINT: case Value::INT: t.type = clutl::JSON_TOKEN_INTEGER; t.val.integer = GetInteger(v); break;
+		case Value::FLOAT: t.type = clutl::JSON_TOKEN_DECIMAL; t.val.decimal = v.decimal; break;
+		case Value::STR: t.type = clutl::JSON_TOKEN_STRING; t.val.string = v.data; t.length = v.length; break;
+		default: SkipContents(r, v); return true;
+		}
+
+		clcpp::CallFunction(function, clcpp::ByRef(t), object);
+		return true;
+	}
+
+
+	void LoadValue(Reader& r, const Value& v, char* object, const clcpp::Type* type, clcpp::Qualifier::Operator op, const clcpp::Field* field)
+	{
+		// Skip the data of anything that can't be loaded
+		if (object == 0 || type == 0)
+		{
+			SkipContents(r, v);
+			return;
+		}
+
+		// Custom load functions consume the current value and nothing more
+		if (op != clcpp::Qualifier::POINTER && CallCustomLoad(r, v, object, type))
+			return;
+
+		switch (v.kind)
+		{
+		case Value::NIL:
+			if (op == clcpp::Qualifier::POINTER)
+				LoadPtr(r, object, 0, type);
+			break;
+
+		case Value::BOOL:
+		case Value::UINT:
+		case Value::INT:
+			if (op == clcpp::Qualifier::POINTER)
+				LoadPtr(r, object, (unsigned int)GetInteger(v), type);
+			else if (type->kind == clcpp::Primitive::KIND_TYPE)
+				LoadInteger(object, type, GetInteger(v));
+			break;
+
+		case Value::FLOAT:
+			if (op != clcpp::Qualifier::POINTER && type->kind == clcpp::Primitive::KIND_TYPE)
+				LoadDecimal(object, type, v.decimal);
+			break;
+
+		case Value::STR:
+			if (op != clcpp::Qualifier::POINTER)
+				LoadString(v, object, type);
+			break;
+
+		case Value::ARRAY:
+			LoadArray(r, v, object, type, field);
+			break;
+
+		case Value::MAP:
+			// Keyed containers and classes are both loaded from maps
+			if (type->ci && (type->ci->flags & clcpp::ContainerInfo::HAS_KEY))
+				LoadDictionary(r, v, object, type->AsTemplateType());
+			else if (type->kind == clcpp::Primitive::KIND_CLASS && op != clcpp::Qualifier::POINTER)
+				LoadClass(r, v, object, type->AsClass());
+			else
+				SkipContents(r, v);
+			break;
+
+		// Binary and extension data is ignored
+		default:
+			break;
+		}
+	}
+
+
+	void LoadValue(Reader& r, char* object, const clcpp::Type* type, clcpp::Qualifier::Operator op, const clcpp::Field* field)
+	{
+		Value v;
+		if (ReadValue(r, v) && EnterValue(r, v))
+		{
+			LoadValue(r, v, object, type, op, field);
+			LeaveValue(r, v);
+		}
+	}
+}
+
+
+clutl::MsgPackError clutl::LoadMsgPack(ReadBuffer& in, void* object, const clcpp::Type* type, PtrFixups* ptr_fixups)
+{
+	Reader r;
+	r.start = (const unsigned char*)in.ReadAt(0);
+	r.pos = r.start + in.GetBytesRead();
+	r.end = r.pos + in.GetBytesRemaining();
+	r.ptr_fixups = ptr_fixups;
+	r.depth = 0;
+
+	LoadValue(r, (char*)object, type, clcpp::Qualifier::VALUE, 0);
+
+	in.SeekRel((int)(r.pos - (r.start + in.GetBytesRead())));
+	return r.error;
+}
+
+
+namespace
+{
+	// ----------------------------------------------------------------------------------------------------
+	// MessagePack writer & reflection-based object serialisation
+	// ----------------------------------------------------------------------------------------------------
+
+
+	void SaveObject(clutl::WriteBuffer& out, const char* object, const clcpp::Field* field, const clcpp::Type* type, clutl::IPtrSave* ptr_save, unsigned int flags);
+
+
+	void SaveBigEndian(clutl::WriteBuffer& out, unsigned char marker, clcpp::uint64 value, unsigned int nb_bytes)
+	{
+		unsigned char* data = (unsigned char*)out.Alloc(nb_bytes + 1);
+		data[0] = marker;
+		for (unsigned int i = nb_bytes; i > 0; i--, value >>= 8)
+			data[i] = (unsigned char)value;
+	}
+
+
+	void SaveUnsignedInteger(clutl::WriteBuffer& out, clcpp::uint64 integer)
+	{
+		// Use the smallest encoding
+		if (integer < 0x80)
+			out.WriteChar((char)integer);
+		else if (integer <= 0xFF)
+			SaveBigEndian(out, 0xCC, integer, 1);
+		else if (integer <= 0xFFFF)
+			SaveBigEndian(out, 0xCD, integer, 2);
+		else if (integer <= 0xFFFFFFFF)
+			SaveBigEndian(out, 0xCE, integer, 4);
+		else
+			SaveBigEndian(out, 0xCF, integer, 8);
+	}
+
+
+	void SaveInteger(clutl::WriteBuffer& out, clcpp::int64 integer)
+	{
+		if (integer >= 0)
+			SaveUnsignedInteger(out, integer);
+		else if (integer >= -32)
+			out.WriteChar((char)integer);
+		else if (integer >= -128)
+			SaveBigEndian(out, 0xD0, integer, 1);
+		else if (integer >= -32768)
+			SaveBigEndian(out, 0xD1, integer, 2);
+		else if (integer >= -2147483647 - 1)
+			SaveBigEndian(out, 0xD2, integer, 4);
+		else
+			SaveBigEndian(out, 0xD3, integer, 8);
+	}
+
+
+	void SaveFloat(clutl::WriteBuffer& out, float decimal)
+	{
+		union { float f; unsigned int u; } value;
+		value.f = decimal;
+		SaveBigEndian(out, 0xCA, value.u, 4);
+	}
+
+
+	void SaveDouble(clutl::WriteBuffer& out, double decimal)
+	{
+		union { double d; clcpp::uint64 u; } value;
+		value.d = decimal;
+		SaveBigEndian(out, 0xCB, value.u, 8);
+	}
+
+
+	void SaveHeader(clutl::WriteBuffer& out, unsigned int count, unsigned char fix_marker, unsigned int fix_max, unsigned char marker16, unsigned char marker32)
+	{
+		if (count <= fix_max)
+			out.WriteChar((char)(fix_marker | count));
+		else if (count <= 0xFFFF)
+			SaveBigEndian(out, marker16, count, 2);
+		else
+			SaveBigEndian(out, marker32, count, 4);
+	}
+
+
+	void SaveString(clutl::WriteBuffer& out, const char* data, unsigned int length)
+	{
+		if (length <= 0x1F)
+			out.WriteChar((char)(0xA0 | length));
+		else if (length <= 0xFF)
+			SaveBigEndian(out, 0xD9, length, 1);
+		else if (length <= 0xFFFF)
+			SaveBigEndian(out, 0xDA, length, 2);
+		else
+			SaveBigEndian(out, 0xDB, length, 4);
+		out.Write(data, length);
+	}
+
+
+	void SaveString(clutl::WriteBuffer& out, const char* str)
+	{
+		unsigned int length = 0;
+		while (str[length] != 0)
+			length++;
+		SaveString(out, str, length);
+	}
+
+
+	void SaveArrayHeader(clutl::WriteBuffer& out, unsigned int count)
+	{
+		SaveHeader(out, count, 0x90, 0x0F, 0xDC, 0xDD);
+	}
+
+
+	void SaveMapHeader(clutl::WriteBuffer& out, unsigned int count)
+	{
+		SaveHeader(out, count, 0x80, 0x0F, 0xDE, 0xDF);
+	}
+
+
+	void SaveType(clutl::WriteBuffer& out, const char* object, const clcpp::Type* type)
+	{
+		switch (type->builtin_kind)
+		{
+		case clcpp::BuiltinKind::BOOL: out.WriteChar(*(const bool*)object ? (char)0xC3 : (char)0xC2); break;
+		case clcpp::BuiltinKind::CHAR: SaveInteger(out, *(const char*)object); break;
+		case clcpp::BuiltinKind::WCHAR_T: SaveInteger(out, *(const wchar_t*)object); break;
+		case clcpp::BuiltinKind::UNSIGNED_CHAR: SaveUnsignedInteger(out, *(const unsigned char*)object); break;
+		case clcpp::BuiltinKind::SHORT: SaveInteger(out, *(const short*)object); break;
+		case clcpp::BuiltinKind::UNSIGNED_SHORT: SaveUnsignedInteger(out, *(const unsigned short*)object); break;
+		case clcpp::BuiltinKind::INT: SaveInteger(out, *(const int*)object); break;
+		case clcpp::BuiltinKind::UNSIGNED_INT: SaveUnsignedInteger(out, *(const unsigned int*)object); break;
+		case clcpp::BuiltinKind::LONG: SaveInteger(out, *(const long*)object); break;
+		case clcpp::BuiltinKind::UNSIGNED_LONG: SaveUnsignedInteger(out, *(const unsigned long*)object); break;
+		case clcpp::BuiltinKind::LONG_LONG: SaveInteger(out, *(const clcpp::int64*)object); break;
+		case clcpp::BuiltinKind::UNSIGNED_LONG_LONG: SaveUnsignedInteger(out, *(const clcpp::uint64*)object); break;
+		case clcpp::BuiltinKind::FLOAT: SaveFloat(out, *(const float*)object); break;
+		case clcpp::BuiltinKind::DOUBLE: SaveDouble(out, *(const double*)object); break;
+		default: clcpp::internal::Assert(false && "No save function for type");
+		}
+	}
+
+
+	void SaveEnum(clutl::WriteBuffer& out, const char* object, const clcpp::Enum* enum_type)
+	{
+		// Do a linear search for an enum with a matching value
+		int value = *(int*)object;
+		const char* enum_name = "clReflect_MsgPack_EnumValueNotFound";
+		for (unsigned int i = 0; i < enum_type->constants.size; i++)
+		{
+			if (enum_type->constants[i]->value == value)
+			{
+				enum_name = enum_type->constants[i]->name.text;
+				break;
+			}
+		}
+
+		// Write the enum name as the value
+		SaveString(out, enum_name);
+	}
+
+
+	void SavePtr(clutl::WriteBuffer& out, const void* object, const clcpp::Field* field, const clcpp::Type* type, clutl::IPtrSave* ptr_save)
+	{
+		// The number of values in each array/map is written first so pointers that aren't saved are null
+		void* ptr = *(void**)object;
+		if (ptr_save == 0 || !ptr_save->CanSavePtr(ptr, field, type))
+			out.WriteChar((char)0xC0);
+		else
+			SaveUnsignedInteger(out, ptr_save->SavePtr(ptr));
+	}
+
+
+	void SaveContainer(clutl::WriteBuffer& out, clcpp::ReadIterator& reader, const clcpp::Field* field, clutl::IPtrSave* ptr_save, unsigned int flags)
+	{
+		SaveArrayHeader(out, reader.m_Count);
+
+		if (const char* value = reader.m_Span.data)
+		{
+			// Step through contiguous objects without calling into the iterator
+			for (unsigned int i = 0; i < reader.m_Count; i++, value += reader.m_Span.stride)
+			{
+				if (reader.m_ValueIsPtr)
+					SavePtr(out, value, field, reader.m_ValueType, ptr_save);
+				else
+					SaveObject(out, value, field, reader.m_ValueType, ptr_save, flags);
+			}
+		}
+
+		else
+		{
+			for (unsigned int i = 0; i < reader.m_Count; i++, reader.MoveNext())
+			{
+				const char* value = (const char*)reader.GetKeyValue().value;
+				if (reader.m_ValueIsPtr)
+					SavePtr(out, value, field, reader.m_ValueType, ptr_save);
+				else
+					SaveObject(out, value, field, reader.m_ValueType, ptr_save, flags);
+			}
+		}
+	}
+
+
+	void SaveCharContainer(clutl::WriteBuffer& out, clcpp::ReadIterator& reader)
+	{
+		// Packed strings can be written in place
+		if (reader.m_Span.data != 0 && reader.m_Span.stride == 1)
+		{
+			SaveString(out, reader.m_Span.data, reader.m_Count);
+			return;
+		}
+
+		// Otherwise gather the characters so that the length prefix is known up front
+		clutl::WriteBuffer chars(reader.m_Count);
+		for (unsigned int i = 0; i < reader.m_Count; i++, reader.MoveNext())
+			chars.WriteChar(*(const char*)reader.GetKeyValue().value);
+		SaveString(out, chars.GetData(), chars.GetBytesWritten());
+	}
+
+
+	void SaveKey(clutl::WriteBuffer& out, const char* key, const clcpp::Type* key_type, KeyFormat key_format)
+	{
+		switch (key_format)
+		{
+		case KEY_FORMAT_INTEGER:
+			SaveType(out, key, key_type);
+			break;
+
+		case KEY_FORMAT_ENUM:
+			SaveEnum(out, key, key_type->AsEnum());
+			break;
+
+		case KEY_FORMAT_STRING:
+			if (IsStringView(key_type))
+			{
+				const clutl::StringView& view = *(const clutl::StringView*)key;
+				SaveString(out, view.data, view.length);
+			}
+			else
+			{
+				clcpp::ReadIterator reader(key_type->AsTemplateType(), key);
+				SaveCharContainer(out, reader);
+			}
+			break;
+
+		default:
+			clcpp::internal::Assert(false && "Unsupported key format");
+		}
+	}
+
+
+	void SaveTemplateType(clutl::WriteBuffer& out, const char* object, const clcpp::Field* field, const clcpp::TemplateType* template_type, clutl::IPtrSave* ptr_save, unsigned int flags)
+	{
+		clcpp::ReadIterator reader(template_type, object);
+		if (IsCharContainer(template_type))
+		{
+			SaveCharContainer(out, reader);
+			return;
+		}
+
+		KeyFormat key_format = GetKeyFormat(reader.m_KeyType, reader.m_KeyIsPtr);
+		if (key_format == KEY_FORMAT_NONE)
+		{
+			SaveContainer(out, reader, field, ptr_save, flags);
+			return;
+		}
+
+		// Keyed containers are maps from key to value
+		SaveMapHeader(out, reader.m_Count);
+		for (unsigned int i = 0; i < reader.m_Count; i++, reader.MoveNext())
+		{
+			clcpp::ContainerKeyValue kv = reader.GetKeyValue();
+			SaveKey(out, (const char*)kv.key, reader.m_KeyType, key_format);
+			if (reader.m_ValueIsPtr)
+				SavePtr(out, kv.value, field, reader.m_ValueType, ptr_save);
+			else
+				SaveObject(out, (const char*)kv.value, field, reader.m_ValueType, ptr_save, flags);
+		}
+	}
+
+
+	unsigned int CountClassFields(const clcpp::Type* type)
+	{
+		// Count all non-transient fields, including those in base classes
+		unsigned int nb_fields = 0;
+		if (type->kind == clcpp::Primitive::KIND_CLASS)
+		{
+			const clcpp::CArray<const clcpp::Field*>& fields = type->AsClass()->fields;
+			for (unsigned int i = 0; i < fields.size; i++)
+			{
+				if (!(fields[i]->flag_attributes & clcpp::FlagAttribute::TRANSIENT))
+					nb_fields++;
+			}
+		}
+
+		for (unsigned int i = 0; i < type->base_types.size; i++)
+			nb_fields += CountClassFields(type->base_types[i]);
+
+		return nb_fields;
+	}
+
+
+	void SaveClassFields(clutl::WriteBuffer& out, const char* object, const clcpp::Type* type, clutl::IPtrSave* ptr_save, unsigned int flags)
+	{
+		if (type->kind == clcpp::Primitive::KIND_CLASS)
+		{
+			const clcpp::CArray<const clcpp::Field*>& fields = type->AsClass()->fields;
+			for (unsigned int i = 0; i < fields.size; i++)
+			{
+				// Skip transient fields
+				const clcpp::Field* field = fields[i];
+				if (field->flag_attributes & clcpp::FlagAttribute::TRANSIENT)
+					continue;
+
+				if (flags & clutl::MsgPackFlags::HASH_FIELD_KEYS)
+					SaveUnsignedInteger(out, field->name.hash);
+				else
+					SaveString(out, field->name.text);
+
+				const char* field_object = object + field->offset;
+				if (field->ci != 0)
+				{
+					clcpp::ReadIterator reader(field, field_object);
+					SaveContainer(out, reader, field, ptr_save, flags);
+				}
+				else if (field->qualifier.op == clcpp::Qualifier::POINTER)
+				{
+					SavePtr(out, field_object, field, field->type, ptr_save);
+				}
+				else
+				{
+					SaveObject(out, field_object, field, field->type, ptr_save, flags);
+				}
+			}
+		}
+
+		// Recurse into base types
+		for (unsigned int i = 0; i < type->base_types.size; i++)
+			SaveClassFields(out, object, type->base_types[i], ptr_save, flags);
+	}
+
+
+	bool CallCustomSave(clutl::WriteBuffer& out, const char* object, const clcpp::Class* class_type)
+	{
+		if (!(class_type->flag_attributes & clcpp::FlagAttribute::CUSTOM_SAVE))
+			return false;
+		const clcpp::Function* function = FindAttributeFunction(class_type, g_SaveJSONHash);
+		if (function == 0)
+			return false;
+
+		// Call the function to generate an output token
+		clutl::JSONToken token;
+		clcpp::CallFunction(function, clcpp::ByRef(token), object);
+
+		switch (token.type)
+		{
+		case clutl::JSON_TOKEN_STRING:
+			SaveString(out, token.val.string, token.length);
+			break;
+		case clutl::JSON_TOKEN_INTEGER:
+			SaveInteger(out, token.val.integer);
+			break;
+		case clutl::JSON_TOKEN_DECIMAL:
+			SaveDouble(out, token.val.decimal);
+			break;
+		default:
+			clcpp::internal::Assert(false && "Invalid token output type");
+		}
+
+		return true;
+	}
+
+
+	void SaveClass(clutl::WriteBuffer& out, const char* object, const clcpp::Class* class_type, clutl::IPtrSave* ptr_save, unsigned int flags)
+	{
+		if (class_type->flag_attributes & clutl::FLAG_ATTR_IS_STRING_VIEW)
+		{
+			const clutl::StringView& view = *(const clutl::StringView*)object;
+			SaveString(out, view.data, view.length);
+			return;
+		}
+
+		if (CallCustomSave(out, object, class_type))
+			return;
+
+		// Call any attached pre-save function
+		if (class_type->flag_attributes & clcpp::FlagAttribute::PRE_SAVE)
+		{
+			if (const clcpp::Function* function = FindAttributeFunction(class_type, g_PreSaveHash))
+				clcpp::CallFunction(function, object);
+		}
+
+		// Classes are maps from field name to value
+		SaveMapHeader(out, CountClassFields(class_type));
+		SaveClassFields(out, object, class_type, ptr_save, flags);
+	}
+
+
+	void SaveObject(clutl::WriteBuffer& out, const char* object, const clcpp::Field* field, const clcpp::Type* type, clutl::IPtrSave* ptr_save, unsigned int flags)
+	{
+		// Dispatch to a save function based on kind
+		switch (type->kind)
+		{
+		case clcpp::Primitive::KIND_TYPE:
+			SaveType(out, object, type);
+			break;
+
+		case clcpp::Primitive::KIND_ENUM:
+			SaveEnum(out, object, type->AsEnum());
+			break;
+
+		case clcpp::Primitive::KIND_CLASS:
+			SaveClass(out, object, type->AsClass(), ptr_save, flags);
+			break;
+
+		case clcpp::Primitive::KIND_TEMPLATE_TYPE:
+			SaveTemplateType(out, object, field, type->AsTemplateType(), ptr_save, flags);
+			break;
+
+		default:
+			clcpp::internal::Assert(false && "Invalid primitive kind for type");
+		}
+	}
+}
+
+
+void clutl::SaveMsgPack(WriteBuffer& out, const void* object, const clcpp::Type* type, IPtrSave* ptr_save, unsigned int flags)
+{
+	SaveObject(out, (const char*)object, 0, type, ptr_save, flags);
+}
@@ -8,219 +8,1545 @@
 // ===============================================================================
 //
 
+#include "SerialiseInternal.h"
+
 #include <clutl/Serialise.h>
+#include <clcpp/Containers.h>
+
+
+// Standard C library function, copy bytes
+// http://pubs.opengroup.org/onlinepubs/009695399/functions/memcpy.html
+
+#ifdef __GNUC__
+	#define __THROW	throw ()
+	#define __nonnull(params) __attribute__ ((__nonnull__ params))
+#else
+	#define __THROW
+	#define __nonnull(params)
+#endif
+
+extern "C" void* CLCPP_CDECL memcpy(void* dst, const void* src, clcpp::size_type size) __THROW __nonnull ((1, 2));
+
+
+// Varints and type queries shared with the other serialisers
+using namespace clutl::internal;
 
 
 namespace
 {
-	struct FieldHeader
+	//
+	// Each saved object starts with a description of the classes, enums and containers it uses
+	// that haven't already been described within the stream:
+	//
+	//    nb_types, { kind, type_hash }..., { description }...
+	//
+	//    class:     layout_fingerprint, nb_fields, { name_hash, type_ref, element_size, count }...
+	//    enum:      nb_constants, { name_hash, value }...
+	//    container: nb_parameters, { type_ref, saved_size }...
+	//
+	// Hashes and fingerprints are 32-bit values. All other values are variable-length integers,
+	// with sizes offset by one so that a variable size is written as zero. Types are referenced
+	// by their built-in kind, by the index of their description within the stream, or by their
+	// hash for any other type.
+	//
+	// This is followed by a reference to the type of the saved object and its saved size, and then
+	// its data. Class data is the value of each described field in turn, with no padding: built-in
+	// types as they are in memory, enums as their integer value and nested classes in the same way.
+	// Pointer fields are saved as the 32-bit hash given by IPtrSave, or zero if there isn't one,
+	// and described with the hash of a void pointer.
+	// Classes without padding that have a layout fingerprint are saved as a copy of their memory,
+	// describing their fields in memory order. Containers are saved as their value count followed
+	// by each key and value. Containers and classes that contain them have a variable saved size,
+	// with their end only located by walking their data.
+	//
+	// Classes with an unchanged layout fingerprint are loaded as a straight copy. All others are
+	// loaded with a migration plan that is built once per stream for each saved type, mapping its
+	// saved fields onto the fields of the loaded type.
+	//
+	// Descriptions are decoded into arrays of 32-bit values with a hash and entry count leading
+	// each layout:
+	//
+	//    class:     type_hash, layout_fingerprint, saved_size, nb_fields, { name_hash, type_hash, element_size, count }...
+	//    enum:      type_hash, nb_constants, { name_hash, value }...
+	//    container: type_hash, nb_parameters, { type_hash, saved_size }...
+	//
+	const unsigned int CLASS_HEADER_SIZE = 4;
+	const unsigned int CLASS_FIELD_SIZE = 4;
+	const unsigned int ENUM_HEADER_SIZE = 2;
+	const unsigned int ENUM_CONSTANT_SIZE = 2;
+	const unsigned int CONTAINER_HEADER_SIZE = 2;
+	const unsigned int CONTAINER_PARAMETER_SIZE = 2;
+
+	// Kinds of described type
+	const unsigned char DESC_CLASS = 0;
+	const unsigned char DESC_ENUM = 1;
+	const unsigned char DESC_CONTAINER = 2;
+
+	// Saved size of containers and classes that contain them
+	const unsigned int VARIABLE_SIZE = 0xFFFFFFFF;
+
+	// Type hash describing pointer fields, which no other saved type can have
+	const unsigned int g_PointerHash = clcpp::internal::HashNameString("void*");
+
+
+	const char* ReadUInt(const char* src, const char* end, unsigned int& value)
 	{
-		// Default construct
-		FieldHeader()
-			: m_Hash(0)
-			, m_DataSize(0)
-			, m_WritePosition(0)
-		{
-		}
+		if ((unsigned int)(end - src) < sizeof(value))
+			return 0;
+		memcpy(&value, src, sizeof(value));
+		return src + sizeof(value);
+	}
 
-		// Construct from a field/type name hash
-		FieldHeader(unsigned int hash)
-			: m_Hash(hash)
-			, m_DataSize(0)
-			, m_WritePosition(0)
-		{
-		}
 
-		void Write(clutl::WriteBuffer& out)
+	unsigned int GetContainerParameters(const clcpp::Type* type, const clcpp::Type** parameter_types)
+	{
+		// Container iterators take the key and value types from the first two template arguments of
+		// keyed containers and the value type from the first of all others
+		const clcpp::TemplateType* template_type = type->AsTemplateType();
+		unsigned int nb_parameters = (type->ci->flags & clcpp::ContainerInfo::HAS_KEY) ? 2 : 1;
+		for (unsigned int i = 0; i < nb_parameters; i++)
 		{
-			// Only commit the hash and data size, marking the data size location for future patching
-			out.Write(&m_Hash, sizeof(m_Hash));
-			m_WritePosition = out.GetBytesWritten();
-			out.Write(&m_DataSize, sizeof(m_DataSize));
+			parameter_types[i] = template_type->parameter_types[i];
+			if (parameter_types[i] == 0 || template_type->parameter_ptrs[i])
+				return 0;
 		}
 
-		void Read(clutl::ReadBuffer& in)
-		{
-			in.Read(&m_Hash, sizeof(m_Hash));
-			in.Read(&m_DataSize, sizeof(m_DataSize));
-		}
+		return nb_parameters;
+	}
 
-		void PatchDataSize(clutl::WriteBuffer& out)
+
+	bool IsSavedType(const clcpp::Type* type)
+	{
+		switch (type->kind)
 		{
-			// Calculate size of the data written since the header write and write to the data size field in the header
-			m_DataSize = out.GetBytesWritten() - (m_WritePosition + sizeof(unsigned int));
-			unsigned int* patch_size = (unsigned int*)(out.GetData() + m_WritePosition);
-			*patch_size = m_DataSize;
+		case (clcpp::Primitive::KIND_TYPE):
+		case (clcpp::Primitive::KIND_ENUM):
+		case (clcpp::Primitive::KIND_CLASS):
+			return true;
+
+		case (clcpp::Primitive::KIND_TEMPLATE_TYPE):
+			{
+				// Only containers of values can be saved
+				if (type->ci == 0)
+					return false;
+				const clcpp::Type* parameter_types[2];
+				unsigned int nb_parameters = GetContainerParameters(type, parameter_types);
+				for (unsigned int i = 0; i < nb_parameters; i++)
+				{
+					if (!IsSavedType(parameter_types[i]))
+						return false;
+				}
+				return nb_parameters != 0;
+			}
+
+		default:
+			return false;
 		}
+	}
 
-		unsigned int m_Hash;
-		unsigned int m_DataSize;
-		unsigned int m_WritePosition;
-	};
 
+	bool IsSavedField(const clcpp::Field* field)
+	{
+		// Pointers are saved as hashes, whatever they point to
+		if (field->flag_attributes & clcpp::FlagAttribute::TRANSIENT)
+			return false;
+		return field->qualifier.op == clcpp::Qualifier::POINTER || IsSavedType(field->type);
+	}
 
-	void SaveObject(clutl::WriteBuffer& out, const char* object, const clcpp::Type* type, unsigned int hash);
-	void LoadObject(clutl::ReadBuffer& in, char* object, const clcpp::Type* type, unsigned int data_size);
 
+	unsigned int GetSavedSize(const clcpp::Type* type);
 
-	void SaveType(clutl::WriteBuffer& out, const char* object, const clcpp::Type* type)
+
+	unsigned int GetFieldSavedSize(const clcpp::Field* field)
 	{
-		out.Write(object, type->size);
+		return field->qualifier.op == clcpp::Qualifier::POINTER ? sizeof(unsigned int) : GetSavedSize(field->type);
 	}
 
-	
-	void SaveEnum(clutl::WriteBuffer& out, const char* object, const clcpp::Enum* enum_type)
+
+	unsigned int GetSavedSize(const clcpp::Type* type)
 	{
-		// Do a linear search for an enum with a matching value
-		// TODO: Optimise this to a binary search by storing sorted enum values?
-		//       They're currently sorted by name...
-		int value = *(int*)object;
-		clcpp::Name enum_name;
-		for (unsigned int i = 0; i < enum_type->constants.size; i++)
+		switch (type->kind)
 		{
-			if (enum_type->constants[i]->value == value)
+		case (clcpp::Primitive::KIND_TYPE):
+			return type->size;
+
+		case (clcpp::Primitive::KIND_ENUM):
+			return sizeof(int);
+
+		case (clcpp::Primitive::KIND_CLASS):
 			{
-				enum_name = enum_type->constants[i]->name;
-				break;
+				unsigned int saved_size = 0;
+				const clcpp::CArray<const clcpp::Field*>& fields = type->AsClass()->fields;
+				for (unsigned int i = 0; i < fields.size; i++)
+				{
+					if (!IsSavedField(fields[i]))
+						continue;
+					unsigned int field_size = GetFieldSavedSize(fields[i]);
+					if (field_size == VARIABLE_SIZE)
+						return VARIABLE_SIZE;
+					saved_size += field_size * GetFieldCount(fields[i]);
+				}
+				return saved_size;
 			}
+
+		default:
+			return VARIABLE_SIZE;
 		}
+	}
 
-		// TODO: What if a match can't be found?
 
-		// Write the name's has as the value
-		out.Write(&enum_name.hash, sizeof(enum_name.hash));
+	bool AddUnique(clutl::WriteBuffer& types, const clcpp::Type* type)
+	{
+		const clcpp::Type** data = (const clcpp::Type**)types.GetData();
+		unsigned int nb_types = types.GetBytesWritten() / sizeof(type);
+		for (unsigned int i = 0; i < nb_types; i++)
+		{
+			if (data[i] == type)
+				return false;
+		}
+
+		types.Write(&type, sizeof(type));
+		return true;
 	}
 
 
-	void SaveClass(clutl::WriteBuffer& out, const char* object, const clcpp::Class* class_type)
+	void GatherTypes(clutl::WriteBuffer& types, const clcpp::Type* type)
 	{
-		// Save each non-transient field in the class
+		if (type->kind == clcpp::Primitive::KIND_TYPE || !AddUnique(types, type))
+			return;
+
+		if (type->kind == clcpp::Primitive::KIND_CLASS)
+		{
+			const clcpp::CArray<const clcpp::Field*>& fields = type->AsClass()->fields;
+			for (unsigned int i = 0; i < fields.size; i++)
+			{
+				if (IsSavedField(fields[i]) && fields[i]->qualifier.op != clcpp::Qualifier::POINTER)
+					GatherTypes(types, fields[i]->type);
+			}
+		}
+
+		else if (type->kind == clcpp::Primitive::KIND_TEMPLATE_TYPE)
+		{
+			const clcpp::Type* parameter_types[2];
+			unsigned int nb_parameters = GetContainerParameters(type, parameter_types);
+			for (unsigned int i = 0; i < nb_parameters; i++)
+				GatherTypes(types, parameter_types[i]);
+		}
+	}
+
+
+	unsigned int GetSavedFields(clutl::WriteBuffer& saved_fields, const clcpp::Class* class_type)
+	{
+		saved_fields.Reset();
 		const clcpp::CArray<const clcpp::Field*>& fields = class_type->fields;
 		for (unsigned int i = 0; i < fields.size; i++)
 		{
-			const clcpp::Field* field = fields[i];
-			if (!(field->flag_attributes & clcpp::FlagAttribute::TRANSIENT))
+			if (IsSavedField(fields[i]))
+				saved_fields.Write(&fields[i], sizeof(fields[i]));
+		}
+
+		// Memory images are saved in memory order
+		const clcpp::Field** data = (const clcpp::Field**)saved_fields.GetData();
+		unsigned int nb_fields = saved_fields.GetBytesWritten() / sizeof(*data);
+		if (IsMemoryImage(class_type))
+		{
+			for (unsigned int i = 1; i < nb_fields; i++)
 			{
-				const char* field_object = object + field->offset;
-				SaveObject(out, field_object, field->type, field->name.hash);
+				const clcpp::Field* field = data[i];
+				unsigned int j = i;
+				for (; j > 0 && data[j - 1]->offset > field->offset; j--)
+					data[j] = data[j - 1];
+				data[j] = field;
 			}
 		}
+
+		return nb_fields;
 	}
 
 
-	void LoadClass(clutl::ReadBuffer& in, char* object, const clcpp::Class* class_type, unsigned int data_size)
+	void WriteTypeRef(clutl::WriteBuffer& out, const clcpp::Type* type, const clcpp::Type** types, unsigned int nb_types)
 	{
-		// Loop until all the data for this class has been read
-		unsigned int end_pos = in.GetBytesRead() + data_size;
-		while (in.GetBytesRead() < end_pos)
+		// Built-in kinds come first, followed by described types, with no kind marking a hash
+		if (type->kind == clcpp::Primitive::KIND_TYPE)
 		{
-			// Read the header for this field
-			FieldHeader header;
-			header.Read(in);
+			WriteVarint(out, type->builtin_kind);
+			if (type->builtin_kind == clcpp::BuiltinKind::NONE)
+				out.Write(&type->name.hash, sizeof(type->name.hash));
+			return;
+		}
 
-			// If the field exists in the class and it's non-transient, load it
-			const clcpp::Field* field = clcpp::FindPrimitive(class_type->fields, header.m_Hash);
-			if (field && !(field->flag_attributes & clcpp::FlagAttribute::TRANSIENT))
+		for (unsigned int i = 0; i < nb_types; i++)
+		{
+			if (types[i] == type)
 			{
-				char* field_object = object + field->offset;
-				LoadObject(in, field_object, field->type, header.m_DataSize);
+				WriteVarint(out, clcpp::BuiltinKind::COUNT + i);
+				return;
 			}
+		}
+		clcpp::internal::Assert(false && "Type hasn't been described");
+	}
+
+
+	void SaveLayouts(clutl::WriteBuffer& out, clutl::WriteBuffer& described_types, const clcpp::Type* type)
+	{
+		// Find all classes, enums and containers not already described, in the order they're first reached
+		unsigned int first_type = described_types.GetBytesWritten() / sizeof(type);
+		GatherTypes(described_types, type);
+		const clcpp::Type** types = (const clcpp::Type**)described_types.GetData();
+		unsigned int nb_types = described_types.GetBytesWritten() / sizeof(*types);
 
-			// TODO: verify read position + header size
+		// Write all hashes first so that descriptions can reference types described after them
+		WriteVarint(out, nb_types - first_type);
+		for (unsigned int i = first_type; i < nb_types; i++)
+		{
+			unsigned char kind = DESC_CONTAINER;
+			if (types[i]->kind == clcpp::Primitive::KIND_CLASS)
+				kind = DESC_CLASS;
+			else if (types[i]->kind == clcpp::Primitive::KIND_ENUM)
+				kind = DESC_ENUM;
+			out.Write(&kind, sizeof(kind));
+			out.Write(&types[i]->name.hash, sizeof(types[i]->name.hash));
+		}
+
+		clutl::WriteBuffer saved_fields;
+		for (unsigned int i = first_type; i < nb_types; i++)
+		{
+			switch (types[i]->kind)
+			{
+			case (clcpp::Primitive::KIND_CLASS):
+				{
+					const clcpp::Class* class_type = types[i]->AsClass();
+					unsigned int nb_fields = GetSavedFields(saved_fields, class_type);
+					const clcpp::Field** fields = (const clcpp::Field**)saved_fields.GetData();
+					out.Write(&class_type->layout_fingerprint, sizeof(class_type->layout_fingerprint));
+					WriteVarint(out, nb_fields);
+					for (unsigned int j = 0; j < nb_fields; j++)
+					{
+						const clcpp::Field* field = fields[j];
+						out.Write(&field->name.hash, sizeof(field->name.hash));
+						if (field->qualifier.op == clcpp::Qualifier::POINTER)
+						{
+							WriteVarint(out, clcpp::BuiltinKind::NONE);
+							out.Write(&g_PointerHash, sizeof(g_PointerHash));
+						}
+						else
+						{
+							WriteTypeRef(out, field->type, types, nb_types);
+						}
+						WriteVarint(out, GetFieldSavedSize(field) + 1);
+						WriteVarint(out, GetFieldCount(field));
+					}
+					break;
+				}
+
+			case (clcpp::Primitive::KIND_ENUM):
+				{
+					// Values are zigzag encoded to keep small negative values small
+					const clcpp::CArray<const clcpp::EnumConstant*>& constants = types[i]->AsEnum()->constants;
+					WriteVarint(out, constants.size);
+					for (unsigned int j = 0; j < constants.size; j++)
+					{
+						int value = constants[j]->value;
+						out.Write(&constants[j]->name.hash, sizeof(constants[j]->name.hash));
+						WriteVarint(out, ((unsigned int)value << 1) ^ (unsigned int)(value >> 31));
+					}
+					break;
+				}
+
+			default:
+				{
+					const clcpp::Type* parameter_types[2];
+					unsigned int nb_parameters = GetContainerParameters(types[i], parameter_types);
+					WriteVarint(out, nb_parameters);
+					for (unsigned int j = 0; j < nb_parameters; j++)
+					{
+						WriteTypeRef(out, parameter_types[j], types, nb_types);
+						WriteVarint(out, GetSavedSize(parameter_types[j]) + 1);
+					}
+					break;
+				}
+			}
 		}
 	}
 
 
-	void SaveObject(clutl::WriteBuffer& out, const char* object, const clcpp::Type* type, unsigned int hash)
+	void SaveContainer(clutl::WriteBuffer& out, const char* object, const clcpp::TemplateType* type, clutl::IPtrSave* ptr_save);
+
+
+	void SavePtrs(clutl::WriteBuffer& out, const char* object, const clcpp::Field* field, clutl::IPtrSave* ptr_save)
 	{
-		// Write the header
-		FieldHeader header(hash);
-		header.Write(out);
+		unsigned int count = GetFieldCount(field);
+		for (unsigned int i = 0; i < count; i++)
+		{
+			void* ptr = ((void* const*)object)[i];
+			unsigned int hash = 0;
+			if (ptr != 0 && ptr_save != 0 && ptr_save->CanSavePtr(ptr, field, field->type))
+				hash = ptr_save->SavePtr(ptr);
+			out.Write(&hash, sizeof(hash));
+		}
+	}
 
-		// Dispatch to a save function based on kind
+
+	void SaveObject(clutl::WriteBuffer& out, const char* object, const clcpp::Type* type, unsigned int count, clutl::IPtrSave* ptr_save)
+	{
 		switch (type->kind)
 		{
 		case (clcpp::Primitive::KIND_TYPE):
-			SaveType(out, object, type);
+			out.Write(object, type->size * count);
 			break;
 
 		case (clcpp::Primitive::KIND_ENUM):
-			SaveEnum(out, object, type->AsEnum());
+			out.Write(object, sizeof(int) * count);
 			break;
 
 		case (clcpp::Primitive::KIND_CLASS):
-			SaveClass(out, object, type->AsClass());
+			if (IsMemoryImage(type))
+			{
+				out.Write(object, type->size * count);
+				break;
+			}
+
+			for (unsigned int i = 0; i < count; i++, object += type->size)
+			{
+				// Save each field in the order they're described
+				const clcpp::CArray<const clcpp::Field*>& fields = type->AsClass()->fields;
+				for (unsigned int j = 0; j < fields.size; j++)
+				{
+					const clcpp::Field* field = fields[j];
+					if (!IsSavedField(field))
+						continue;
+					if (field->qualifier.op == clcpp::Qualifier::POINTER)
+						SavePtrs(out, object + field->offset, field, ptr_save);
+					else
+						SaveObject(out, object + field->offset, field->type, GetFieldCount(field), ptr_save);
+				}
+			}
+			break;
+
+		case (clcpp::Primitive::KIND_TEMPLATE_TYPE):
+			for (unsigned int i = 0; i < count; i++, object += type->size)
+				SaveContainer(out, object, type->AsTemplateType(), ptr_save);
 			break;
 
 		default:
 			clcpp::internal::Assert(false && "Invalid primitive kind for type");
 		}
+	}
+
+
+	void SaveContainer(clutl::WriteBuffer& out, const char* object, const clcpp::TemplateType* type, clutl::IPtrSave* ptr_save)
+	{
+		clcpp::ReadIterator reader(type, object);
+		WriteVarint(out, reader.m_Count);
+
+		if (reader.m_KeyType != 0)
+		{
+			for (unsigned int i = 0; i < reader.m_Count; i++, reader.MoveNext())
+			{
+				clcpp::ContainerKeyValue kv = reader.GetKeyValue();
+				SaveObject(out, (const char*)kv.key, reader.m_KeyType, 1, ptr_save);
+				SaveObject(out, (const char*)kv.value, reader.m_ValueType, 1, ptr_save);
+			}
+		}
 
-		// Record how much data was written for this field
-		header.PatchDataSize(out);
+		else if (const char* value = reader.m_Span.data)
+		{
+			// Contiguous values are saved as an array, with memory images written in one go
+			if (reader.m_Span.stride == reader.m_ValueType->size)
+				SaveObject(out, value, reader.m_ValueType, reader.m_Count, ptr_save);
+			else
+			{
+				for (unsigned int i = 0; i < reader.m_Count; i++, value += reader.m_Span.stride)
+					SaveObject(out, value, reader.m_ValueType, 1, ptr_save);
+			}
+		}
+
+		else
+		{
+			for (unsigned int i = 0; i < reader.m_Count; i++, reader.MoveNext())
+				SaveObject(out, (const char*)reader.GetKeyValue().value, reader.m_ValueType, 1, ptr_save);
+		}
 	}
 
 
-	void LoadType(clutl::ReadBuffer& in, char* object, const clcpp::Type* type)
+	const unsigned int* FindLayout(const clutl::WriteBuffer& layouts, unsigned int header_size, unsigned int entry_size, unsigned int type_hash)
 	{
-		in.Read(object, type->size);
+		const unsigned int* entries = (const unsigned int*)layouts.GetData();
+		const unsigned int* end = entries + layouts.GetBytesWritten() / sizeof(unsigned int);
+		while (entries < end)
+		{
+			if (entries[0] == type_hash)
+				return entries;
+			entries += header_size + entries[header_size - 1] * entry_size;
+		}
+		return 0;
 	}
 
 
-	void LoadEnum(clutl::ReadBuffer& in, char* object, const clcpp::Enum* enum_type)
+	bool IsSameLayout(const clutl::WriteBuffer& classes, const unsigned int* saved_class, const clcpp::Class* class_type)
 	{
-		// Read the enum name hash and do a search for it int he constant list
-		unsigned int enum_name_hash;
-		in.Read(&enum_name_hash, sizeof(enum_name_hash));
-		const clcpp::EnumConstant* constant = clcpp::FindPrimitive(enum_type->constants, enum_name_hash);
+		if (saved_class[1] == 0 || saved_class[1] != class_type->layout_fingerprint ||
+			saved_class[3] != class_type->fields.size || saved_class[2] != GetSavedSize(class_type))
+			return false;
+
+		// Memory images are saved in memory order, so each saved field must be at the same offset when loaded
+		unsigned int offset = 0;
+		const unsigned int* saved_field = saved_class + CLASS_HEADER_SIZE;
+		for (unsigned int i = 0; i < saved_class[3]; i++, saved_field += CLASS_FIELD_SIZE)
+		{
+			const clcpp::Field* field = clcpp::FindPrimitive(class_type->fields, saved_field[0]);
+			if (field == 0 || field->offset != offset || saved_field[2] != field->type->size || saved_field[3] != GetFieldCount(field))
+				return false;
+			if (field->type->kind == clcpp::Primitive::KIND_CLASS)
+			{
+				const unsigned int* saved_nested = FindLayout(classes, CLASS_HEADER_SIZE, CLASS_FIELD_SIZE, saved_field[1]);
+				if (saved_nested == 0 || !IsSameLayout(classes, saved_nested, field->type->AsClass()))
+					return false;
+			}
+			offset += saved_field[2] * saved_field[3];
+		}
 
-		// Copy the enum value if one is found
-		if (constant)
-			*(int*)object = constant->value;
+		return true;
 	}
 
 
-	void LoadObject(clutl::ReadBuffer& in, char* object, const clcpp::Type* type, unsigned int data_size)
+	// Name hashes of the built-in types, for converting saved values to types that have changed
+	struct BuiltinHashes
 	{
-		switch (type->kind)
+		BuiltinHashes()
 		{
-		case (clcpp::Primitive::KIND_TYPE):
-			LoadType(in, object, type);
-			break;
+			static const char* names[clcpp::BuiltinKind::COUNT] =
+			{
+				0, "bool", "char", "wchar_t", "unsigned char", "short", "unsigned short", "int", "unsigned int",
+				"long", "unsigned long", "long long", "unsigned long long", "float", "double",
+			};
 
-		case (clcpp::Primitive::KIND_ENUM):
-			LoadEnum(in, object, type->AsEnum());
-			break;
+			static const unsigned int type_sizes[clcpp::BuiltinKind::COUNT] =
+			{
+				0, sizeof(bool), sizeof(char), sizeof(wchar_t), sizeof(unsigned char), sizeof(short), sizeof(unsigned short), sizeof(int), sizeof(unsigned int),
+				sizeof(long), sizeof(unsigned long), sizeof(clcpp::int64), sizeof(clcpp::uint64), sizeof(float), sizeof(double),
+			};
 
-		case (clcpp::Primitive::KIND_CLASS):
-			LoadClass(in, object, type->AsClass(), data_size);
-			break;
+			hashes[0] = 0;
+			sizes[0] = 0;
+			for (int i = 1; i < clcpp::BuiltinKind::COUNT; i++)
+			{
+				hashes[i] = clcpp::internal::HashNameString(names[i]);
+				sizes[i] = type_sizes[i];
+			}
+		}
 
-		default:
-			// Unsupported type
-			clcpp::internal::Assert(false);
+		clcpp::BuiltinKind::Value GetKind(unsigned int type_hash) const
+		{
+			for (int i = 1; i < clcpp::BuiltinKind::COUNT; i++)
+			{
+				if (hashes[i] == type_hash)
+					return (clcpp::BuiltinKind::Value)i;
+			}
+			return clcpp::BuiltinKind::NONE;
+		}
+
+		unsigned int hashes[clcpp::BuiltinKind::COUNT];
+		unsigned int sizes[clcpp::BuiltinKind::COUNT];
+	};
+	const BuiltinHashes g_BuiltinHashes;
+
+
+	// Saved values that follow variable-size data aren't aligned
+	template <typename TYPE>
+	TYPE ReadValue(const char* src)
+	{
+		TYPE value;
+		memcpy(&value, src, sizeof(value));
+		return value;
+	}
+
+
+	template <typename TYPE>
+	void ConvertValue(char* dest, const char* src, clcpp::BuiltinKind::Value src_kind)
+	{
+		TYPE value;
+		switch (src_kind)
+		{
+		case clcpp::BuiltinKind::BOOL: value = (TYPE)ReadValue<bool>(src); break;
+		case clcpp::BuiltinKind::CHAR: value = (TYPE)ReadValue<char>(src); break;
+		case clcpp::BuiltinKind::WCHAR_T: value = (TYPE)ReadValue<wchar_t>(src); break;
+		case clcpp::BuiltinKind::UNSIGNED_CHAR: value = (TYPE)ReadValue<unsigned char>(src); break;
+		case clcpp::BuiltinKind::SHORT: value = (TYPE)ReadValue<short>(src); break;
+		case clcpp::BuiltinKind::UNSIGNED_SHORT: value = (TYPE)ReadValue<unsigned short>(src); break;
+		case clcpp::BuiltinKind::INT: value = (TYPE)ReadValue<int>(src); break;
+		case clcpp::BuiltinKind::UNSIGNED_INT: value = (TYPE)ReadValue<unsigned int>(src); break;
+		case clcpp::BuiltinKind::LONG: value = (TYPE)ReadValue<long>(src); break;
+		case clcpp::BuiltinKind::UNSIGNED_LONG: value = (TYPE)ReadValue<unsigned long>(src); break;
+		case clcpp::BuiltinKind::LONG_LONG: value = (TYPE)ReadValue<clcpp::int64>(src); break;
+		case clcpp::BuiltinKind::UNSIGNED_LONG_LONG: value = (TYPE)ReadValue<clcpp::uint64>(src); break;
+		case clcpp::BuiltinKind::FLOAT: value = (TYPE)ReadValue<float>(src); break;
+		case clcpp::BuiltinKind::DOUBLE: value = (TYPE)ReadValue<double>(src); break;
+		default: return;
+		}
+		*(TYPE*)dest = value;
+	}
+
+
+	template <>
+	void ConvertValue<bool>(char* dest, const char* src, clcpp::BuiltinKind::Value src_kind)
+	{
+		double value = 0;
+		ConvertValue<double>((char*)&value, src, src_kind);
+		*(bool*)dest = value != 0;
+	}
+
+
+	void ConvertBuiltin(char* dest, clcpp::BuiltinKind::Value dest_kind, const char* src, clcpp::BuiltinKind::Value src_kind)
+	{
+		switch (dest_kind)
+		{
+		case clcpp::BuiltinKind::BOOL: ConvertValue<bool>(dest, src, src_kind); break;
+		case clcpp::BuiltinKind::CHAR: ConvertValue<char>(dest, src, src_kind); break;
+		case clcpp::BuiltinKind::WCHAR_T: ConvertValue<wchar_t>(dest, src, src_kind); break;
+		case clcpp::BuiltinKind::UNSIGNED_CHAR: ConvertValue<unsigned char>(dest, src, src_kind); break;
+		case clcpp::BuiltinKind::SHORT: ConvertValue<short>(dest, src, src_kind); break;
+		case clcpp::BuiltinKind::UNSIGNED_SHORT: ConvertValue<unsigned short>(dest, src, src_kind); break;
+		case clcpp::BuiltinKind::INT: ConvertValue<int>(dest, src, src_kind); break;
+		case clcpp::BuiltinKind::UNSIGNED_INT: ConvertValue<unsigned int>(dest, src, src_kind); break;
+		case clcpp::BuiltinKind::LONG: ConvertValue<long>(dest, src, src_kind); break;
+		case clcpp::BuiltinKind::UNSIGNED_LONG: ConvertValue<unsigned long>(dest, src, src_kind); break;
+		case clcpp::BuiltinKind::LONG_LONG: ConvertValue<clcpp::int64>(dest, src, src_kind); break;
+		case clcpp::BuiltinKind::UNSIGNED_LONG_LONG: ConvertValue<clcpp::uint64>(dest, src, src_kind); break;
+		case clcpp::BuiltinKind::FLOAT: ConvertValue<float>(dest, src, src_kind); break;
+		case clcpp::BuiltinKind::DOUBLE: ConvertValue<double>(dest, src, src_kind); break;
+		default: break;
+		}
+	}
+
+
+	// A single step in loading a saved type, applied to count elements
+	struct PlanOp
+	{
+		enum Type
+		{
+			// Copy size bytes
+			COPY,
+
+			// Convert between built-in types
+			CONVERT,
+
+			// Map enum values through an enum map
+			ENUM,
+
+			// Load nested class objects with another plan
+			CLASS,
+
+			// Load containers with a container plan
+			CONTAINER,
+
+			// Record saved pointer hashes with the pointer fixups
+			POINTER,
+
+			// Stop loading data that can't be located
+			FAIL,
+		};
+
+		Type type;
+
+		// Source offsets are relative to the end of the last variable-size value
+		unsigned int src_offset;
+		unsigned int dest_offset;
+		unsigned int size;
+
+		// Elements beyond the destination count are skipped
+		unsigned int count;
+		unsigned int dest_count;
+		unsigned int src_stride;
+		unsigned int dest_stride;
+
+		clcpp::BuiltinKind::Value src_kind;
+		clcpp::BuiltinKind::Value dest_kind;
+		unsigned int index;
+
+		// Type pointed to by loaded pointer fields
+		const clcpp::Type* pointer_type;
+
+		// Size of the fixed-size data that follows a variable-size value
+		unsigned int segment_size;
+	};
+
+
+	struct Plan
+	{
+		unsigned int saved_type_hash;
+
+		// Loaded type, null if the saved data is only being skipped
+		const clcpp::Type* type;
+
+		unsigned int saved_size;
+		unsigned int segment_size;
+		unsigned int first_op;
+		unsigned int nb_ops;
+
+		// Set while the plan's operations are being built
+		bool is_building;
+	};
+
+
+	struct EnumMap
+	{
+		unsigned int saved_enum_hash;
+		const clcpp::Enum* enum_type;
+
+		// Saved value/loaded value pairs, empty when all values are the same
+		unsigned int first_value;
+		unsigned int nb_values;
+	};
+
+
+	// Largest key that can be loaded into temporary storage
+	const unsigned int MAX_KEY_SIZE = 16;
+
+
+	struct ContainerPlan
+	{
+		unsigned int saved_container_hash;
+		const clcpp::TemplateType* requested_type;
+
+		// Loaded container type, null if the saved container is only being skipped
+		const clcpp::TemplateType* type;
+
+		// Plans for loading or skipping each key and value, along with their saved sizes
+		bool has_key;
+		bool string_key;
+		unsigned int key_plan;
+		unsigned int value_plan;
+		unsigned int key_size;
+		unsigned int value_size;
+
+		// Values can be copied straight into contiguous container memory
+		bool copy_values;
+	};
+
+
+	// Layouts decoded from a stream and the plans and enum maps built for them, referenced by
+	// index as their arrays grow
+	struct LoadContext
+	{
+		LoadContext(clutl::WriteBuffer& type_hashes, clutl::WriteBuffer& classes, clutl::WriteBuffer& enums, clutl::WriteBuffer& containers,
+			clutl::WriteBuffer& plans, clutl::WriteBuffer& ops, clutl::WriteBuffer& container_plans, clutl::WriteBuffer& enum_maps, clutl::WriteBuffer& enum_values)
+			: type_hashes(type_hashes)
+			, classes(classes)
+			, enums(enums)
+			, containers(containers)
+			, plans(plans)
+			, ops(ops)
+			, container_plans(container_plans)
+			, enum_maps(enum_maps)
+			, enum_values(enum_values)
+			, ptr_fixups(0)
+		{
+		}
+
+		clutl::WriteBuffer& type_hashes;
+		clutl::WriteBuffer& classes;
+		clutl::WriteBuffer& enums;
+		clutl::WriteBuffer& containers;
+		clutl::WriteBuffer& plans;
+		clutl::WriteBuffer& ops;
+		clutl::WriteBuffer& container_plans;
+		clutl::WriteBuffer& enum_maps;
+		clutl::WriteBuffer& enum_values;
+
+		// Pointers loaded by this load only, with plans shared between loads
+		clutl::PtrFixups* ptr_fixups;
+	};
+
+
+	const char* ReadTypeRef(const LoadContext& ctx, const char* src, const char* end, unsigned int& type_hash)
+	{
+		unsigned int type_ref;
+		if ((src = ReadVarint(src, end, type_ref)) == 0)
+			return 0;
+		if (type_ref == clcpp::BuiltinKind::NONE)
+			return ReadUInt(src, end, type_hash);
+		if (type_ref < clcpp::BuiltinKind::COUNT)
+		{
+			type_hash = g_BuiltinHashes.hashes[type_ref];
+			return src;
+		}
+
+		unsigned int index = type_ref - clcpp::BuiltinKind::COUNT;
+		if (index >= ctx.type_hashes.GetBytesWritten() / sizeof(unsigned int))
+			return 0;
+		type_hash = ((const unsigned int*)ctx.type_hashes.GetData())[index];
+		return src;
+	}
+
+
+	const char* ReadSavedSize(const char* src, const char* end, unsigned int& saved_size)
+	{
+		// Sizes are offset by one, wrapping variable sizes around to zero
+		src = ReadVarint(src, end, saved_size);
+		saved_size -= 1;
+		return src;
+	}
+
+
+	const char* DecodeLayouts(LoadContext& ctx, const char* src, const char* end)
+	{
+		// Each type starts with its kind and hash
+		unsigned int nb_types;
+		if ((src = ReadVarint(src, end, nb_types)) == 0 || nb_types > (unsigned int)(end - src) / 5)
+			return 0;
+		const char* kinds = src;
+		for (unsigned int i = 0; i < nb_types; i++, src += 5)
+			ctx.type_hashes.Write(src + 1, sizeof(unsigned int));
+
+		unsigned int first_type = ctx.type_hashes.GetBytesWritten() / sizeof(unsigned int) - nb_types;
+		for (unsigned int i = 0; i < nb_types; i++)
+		{
+			unsigned int type_hash = ((const unsigned int*)ctx.type_hashes.GetData())[first_type + i];
+			unsigned int nb_entries;
+			switch (kinds[i * 5])
+			{
+			case (DESC_CLASS):
+				{
+					// Each field takes at least 7 bytes
+					unsigned int layout_fingerprint;
+					if ((src = ReadUInt(src, end, layout_fingerprint)) == 0 || (src = ReadVarint(src, end, nb_entries)) == 0 ||
+						nb_entries > (unsigned int)(end - src) / 7)
+						return 0;
+
+					unsigned int* saved_class = (unsigned int*)ctx.classes.Alloc((CLASS_HEADER_SIZE + nb_entries * CLASS_FIELD_SIZE) * sizeof(unsigned int));
+					saved_class[0] = type_hash;
+					saved_class[1] = layout_fingerprint;
+					saved_class[3] = nb_entries;
+
+					// The saved size of the class is the sum of its fields, which can only overflow with corrupt data
+					clcpp::uint64 saved_size = 0;
+					unsigned int* saved_field = saved_class + CLASS_HEADER_SIZE;
+					for (unsigned int j = 0; j < nb_entries; j++, saved_field += CLASS_FIELD_SIZE)
+					{
+						if ((src = ReadUInt(src, end, saved_field[0])) == 0 || (src = ReadTypeRef(ctx, src, end, saved_field[1])) == 0 ||
+							(src = ReadSavedSize(src, end, saved_field[2])) == 0 || (src = ReadVarint(src, end, saved_field[3])) == 0)
+							return 0;
+						if (saved_field[2] == VARIABLE_SIZE || saved_size == VARIABLE_SIZE)
+							saved_size = VARIABLE_SIZE;
+						else if ((saved_size += (clcpp::uint64)saved_field[2] * saved_field[3]) > 0x7FFFFFFF)
+							return 0;
+					}
+					saved_class[2] = (unsigned int)saved_size;
+					break;
+				}
+
+			case (DESC_ENUM):
+				{
+					// Each constant takes at least 5 bytes
+					if ((src = ReadVarint(src, end, nb_entries)) == 0 || nb_entries > (unsigned int)(end - src) / 5)
+						return 0;
+
+					unsigned int* saved_enum = (unsigned int*)ctx.enums.Alloc((ENUM_HEADER_SIZE + nb_entries * ENUM_CONSTANT_SIZE) * sizeof(unsigned int));
+					saved_enum[0] = type_hash;
+					saved_enum[1] = nb_entries;
+					unsigned int* saved_constant = saved_enum + ENUM_HEADER_SIZE;
+					for (unsigned int j = 0; j < nb_entries; j++, saved_constant += ENUM_CONSTANT_SIZE)
+					{
+						unsigned int value;
+						if ((src = ReadUInt(src, end, saved_constant[0])) == 0 || (src = ReadVarint(src, end, value)) == 0)
+							return 0;
+						saved_constant[1] = (value >> 1) ^ (0 - (value & 1));
+					}
+					break;
+				}
+
+			case (DESC_CONTAINER):
+				{
+					// Keyed containers have two parameters and all others one
+					if ((src = ReadVarint(src, end, nb_entries)) == 0 || nb_entries == 0 || nb_entries > 2)
+						return 0;
+
+					unsigned int* saved_container = (unsigned int*)ctx.containers.Alloc((CONTAINER_HEADER_SIZE + nb_entries * CONTAINER_PARAMETER_SIZE) * sizeof(unsigned int));
+					saved_container[0] = type_hash;
+					saved_container[1] = nb_entries;
+					unsigned int* saved_parameter = saved_container + CONTAINER_HEADER_SIZE;
+					for (unsigned int j = 0; j < nb_entries; j++, saved_parameter += CONTAINER_PARAMETER_SIZE)
+					{
+						if ((src = ReadTypeRef(ctx, src, end, saved_parameter[0])) == 0 || (src = ReadSavedSize(src, end, saved_parameter[1])) == 0)
+							return 0;
+					}
+					break;
+				}
+
+			default:
+				return 0;
+			}
+		}
+
+		return src;
+	}
+
+
+	const Plan& GetPlanData(const LoadContext& ctx, unsigned int index)
+	{
+		return ((const Plan*)ctx.plans.GetData())[index];
+	}
+
+
+	unsigned int GetEnumMap(LoadContext& ctx, const unsigned int* saved_enum, const clcpp::Enum* enum_type)
+	{
+		const EnumMap* enum_maps = (const EnumMap*)ctx.enum_maps.GetData();
+		unsigned int nb_enum_maps = ctx.enum_maps.GetBytesWritten() / sizeof(EnumMap);
+		for (unsigned int i = 0; i < nb_enum_maps; i++)
+		{
+			if (enum_maps[i].saved_enum_hash == saved_enum[0] && enum_maps[i].enum_type == enum_type)
+				return i;
+		}
+
+		// Pair up the values of constants with the same name
+		EnumMap enum_map;
+		enum_map.saved_enum_hash = saved_enum[0];
+		enum_map.enum_type = enum_type;
+		enum_map.first_value = ctx.enum_values.GetBytesWritten() / sizeof(int);
+		enum_map.nb_values = 0;
+		bool changed = false;
+		const unsigned int* saved_constant = saved_enum + ENUM_HEADER_SIZE;
+		for (unsigned int i = 0; i < saved_enum[1]; i++, saved_constant += ENUM_CONSTANT_SIZE)
+		{
+			const clcpp::EnumConstant* constant = clcpp::FindPrimitive(enum_type->constants, saved_constant[0]);
+			if (constant == 0)
+			{
+				changed = true;
+				continue;
+			}
+
+			int values[2] = { (int)saved_constant[1], constant->value };
+			ctx.enum_values.Write(values, sizeof(values));
+			enum_map.nb_values++;
+			changed |= values[0] != values[1];
+		}
+
+		if (!changed)
+		{
+			ctx.enum_values.SeekRel(-(int)(enum_map.nb_values * 2 * sizeof(int)));
+			enum_map.nb_values = 0;
 		}
+
+		ctx.enum_maps.Write(&enum_map, sizeof(enum_map));
+		return nb_enum_maps;
+	}
+
+
+	void AddOp(clutl::WriteBuffer& ops, const PlanOp& op)
+	{
+		// Merge copies of neighbouring fields
+		PlanOp* last_op = ops.GetBytesWritten() ? (PlanOp*)(ops.GetData() + ops.GetBytesWritten()) - 1 : 0;
+		if (op.type == PlanOp::COPY && last_op && last_op->type == PlanOp::COPY &&
+			last_op->src_offset + last_op->size == op.src_offset && last_op->dest_offset + last_op->size == op.dest_offset)
+		{
+			last_op->size += op.size;
+			return;
+		}
+
+		ops.Write(&op, sizeof(op));
+	}
+
+
+	unsigned int GetPlan(LoadContext& ctx, unsigned int saved_type_hash, unsigned int saved_size, const clcpp::Type* type);
+	unsigned int GetContainerPlan(LoadContext& ctx, const unsigned int* saved_container, const clcpp::Type* type);
+
+
+	bool AddValueOps(LoadContext& ctx, clutl::WriteBuffer& ops, unsigned int saved_type_hash, unsigned int element_size, unsigned int count,
+		unsigned int src_offset, const clcpp::Type* type, unsigned int dest_offset, unsigned int dest_count, bool is_ptr)
+	{
+		// Pointer fields can only load saved pointers
+		if (is_ptr && saved_type_hash != g_PointerHash)
+			type = 0;
+
+		// Array elements beyond the size of the new array are dropped
+		PlanOp op;
+		op.type = PlanOp::COPY;
+		op.src_offset = src_offset;
+		op.dest_offset = dest_offset;
+		op.size = 0;
+		op.count = count;
+		op.dest_count = type == 0 ? 0 : count < dest_count ? count : dest_count;
+		op.src_stride = element_size;
+		op.dest_stride = type ? type->size : 0;
+		op.src_kind = clcpp::BuiltinKind::NONE;
+		op.dest_kind = clcpp::BuiltinKind::NONE;
+		op.index = 0;
+		op.pointer_type = 0;
+		op.segment_size = 0;
+
+		// Saved pointers are skipped by offset unless they're loaded into a pointer field
+		if (saved_type_hash == g_PointerHash)
+		{
+			if (element_size != sizeof(unsigned int))
+				return false;
+			if (type == 0 || !is_ptr)
+				return true;
+			op.type = PlanOp::POINTER;
+			op.dest_stride = sizeof(void*);
+			op.pointer_type = type;
+			AddOp(ops, op);
+			return true;
+		}
+
+		// Nested classes load with their own plan, which only skips their data if there's nothing to load into
+		if (FindLayout(ctx.classes, CLASS_HEADER_SIZE, CLASS_FIELD_SIZE, saved_type_hash))
+		{
+			if (type != 0 && type->kind != clcpp::Primitive::KIND_CLASS)
+				type = 0;
+			if (type == 0 && element_size != VARIABLE_SIZE)
+				return false;
+
+			// Classes can only contain themselves through containers, so this is corrupt data that
+			// would otherwise recurse without reading anything
+			op.type = PlanOp::CLASS;
+			op.index = GetPlan(ctx, saved_type_hash, element_size, type);
+			if (GetPlanData(ctx, op.index).saved_size != element_size || GetPlanData(ctx, op.index).is_building)
+				return false;
+
+			// Classes that load as a single copy of their entire size can be copied as one array
+			const Plan& plan = GetPlanData(ctx, op.index);
+			const PlanOp* first_op = (const PlanOp*)ctx.ops.GetData() + plan.first_op;
+			if (type != 0 && plan.nb_ops == 1 && first_op->type == PlanOp::COPY && first_op->src_offset == 0 &&
+				first_op->dest_offset == 0 && first_op->size == element_size && element_size == type->size)
+			{
+				op.type = PlanOp::COPY;
+				op.size = op.dest_count * element_size;
+			}
+
+			AddOp(ops, op);
+			return true;
+		}
+
+		// Containers are always variable-size and can be skipped if there's nothing to load into
+		if (const unsigned int* saved_container = FindLayout(ctx.containers, CONTAINER_HEADER_SIZE, CONTAINER_PARAMETER_SIZE, saved_type_hash))
+		{
+			if (element_size != VARIABLE_SIZE)
+				return false;
+
+			op.type = PlanOp::CONTAINER;
+			op.index = GetContainerPlan(ctx, saved_container, type);
+			AddOp(ops, op);
+			return true;
+		}
+
+		// Everything else has a fixed size and is skipped by offset
+		if (type == 0 || element_size == VARIABLE_SIZE)
+			return false;
+
+		// Enums are copied unless their constant values have changed
+		if (const unsigned int* saved_enum = FindLayout(ctx.enums, ENUM_HEADER_SIZE, ENUM_CONSTANT_SIZE, saved_type_hash))
+		{
+			if (type->kind != clcpp::Primitive::KIND_ENUM || type->size != sizeof(int) || element_size != sizeof(int))
+				return false;
+
+			op.index = GetEnumMap(ctx, saved_enum, type->AsEnum());
+			op.type = ((const EnumMap*)ctx.enum_maps.GetData())[op.index].nb_values ? PlanOp::ENUM : PlanOp::COPY;
+			op.size = op.dest_count * sizeof(int);
+			AddOp(ops, op);
+			return true;
+		}
+
+		// Copy unchanged types and convert between built-in types
+		if (type->kind != clcpp::Primitive::KIND_TYPE)
+			return false;
+		if (saved_type_hash == type->name.hash && element_size == type->size)
+		{
+			op.type = PlanOp::COPY;
+			op.size = op.dest_count * element_size;
+			AddOp(ops, op);
+			return true;
+		}
+		op.src_kind = g_BuiltinHashes.GetKind(saved_type_hash);
+		op.dest_kind = type->builtin_kind;
+		if (op.src_kind == clcpp::BuiltinKind::NONE || op.dest_kind == clcpp::BuiltinKind::NONE)
+			return false;
+
+		// Values saved with a different size, such as a long on another platform, can't be read
+		if (element_size != g_BuiltinHashes.sizes[op.src_kind])
+			return false;
+
+		op.type = PlanOp::CONVERT;
+		AddOp(ops, op);
+		return true;
+	}
+
+
+	void SetSegmentSize(Plan& plan, clutl::WriteBuffer& ops, int segment_op, unsigned int segment_size)
+	{
+		if (segment_op < 0)
+			plan.segment_size = segment_size;
+		else
+			((PlanOp*)ops.GetData())[segment_op].segment_size = segment_size;
+	}
+
+
+	unsigned int GetPlan(LoadContext& ctx, unsigned int saved_type_hash, unsigned int saved_size, const clcpp::Type* type)
+	{
+		const Plan* plans = (const Plan*)ctx.plans.GetData();
+		unsigned int nb_plans = ctx.plans.GetBytesWritten() / sizeof(Plan);
+		for (unsigned int i = 0; i < nb_plans; i++)
+		{
+			if (plans[i].saved_type_hash == saved_type_hash && plans[i].type == type)
+				return i;
+		}
+
+		// Reserve the plan before building it so that types which contain themselves find it
+		Plan plan;
+		plan.saved_type_hash = saved_type_hash;
+		plan.type = type;
+		plan.saved_size = VARIABLE_SIZE;
+		plan.segment_size = 0;
+		plan.first_op = 0;
+		plan.nb_ops = 0;
+		plan.is_building = true;
+		unsigned int index = nb_plans;
+		ctx.plans.Write(&plan, sizeof(plan));
+
+		// Build into a separate array as nested plans add their own operations. Each variable-size
+		// value ends the current segment of fixed-size data, with a new one starting after it.
+		clutl::WriteBuffer ops;
+		unsigned int src_offset = 0;
+		int segment_op = -1;
+		bool is_variable = false;
+		PlanOp fail_op;
+		fail_op.type = PlanOp::FAIL;
+		fail_op.src_offset = 0;
+		fail_op.dest_offset = 0;
+
+		const unsigned int* saved_class = FindLayout(ctx.classes, CLASS_HEADER_SIZE, CLASS_FIELD_SIZE, saved_type_hash);
+		if (saved_class != 0)
+		{
+			const clcpp::Class* class_type = type && type->kind == clcpp::Primitive::KIND_CLASS ? type->AsClass() : 0;
+			const unsigned int* saved_field = saved_class + CLASS_HEADER_SIZE;
+			for (unsigned int i = 0; i < saved_class[3]; i++, saved_field += CLASS_FIELD_SIZE)
+			{
+				// Fields that no longer exist are skipped
+				unsigned int element_size = saved_field[2];
+				unsigned int count = saved_field[3];
+				const clcpp::Field* field = class_type ? clcpp::FindPrimitive(class_type->fields, saved_field[0]) : 0;
+				if (field && !IsSavedField(field))
+					field = 0;
+
+				if (element_size != VARIABLE_SIZE)
+				{
+					// Sizes that overflow can only come from corrupt data
+					if (count != 0 && element_size > (0x7FFFFFFF - src_offset) / count)
+					{
+						ops.Write(&fail_op, sizeof(fail_op));
+						break;
+					}
+					AddValueOps(ctx, ops, saved_field[1], element_size, count, src_offset, field ? field->type : 0,
+						field ? field->offset : 0, field ? GetFieldCount(field) : 0, field && field->qualifier.op == clcpp::Qualifier::POINTER);
+					src_offset += element_size * count;
+					continue;
+				}
+
+				// Variable-size data that can't be read leaves nothing after it that can be located
+				SetSegmentSize(plan, ops, segment_op, src_offset);
+				is_variable = true;
+				if (!AddValueOps(ctx, ops, saved_field[1], element_size, count, src_offset, field ? field->type : 0,
+					field ? field->offset : 0, field ? GetFieldCount(field) : 0, field && field->qualifier.op == clcpp::Qualifier::POINTER))
+				{
+					ops.Write(&fail_op, sizeof(fail_op));
+					break;
+				}
+				src_offset = 0;
+				segment_op = ops.GetBytesWritten() / sizeof(PlanOp) - 1;
+			}
+		}
+
+		else if (saved_size != VARIABLE_SIZE)
+		{
+			AddValueOps(ctx, ops, saved_type_hash, saved_size, 1, 0, type, 0, 1, false);
+			src_offset = saved_size;
+		}
+
+		else
+		{
+			is_variable = true;
+			if (!AddValueOps(ctx, ops, saved_type_hash, saved_size, 1, 0, type, 0, 1, false))
+				ops.Write(&fail_op, sizeof(fail_op));
+			segment_op = ops.GetBytesWritten() / sizeof(PlanOp) - 1;
+		}
+
+		SetSegmentSize(plan, ops, segment_op, src_offset);
+		plan.saved_size = is_variable ? VARIABLE_SIZE : src_offset;
+		plan.first_op = ctx.ops.GetBytesWritten() / sizeof(PlanOp);
+		plan.nb_ops = ops.GetBytesWritten() / sizeof(PlanOp);
+		ctx.ops.Write(ops.GetData(), ops.GetBytesWritten());
+		plan.is_building = false;
+		((Plan*)ctx.plans.GetData())[index] = plan;
+		return index;
+	}
+
+
+	unsigned int GetContainerPlan(LoadContext& ctx, const unsigned int* saved_container, const clcpp::Type* type)
+	{
+		const clcpp::TemplateType* template_type = 0;
+		if (type != 0 && type->kind == clcpp::Primitive::KIND_TEMPLATE_TYPE && type->ci != 0)
+			template_type = type->AsTemplateType();
+
+		const ContainerPlan* container_plans = (const ContainerPlan*)ctx.container_plans.GetData();
+		unsigned int nb_container_plans = ctx.container_plans.GetBytesWritten() / sizeof(ContainerPlan);
+		for (unsigned int i = 0; i < nb_container_plans; i++)
+		{
+			if (container_plans[i].saved_container_hash == saved_container[0] && container_plans[i].requested_type == template_type)
+				return i;
+		}
+
+		// Reserve the plan before building it so that containers of types which contain them find it
+		ContainerPlan plan;
+		plan.saved_container_hash = saved_container[0];
+		plan.requested_type = template_type;
+		plan.type = 0;
+		plan.has_key = saved_container[1] == 2;
+		plan.string_key = false;
+		plan.key_plan = 0;
+		plan.value_plan = 0;
+		plan.key_size = 0;
+		plan.value_size = 0;
+		plan.copy_values = false;
+		unsigned int index = nb_container_plans;
+		ctx.container_plans.Write(&plan, sizeof(plan));
+
+		// Saved containers are skipped unless they can be loaded with the same parameters
+		const clcpp::Type* parameter_types[2];
+		if (template_type != 0 && GetContainerParameters(template_type, parameter_types) != saved_container[1])
+			template_type = 0;
+		const unsigned int* saved_key = saved_container + CONTAINER_HEADER_SIZE;
+		const unsigned int* saved_value = plan.has_key ? saved_key + CONTAINER_PARAMETER_SIZE : saved_key;
+		plan.key_size = plan.has_key ? saved_key[1] : 0;
+		plan.value_size = saved_value[1];
+
+		// Keys are loaded into temporary storage, apart from strings which are given as a StringView
+		if (template_type != 0 && plan.has_key)
+		{
+			if (IsCharContainer(parameter_types[0]))
+			{
+				const unsigned int* saved_key_container = FindLayout(ctx.containers, CONTAINER_HEADER_SIZE, CONTAINER_PARAMETER_SIZE, saved_key[0]);
+				plan.string_key = saved_key_container != 0 && saved_key_container[1] == 1 &&
+					saved_key_container[2] == g_BuiltinHashes.hashes[clcpp::BuiltinKind::CHAR] && saved_key_container[3] == 1;
+				if (!plan.string_key)
+					template_type = 0;
+			}
+			else if (parameter_types[0]->size <= MAX_KEY_SIZE && saved_key[1] != VARIABLE_SIZE)
+			{
+				plan.key_plan = GetPlan(ctx, saved_key[0], saved_key[1], parameter_types[0]);
+				if (GetPlanData(ctx, plan.key_plan).nb_ops == 0)
+					template_type = 0;
+			}
+			else
+			{
+				template_type = 0;
+			}
+		}
+
+		// Keys that aren't loaded with a plan still need one to skip them
+		if (plan.has_key && (template_type == 0 || plan.string_key))
+			plan.key_plan = GetPlan(ctx, saved_key[0], saved_key[1], 0);
+
+		const clcpp::Type* value_type = template_type ? parameter_types[plan.has_key ? 1 : 0] : 0;
+		plan.value_plan = GetPlan(ctx, saved_value[0], saved_value[1], value_type);
+		if (template_type != 0)
+		{
+			// Values that load as a single copy can be copied straight into contiguous container memory
+			const Plan& value_plan = GetPlanData(ctx, plan.value_plan);
+			const PlanOp* first_op = (const PlanOp*)ctx.ops.GetData() + value_plan.first_op;
+			plan.copy_values = !plan.has_key && value_plan.nb_ops == 1 && first_op->type == PlanOp::COPY &&
+				first_op->src_offset == 0 && first_op->dest_offset == 0 && first_op->size == plan.value_size &&
+				plan.value_size == value_type->size;
+		}
+
+		plan.type = template_type;
+		((ContainerPlan*)ctx.container_plans.GetData())[index] = plan;
+		return index;
+	}
+
+
+	void MapEnum(const LoadContext& ctx, unsigned int index, char* object, const char* src)
+	{
+		const EnumMap& enum_map = ((const EnumMap*)ctx.enum_maps.GetData())[index];
+		const int* values = (const int*)ctx.enum_values.GetData() + enum_map.first_value * 2;
+		int value = ReadValue<int>(src);
+
+		// Values that no longer have a constant are left unchanged
+		for (unsigned int i = 0; i < enum_map.nb_values; i++, values += 2)
+		{
+			if (values[0] == value)
+			{
+				*(int*)object = values[1];
+				return;
+			}
+		}
+	}
+
+
+	const char* ExecuteContainer(const LoadContext& ctx, unsigned int index, const char* src, const char* end, char* object);
+
+
+	const char* ExecutePlan(const LoadContext& ctx, unsigned int index, const char* src, const char* end, char* object)
+	{
+		// Each segment of fixed-size data is bounds checked before any of it is read
+		const Plan& plan = GetPlanData(ctx, index);
+		unsigned int segment_size = plan.segment_size;
+		if (segment_size > (unsigned int)(end - src))
+			return 0;
+
+		// Objects that aren't being loaded only need their variable-size data skipping
+		const PlanOp* op = (const PlanOp*)ctx.ops.GetData() + plan.first_op;
+		for (unsigned int i = 0; i < plan.nb_ops; i++, op++)
+		{
+			const char* op_src = src + op->src_offset;
+			char* op_dest = object ? object + op->dest_offset : 0;
+			switch (op->type)
+			{
+			case (PlanOp::COPY):
+				if (op_dest != 0)
+					memcpy(op_dest, op_src, op->size);
+				break;
+
+			case (PlanOp::CONVERT):
+				for (unsigned int j = 0; op_dest && j < op->dest_count; j++, op_src += op->src_stride, op_dest += op->dest_stride)
+					ConvertBuiltin(op_dest, op->dest_kind, op_src, op->src_kind);
+				break;
+
+			case (PlanOp::ENUM):
+				for (unsigned int j = 0; op_dest && j < op->dest_count; j++, op_src += op->src_stride, op_dest += op->dest_stride)
+					MapEnum(ctx, op->index, op_dest, op_src);
+				break;
+
+			case (PlanOp::CLASS):
+				if (op->src_stride != VARIABLE_SIZE)
+				{
+					for (unsigned int j = 0; op_dest && j < op->dest_count; j++, op_src += op->src_stride, op_dest += op->dest_stride)
+						ExecutePlan(ctx, op->index, op_src, end, op_dest);
+					break;
+				}
+
+				// Variable-size objects follow each other, with a new segment after the last
+				for (unsigned int j = 0; j < op->count; j++)
+				{
+					op_src = ExecutePlan(ctx, op->index, op_src, end, j < op->dest_count ? op_dest + j * op->dest_stride : 0);
+					if (op_src == 0)
+						return 0;
+				}
+				src = op_src;
+				segment_size = op->segment_size;
+				if (segment_size > (unsigned int)(end - src))
+					return 0;
+				break;
+
+			case (PlanOp::CONTAINER):
+				for (unsigned int j = 0; j < op->count; j++)
+				{
+					op_src = ExecuteContainer(ctx, op->index, op_src, end, j < op->dest_count ? op_dest + j * op->dest_stride : 0);
+					if (op_src == 0)
+						return 0;
+				}
+				src = op_src;
+				segment_size = op->segment_size;
+				if (segment_size > (unsigned int)(end - src))
+					return 0;
+				break;
+
+			case (PlanOp::POINTER):
+				// Pointers are left unchanged when there are no fixups to patch them with
+				for (unsigned int j = 0; op_dest && ctx.ptr_fixups && j < op->dest_count; j++, op_src += op->src_stride, op_dest += op->dest_stride)
+					ctx.ptr_fixups->AddPtr((void**)op_dest, ReadValue<unsigned int>(op_src), op->pointer_type);
+				break;
+
+			case (PlanOp::FAIL):
+				return 0;
+			}
+		}
+
+		return src + segment_size;
+	}
+
+
+	const char* SkipContainerValues(const LoadContext& ctx, const ContainerPlan& plan, unsigned int count, const char* src, const char* end)
+	{
+		// Fixed-size keys and values are skipped in one go
+		clcpp::uint64 key_size = plan.has_key ? plan.key_size : 0;
+		if (key_size != VARIABLE_SIZE && plan.value_size != VARIABLE_SIZE)
+		{
+			clcpp::uint64 size = count * (key_size + plan.value_size);
+			return size > (clcpp::uint64)(end - src) ? 0 : src + size;
+		}
+
+		for (unsigned int i = 0; i < count && src != 0; i++)
+		{
+			if (plan.has_key)
+				src = ExecutePlan(ctx, plan.key_plan, src, end, 0);
+			if (src != 0)
+				src = ExecutePlan(ctx, plan.value_plan, src, end, 0);
+		}
+		return src;
+	}
+
+
+	const char* ExecuteContainer(const LoadContext& ctx, unsigned int index, const char* src, const char* end, char* object)
+	{
+		unsigned int count;
+		if ((src = ReadVarint(src, end, count)) == 0)
+			return 0;
+
+		const ContainerPlan& plan = ((const ContainerPlan*)ctx.container_plans.GetData())[index];
+		if (object == 0 || plan.type == 0)
+			return SkipContainerValues(ctx, plan, count, src, end);
+
+		// Don't allocate more values than the data could possibly hold, with variable-size
+		// values taking at least one byte
+		clcpp::uint64 min_size = plan.value_size == VARIABLE_SIZE ? 1 : plan.value_size;
+		if (plan.has_key)
+			min_size += plan.key_size == VARIABLE_SIZE ? 1 : plan.key_size;
+		if (count * min_size > (clcpp::uint64)(end - src))
+			return 0;
+
+		clcpp::WriteIterator writer;
+		writer.Initialise(plan.type, object, count);
+		if (!writer.IsInitialised())
+			return SkipContainerValues(ctx, plan, count, src, end);
+
+		// Prefer writing values straight into contiguous memory, skipping those beyond the container's capacity
+		char* values = 0;
+		unsigned int stride = 0;
+		unsigned int nb_values = count;
+		if (!plan.has_key)
+		{
+			if (writer.m_Span.data != 0)
+			{
+				values = writer.m_Span.data;
+				stride = writer.m_Span.stride;
+				nb_values = (unsigned int)writer.m_Count < count ? writer.m_Count : count;
+			}
+			else if ((values = (char*)writer.AddEmptyRange(count)) != 0)
+			{
+				stride = writer.m_ValueType->size;
+			}
+		}
+
+		// Trivially copyable values are copied in one go
+		if (plan.copy_values && values != 0 && stride == plan.value_size)
+		{
+			memcpy(values, src, nb_values * stride);
+			return src + count * plan.value_size;
+		}
+
+		// Aligned storage for any key that isn't a string
+		clcpp::uint64 key_data[MAX_KEY_SIZE / sizeof(clcpp::uint64)];
+		clutl::StringView key_view;
+
+		for (unsigned int i = 0; i < count; i++)
+		{
+			void* key = 0;
+			if (plan.string_key)
+			{
+				// Strings are containers of char that are used in place
+				if ((src = ReadVarint(src, end, key_view.length)) == 0 || key_view.length > (unsigned int)(end - src))
+					return 0;
+				key_view.data = src;
+				src += key_view.length;
+				key = &key_view;
+			}
+			else if (plan.has_key)
+			{
+				for (unsigned int j = 0; j < sizeof(key_data) / sizeof(key_data[0]); j++)
+					key_data[j] = 0;
+				if ((src = ExecutePlan(ctx, plan.key_plan, src, end, (char*)key_data)) == 0)
+					return 0;
+				key = key_data;
+			}
+
+			char* value;
+			if (plan.has_key)
+				value = (char*)writer.AddEmpty(key);
+			else if (values != 0)
+				value = i < nb_values ? values + i * stride : 0;
+			else
+				value = (char*)writer.AddEmpty();
+
+			if ((src = ExecutePlan(ctx, plan.value_plan, src, end, value)) == 0)
+				return 0;
+		}
+
+		return src;
 	}
 }
 
-void clutl::SaveVersionedBinary(WriteBuffer& out, const void* object, const clcpp::Type* type)
+
+void clutl::SaveVersionedBinary(WriteBuffer& out, const void* object, const clcpp::Type* type, VersionedBinaryStream* stream, IPtrSave* ptr_save)
 {
-	SaveObject(out, (const char*)object, type, type->name.hash);
+	clcpp::internal::Assert(IsSavedType(type) && "Type can't be saved");
+
+	// Without a stream all layouts are described
+	VersionedBinaryStream object_stream;
+	if (stream == 0)
+		stream = &object_stream;
+	SaveLayouts(out, stream->m_SavedTypes, type);
+
+	const clcpp::Type** types = (const clcpp::Type**)stream->m_SavedTypes.GetData();
+	WriteTypeRef(out, type, types, stream->m_SavedTypes.GetBytesWritten() / sizeof(*types));
+	WriteVarint(out, GetSavedSize(type) + 1);
+	SaveObject(out, (const char*)object, type, 1, ptr_save);
 }
 
 
-void clutl::LoadVersionedBinary(ReadBuffer& in, void* object, const clcpp::Type* type)
+bool clutl::LoadVersionedBinary(ReadBuffer& in, void* object, const clcpp::Type* type, VersionedBinaryStream* stream, PtrFixups* ptr_fixups)
 {
-	// Read the header
-	FieldHeader header;
-	header.Read(in);
+	VersionedBinaryStream object_stream;
+	if (stream == 0)
+		stream = &object_stream;
+	LoadContext ctx(stream->m_TypeHashes, stream->m_Classes, stream->m_Enums, stream->m_Containers,
+		stream->m_Plans, stream->m_PlanOps, stream->m_ContainerPlans, stream->m_EnumMaps, stream->m_EnumValues);
+	ctx.ptr_fixups = ptr_fixups;
 
-	// Type names don't match
-	// TODO: Error ?
-	if (type->name.hash != header.m_Hash)
-		return;
+	// Read any new layouts and the type and size of the saved object
+	const char* data = in.ReadAt(in.GetBytesRead());
+	const char* end = data + in.GetBytesRemaining();
+	const char* src = DecodeLayouts(ctx, data, end);
+	unsigned int saved_type_hash, saved_size;
+	if (src == 0 || (src = ReadTypeRef(ctx, src, end, saved_type_hash)) == 0 || (src = ReadSavedSize(src, end, saved_size)) == 0)
+	{
+		in.SeekRel(end - data);
+		return false;
+	}
 
-	LoadObject(in, (char*)object, type, header.m_DataSize);
+	// Objects of a different type are skipped
+	const clcpp::Type* load_type = saved_type_hash == type->name.hash ? type : 0;
 
-	// TODO: verify position
-}
\ No newline at end of file
+	// Memory images with an unchanged layout are copied without building any plans. Everything else goes
+	// through the cached plans, which merge consecutive unchanged fields into single copies.
+	if (load_type != 0 && type->kind == clcpp::Primitive::KIND_CLASS && saved_size != VARIABLE_SIZE && saved_size <= (unsigned int)(end - src) && IsMemoryImage(type))
+	{
+		const unsigned int* saved_class = FindLayout(ctx.classes, CLASS_HEADER_SIZE, CLASS_FIELD_SIZE, saved_type_hash);
+		if (saved_class != 0 && saved_size == saved_class[2] && IsSameLayout(ctx.classes, saved_class, type->AsClass()))
+		{
+			memcpy(object, src, saved_size);
+			in.SeekRel(src + saved_size - data);
+			return true;
+		}
+	}
+
+	// Data that can't be loaded leaves nothing after it that can be located
+	unsigned int index = GetPlan(ctx, saved_type_hash, saved_size, load_type);
+	const char* data_end = ExecutePlan(ctx, index, src, end, load_type ? (char*)object : 0);
+	in.SeekRel((data_end ? data_end : end) - data);
+	return data_end != 0 && load_type != 0;
+}
+
+
+void clutl::VersionedBinaryStream::Reset()
+{
+	m_SavedTypes.Reset();
+	m_TypeHashes.Reset();
+	m_Classes.Reset();
+	m_Enums.Reset();
+	m_Containers.Reset();
+	m_Plans.Reset();
+	m_PlanOps.Reset();
+	m_ContainerPlans.Reset();
+	m_EnumMaps.Reset();
+	m_EnumValues.Reset();
+}
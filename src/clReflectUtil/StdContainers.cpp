@@ -0,0 +1,328 @@
+//
+// ===============================================================================
+// clReflect
+// -------------------------------------------------------------------------------
+// Copyright (c) 2011-2012 Don Williamson & clReflect Authors (see AUTHORS file)
+// Released under MIT License (see LICENSE file)
+// ===============================================================================
+//
+
+#include <clutl/StdContainers.h>
+
+
+// Registered container operations; zero-initialised before any registration runs
+static clutl::StdContainerOps* g_StdContainerOps = 0;
+
+
+namespace
+{
+	bool ArgMatches(clutl::StdContainerOps::NameHashFunc name_hash, bool is_ptr, const clcpp::TemplateType* type, int index)
+	{
+		const clcpp::Type* arg_type = type->parameter_types[index];
+		return arg_type != 0 && arg_type->name.hash == name_hash() && type->parameter_ptrs[index] == is_ptr;
+	}
+
+
+	const clcpp::TemplateType* GetTemplateType(const clcpp::Primitive* primitive)
+	{
+		clcpp::internal::Assert(primitive != 0);
+		clcpp::internal::Assert(primitive->kind == clcpp::Primitive::KIND_TEMPLATE_TYPE);
+		return (const clcpp::TemplateType*)primitive;
+	}
+
+
+	const clutl::StdContainerOps* GetOps(clutl::StdContainerOps::Kind kind, const clcpp::TemplateType* type)
+	{
+		const clutl::StdContainerOps* ops = clutl::FindStdContainerOps(kind, type);
+		clcpp::internal::Assert(ops != 0 && "Standard container instantiation hasn't been registered");
+		return ops;
+	}
+}
+
+
+clutl::StdContainerOps::StdContainerOps(Kind kind, NameHashFunc key_name_hash, bool key_is_ptr, NameHashFunc value_name_hash, bool value_is_ptr)
+	: size(0)
+	, reserve(0)
+	, data(0)
+	, resize(0)
+	, grow(0)
+	, value_size(0)
+	, begin(0)
+	, end(0)
+	, get(0)
+	, move_next(0)
+	, clear(0)
+	, insert(0)
+	, kind(kind)
+	, key_name_hash(key_name_hash)
+	, key_is_ptr(key_is_ptr)
+	, value_name_hash(value_name_hash)
+	, value_is_ptr(value_is_ptr)
+	, next(g_StdContainerOps)
+{
+	g_StdContainerOps = this;
+}
+
+
+const clutl::StdContainerOps* clutl::FindStdContainerOps(StdContainerOps::Kind kind, const clcpp::TemplateType* type)
+{
+	// Keyed containers take the key as their first argument
+	for (const StdContainerOps* ops = g_StdContainerOps; ops != 0; ops = ops->next)
+	{
+		if (ops->kind != kind)
+			continue;
+		if (ops->key_name_hash == 0)
+		{
+			if (ArgMatches(ops->value_name_hash, ops->value_is_ptr, type, 0))
+				return ops;
+		}
+		else if (ArgMatches(ops->key_name_hash, ops->key_is_ptr, type, 0) && ArgMatches(ops->value_name_hash, ops->value_is_ptr, type, 1))
+		{
+			return ops;
+		}
+	}
+
+	return 0;
+}
+
+
+clutl::StdSequenceReadIterator::StdSequenceReadIterator(StdContainerOps::Kind kind)
+	: m_Kind(kind)
+	, m_Position(0)
+	, m_End(0)
+	, m_Stride(0)
+{
+}
+
+
+void clutl::StdSequenceReadIterator::Initialise(const clcpp::Primitive* primitive, const void* container_object, clcpp::ReadIterator& storage)
+{
+	clcpp::internal::Assert(container_object != 0);
+	const clcpp::TemplateType* type = GetTemplateType(primitive);
+	const StdContainerOps* ops = GetOps(m_Kind, type);
+	if (ops == 0)
+		return;
+
+	// Describe the value type
+	storage.m_ValueType = type->parameter_types[0];
+	storage.m_ValueIsPtr = type->parameter_ptrs[0];
+
+	// Values are contiguous so iteration only needs a pointer into the container memory
+	storage.m_Count = ops->size(container_object);
+	m_Stride = ops->value_size;
+	m_Position = (const char*)ops->data(container_object);
+	m_End = m_Position + storage.m_Count * m_Stride;
+	storage.m_Span.data = (char*)m_Position;
+	storage.m_Span.stride = m_Stride;
+}
+
+
+clcpp::ContainerKeyValue clutl::StdSequenceReadIterator::GetKeyValue() const
+{
+	clcpp::internal::Assert(m_Position < m_End);
+	clcpp::ContainerKeyValue kv;
+	kv.value = m_Position;
+	return kv;
+}
+
+
+void clutl::StdSequenceReadIterator::MoveNext()
+{
+	m_Position += m_Stride;
+}
+
+
+clutl::StdSequenceWriteIterator::StdSequenceWriteIterator(StdContainerOps::Kind kind)
+	: m_Kind(kind)
+	, m_Ops(0)
+	, m_Container(0)
+	, m_Position(0)
+	, m_End(0)
+	, m_Stride(0)
+{
+}
+
+
+void clutl::StdSequenceWriteIterator::Initialise(const clcpp::Primitive* primitive, void* container_object, clcpp::WriteIterator& storage, int count)
+{
+	clcpp::internal::Assert(container_object != 0);
+	const clcpp::TemplateType* type = GetTemplateType(primitive);
+	const StdContainerOps* ops = GetOps(m_Kind, type);
+	if (ops == 0)
+		return;
+
+	// Describe the value type
+	storage.m_ValueType = type->parameter_types[0];
+	storage.m_ValueIsPtr = type->parameter_ptrs[0];
+
+	// Resize once up-front so that adding values only has to step through the new memory
+	storage.m_Count = count;
+	m_Stride = ops->value_size;
+	m_Position = (char*)ops->resize(container_object, count);
+	m_End = m_Position + count * m_Stride;
+	storage.m_Span.data = m_Position;
+	storage.m_Span.stride = m_Stride;
+	m_Ops = ops;
+	m_Container = container_object;
+}
+
+
+void clutl::StdSequenceWriteIterator::GrowTo(unsigned int count)
+{
+	clcpp::internal::Assert(m_Ops != 0);
+	char* data = m_End - m_Ops->size(m_Container) * m_Stride;
+	unsigned int position = (m_Position - data) / m_Stride;
+
+	// Growth is geometric when adding one value at a time, unless capacity was reserved up-front
+	data = (char*)m_Ops->grow(m_Container, count);
+	m_Position = data + position * m_Stride;
+	m_End = data + count * m_Stride;
+}
+
+
+void* clutl::StdSequenceWriteIterator::AddEmpty()
+{
+	if (m_Position == m_End)
+		GrowTo(m_Ops->size(m_Container) + 1);
+	void* value_ptr = m_Position;
+	m_Position += m_Stride;
+	return value_ptr;
+}
+
+
+void* clutl::StdSequenceWriteIterator::AddEmpty(void*)
+{
+	return AddEmpty();
+}
+
+
+void* clutl::StdSequenceWriteIterator::AddEmptyRange(unsigned int count)
+{
+	unsigned int nb_remaining = (m_End - m_Position) / m_Stride;
+	if (count > nb_remaining)
+		GrowTo(m_Ops->size(m_Container) + count - nb_remaining);
+	void* values = m_Position;
+	m_Position += count * m_Stride;
+	return values;
+}
+
+
+void clutl::StdSequenceWriteIterator::Reserve(unsigned int count)
+{
+	clcpp::internal::Assert(m_Ops != 0);
+	char* data = m_End - m_Ops->size(m_Container) * m_Stride;
+	unsigned int position = (m_Position - data) / m_Stride;
+
+	// Reserving may reallocate, moving the values
+	m_Ops->reserve(m_Container, count);
+	data = (char*)m_Ops->data(m_Container);
+	m_End = data + m_Ops->size(m_Container) * m_Stride;
+	m_Position = data + position * m_Stride;
+}
+
+
+clutl::StdAssocReadIterator::StdAssocReadIterator(StdContainerOps::Kind kind)
+	: m_Kind(kind)
+	, m_Ops(0)
+{
+}
+
+
+clutl::StdAssocReadIterator::~StdAssocReadIterator()
+{
+	if (m_Ops != 0)
+		m_Ops->end(m_State);
+}
+
+
+void clutl::StdAssocReadIterator::Initialise(const clcpp::Primitive* primitive, const void* container_object, clcpp::ReadIterator& storage)
+{
+	clcpp::internal::Assert(container_object != 0);
+	const clcpp::TemplateType* type = GetTemplateType(primitive);
+	const StdContainerOps* ops = GetOps(m_Kind, type);
+	if (ops == 0)
+		return;
+
+	// Describe the key/value types
+	storage.m_KeyType = type->parameter_types[0];
+	storage.m_KeyIsPtr = type->parameter_ptrs[0];
+	storage.m_ValueType = type->parameter_types[1];
+	storage.m_ValueIsPtr = type->parameter_ptrs[1];
+
+	storage.m_Count = ops->size(container_object);
+	ops->begin(container_object, m_State);
+	m_Ops = ops;
+}
+
+
+clcpp::ContainerKeyValue clutl::StdAssocReadIterator::GetKeyValue() const
+{
+	return m_Ops->get(m_State);
+}
+
+
+void clutl::StdAssocReadIterator::MoveNext()
+{
+	m_Ops->move_next(m_State);
+}
+
+
+clutl::StdAssocWriteIterator::StdAssocWriteIterator(StdContainerOps::Kind kind)
+	: m_Kind(kind)
+	, m_Ops(0)
+	, m_Container(0)
+{
+}
+
+
+void clutl::StdAssocWriteIterator::Initialise(const clcpp::Primitive* primitive, void* container_object, clcpp::WriteIterator& storage, int count)
+{
+	clcpp::internal::Assert(container_object != 0);
+	const clcpp::TemplateType* type = GetTemplateType(primitive);
+	const StdContainerOps* ops = GetOps(m_Kind, type);
+	if (ops == 0)
+		return;
+
+	// Describe the key/value types
+	storage.m_KeyType = type->parameter_types[0];
+	storage.m_KeyIsPtr = type->parameter_ptrs[0];
+	storage.m_ValueType = type->parameter_types[1];
+	storage.m_ValueIsPtr = type->parameter_ptrs[1];
+
+	storage.m_Count = count;
+	ops->clear(container_object, count);
+	m_Ops = ops;
+	m_Container = container_object;
+}
+
+
+void* clutl::StdAssocWriteIterator::AddEmpty()
+{
+	clcpp::internal::Assert(false && "Values can only be added to maps with a key");
+	return 0;
+}
+
+
+void* clutl::StdAssocWriteIterator::AddEmpty(void* key)
+{
+	clcpp::internal::Assert(m_Ops != 0);
+	return m_Ops->insert(m_Container, key);
+}
+
+
+void clutl::StdAssocWriteIterator::Reserve(unsigned int count)
+{
+	clcpp::internal::Assert(m_Ops != 0);
+	m_Ops->reserve(m_Container, count);
+}
+
+
+// Construction/destruction functions for the reflected iterators
+clcpp_impl_class(clutl::StdVectorReadIterator)
+clcpp_impl_class(clutl::StdVectorWriteIterator)
+clcpp_impl_class(clutl::StdStringReadIterator)
+clcpp_impl_class(clutl::StdStringWriteIterator)
+clcpp_impl_class(clutl::StdMapReadIterator)
+clcpp_impl_class(clutl::StdMapWriteIterator)
+clcpp_impl_class(clutl::StdUnorderedMapReadIterator)
+clcpp_impl_class(clutl::StdUnorderedMapWriteIterator)